@@ -55,6 +55,33 @@ CC_INC=
 CC_LIB=
 #
 #
+# Instruction decoder of the emulator. Currently supported:
+#  threaded (direct threaded decoder, for native builds, needs GCC or Clang)
+#  table    (function pointer jump table decoder, for Emscripten builds)
+#  jit      (dynamic translator to x86-64 machine code, interprets elsewhere)
+#
+ENGINE=threaded
+#
+#
+# SREG flag evaluation of the instruction decoder. Currently supported:
+#  eager (every instruction computes its flags)
+#  lazy  (add and subtract flags are computed when SREG is accessed, faster
+#         for code rarely using the flags of arithmetic results)
+#
+SREG=eager
+#
+#
+# Flag engine computing the arithmetic flags of instructions. Currently
+# supported:
+#  table    (one large precalculated table, 33 KBytes)
+#  split    (compact precalculated tables, 5 KBytes, H computed separately)
+#  computed (flags computed by logic operations, no tables)
+#  builtin  (V and C from the compiler's overflow checking builtins, needs
+#            GCC or Clang, no tables)
+#
+FLAGS=table
+#
+#
 # In case a test build (debug) is necessary, give 'test' here. It enables
 # extra assertions, and compiles the program with no optimizations, debug
 # symbols enabled.
@@ -52,7 +52,7 @@ endif
 #
 ifeq ($(TSYS),linux)
 CFLAGS+= -DTARGET_LINUX
-LINKB=
+LINKB= -lpthread
 endif
 #
 #
@@ -65,6 +65,36 @@ LINKB= -lmingw32 -mwindows
 endif
 #
 #
+# Instruction decoder
+#
+ifeq ($(ENGINE),threaded)
+CFLAGS+= -DCU_AVR_THREADED
+endif
+ifeq ($(ENGINE),jit)
+CFLAGS+= -DCU_AVR_JIT
+endif
+#
+#
+# SREG flag evaluation
+#
+ifeq ($(SREG),lazy)
+CFLAGS+= -DCU_AVR_LAZY_SREG
+endif
+#
+#
+# Flag engine
+#
+ifeq ($(FLAGS),split)
+CFLAGS+= -DCU_AVRFG_SPLIT
+endif
+ifeq ($(FLAGS),computed)
+CFLAGS+= -DCU_AVRFG_COMPUTED
+endif
+ifeq ($(FLAGS),builtin)
+CFLAGS+= -DCU_AVRFG_BUILTIN
+endif
+#
+#
 # When asking for debug edit
 #
 ifeq ($(GO),test)
@@ -74,9 +104,10 @@ CFLAGS+= -DTARGET_DEBUG
 endif
 #
 #
-# 'Production' edit
+# 'Production' edit (the emulator core is linked as a single LTO partition
+# to keep its opcode handlers together)
 #
-CFSPD?=-O3 -s -flto
+CFSPD?=-O3 -s -flto -flto-partition=one
 CFSIZ?=-Os -s -flto
 #
 #
@@ -0,0 +1,919 @@
+/*
+ *  Fault campaign runner
+ *
+ *  Copyright (C) 2016
+ *    Sandor Zsuga (Jubatian)
+ *  Uzem (the base of CUzeBox) is copyright (C)
+ *    David Etherton,
+ *    Eric Anderton,
+ *    Alec Bourque (Uze),
+ *    Filipe Rinaldi,
+ *    Sandor Zsuga (Jubatian),
+ *    Matt Pandina (Artcfox)
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+
+#include "campaign.h"
+#include "cu_avr.h"
+#include "filesys.h"
+
+#ifdef TARGET_LINUX
+#include <pthread.h>
+#include <unistd.h>
+#define CAMP_THREADS
+#endif
+
+
+
+/* String constants */
+static const char cu_id[]  = "Campaign: ";
+static const char cu_err[] = "Error: ";
+
+
+/* Maximal count of worker threads */
+#define CAMP_WORKERS_MAX 256U
+
+
+/* Output of a run */
+typedef struct{
+ char*  buf;      /* Output text (NULL if none yet) */
+ auint  len;      /* Length of the output text */
+ auint  size;     /* Allocated size of the buffer */
+ boole  trunc;    /* Output truncated (out of memory) */
+ boole  lost;     /* Stuck bit faults lost (out of memory), run invalid */
+}camp_out_t;
+
+
+/* Worker. Its runs not taken yet are lo - hi (exclusive): the worker takes
+** them from the bottom, idle workers steal the upper half of them. */
+typedef struct{
+ cu_avr_ctx_t*   avr;  /* Emulator instance (NULL if the worker is not running) */
+ auint           lo;   /* First run not taken yet */
+ auint           hi;   /* End of runs not taken yet */
+#ifdef CAMP_THREADS
+ pthread_mutex_t lock; /* Protects lo and hi */
+ pthread_t       thrd; /* Thread of the worker (except worker 0, the caller) */
+#endif
+}camp_worker_t;
+
+
+
+/* Initial CPU state of the runs */
+static cu_state_cpu_t const* camp_init;
+
+/* Checkpoint to start the runs from (NULL: start from reset) */
+static cu_avr_ckpt_t* camp_ckpt;
+
+/* Output produced before reaching the checkpoint */
+static camp_out_t camp_pre;
+
+/* Port writes of the configurations, port and value pairs */
+static uint8* camp_cfg;
+
+/* Configurations: start of port writes in camp_cfg (pairs), there is one
+** more entry than runs to get the end of the last one */
+static auint* camp_runs;
+
+/* Count of runs */
+static auint  camp_nrun;
+
+/* Outputs of the runs */
+static camp_out_t* camp_outs;
+
+/* Golden output the runs are compared with (NULL: none), its length and
+** the prefix to stop at when matched (zero: none) */
+static char const* camp_gbuf = NULL;
+static auint       camp_glen = 0U;
+static auint       camp_gpfx = 0U;
+
+/* Outcomes of the golden output comparison of the runs (only if there is a
+** golden output): outcome, matching bytes and cycle for each */
+static auint*      camp_gold;
+
+/* State convergence check: sampling interval (zero: off), the state hash
+** trace of the reference run (the run without port writes), and its output,
+** results, exit status and golden output comparison outcome, which complete
+** those of the runs stopped as masked */
+static auint          camp_civl = 0U;
+static cu_avr_conv_t* camp_conv;
+static camp_out_t     camp_rout;
+static camp_out_t     camp_rres;
+static auint          camp_rstat;
+static auint          camp_rgold[3];
+
+/* Outcomes of the state convergence check of the runs (only if it is on):
+** outcome, cycle of the first divergence and cycle masked at for each */
+static auint*         camp_cst;
+
+/* Hang detection: probing interval (zero: off) and cycle budget as a
+** multiple of the length of the reference run (zero: none), the cycles the
+** reference run started and ended at, then the outcomes of the runs (only
+** if it is on): outcome, cycle stopped at and period of the loop for each */
+static auint          camp_hivl = 0U;
+static auint          camp_hmul = 0U;
+static auint          camp_rbeg;
+static auint          camp_rcyc;
+static auint*         camp_hst;
+
+/* Binary results and exit statuses of the runs (only if results are
+** written), the results produced before reaching the checkpoint */
+static camp_out_t* camp_ress;
+static auint*      camp_stat;
+static camp_out_t  camp_pres;
+
+/* Workers */
+static camp_worker_t camp_wrk[CAMP_WORKERS_MAX];
+
+/* Count of workers */
+static auint  camp_nwrk;
+
+
+
+#ifdef CAMP_THREADS
+#define camp_lock(wrk)   pthread_mutex_lock(&((wrk)->lock))
+#define camp_unlock(wrk) pthread_mutex_unlock(&((wrk)->lock))
+#else
+#define camp_lock(wrk)
+#define camp_unlock(wrk)
+#endif
+
+
+
+/*
+** Output function of the emulator instances collecting the output of a run.
+*/
+static void camp_print(void* user, char const* str, auint len)
+{
+ camp_out_t* out = user;
+ char*       nbuf;
+ auint       nsize;
+
+ if ((out->len + len) > out->size){
+  nsize = (out->size == 0U) ? 256U : (out->size << 1);
+  while (nsize < (out->len + len)){ nsize <<= 1; }
+  nbuf = realloc(out->buf, nsize);
+  if (nbuf == NULL){
+   out->trunc = TRUE;
+   return;
+  }
+  out->buf  = nbuf;
+  out->size = nsize;
+ }
+
+ memcpy(out->buf + out->len, str, len);
+ out->len += len;
+}
+
+
+
+/*
+** Result function of the emulator instances collecting the binary results
+** of a run.
+*/
+static void camp_result(void* user, uint8 const* data, auint len)
+{
+ camp_print(user, (char const*)(data), len);
+}
+
+
+
+/*
+** Takes a run for the given worker. Returns FALSE if there are no more runs.
+*/
+static boole camp_take(auint wid, auint* run)
+{
+ camp_worker_t* own = &(camp_wrk[wid]);
+ camp_worker_t* vic;
+ auint          i;
+ auint          lo = 0U;
+ auint          hi = 0U;
+
+ /* Own runs */
+
+ camp_lock(own);
+ if (own->lo < own->hi){
+  lo = own->lo;
+  hi = lo + 1U;
+  own->lo ++;
+ }
+ camp_unlock(own);
+ if (lo != hi){
+  *run = lo;
+  return TRUE;
+ }
+
+ /* Steal the upper half of the runs of another worker */
+
+ for (i = 1U; i < camp_nwrk; i++){
+  vic = &(camp_wrk[(wid + i) % camp_nwrk]);
+  camp_lock(vic);
+  if (vic->lo < vic->hi){
+   lo = vic->hi - (((vic->hi - vic->lo) + 1U) >> 1);
+   hi = vic->hi;
+   vic->hi = lo;
+  }
+  camp_unlock(vic);
+  if (lo != hi){
+   camp_lock(own);
+   own->lo = lo + 1U;
+   own->hi = hi;
+   camp_unlock(own);
+   *run = lo;
+   return TRUE;
+  }
+ }
+
+ return FALSE;
+}
+
+
+
+/*
+** Brings an emulator instance to the start of the runs: the checkpoint, or
+** reset if there is none. Either only copies what the previous run altered.
+*/
+static void camp_start(cu_avr_ctx_t* avr)
+{
+ if (camp_ckpt != NULL){
+  cu_avr_ckpt_restore(avr, camp_ckpt);
+ }else{
+  cu_avr_reset_to(avr, camp_init);
+ }
+}
+
+
+
+/*
+** Completes the output of a run stopped as masked with the rest of the
+** reference run's: having the same state, the run would continue the same.
+*/
+static void camp_complete(camp_out_t* out, camp_out_t const* ref)
+{
+ if ((!out->trunc) && (out->len < ref->len)){
+  camp_print(out, ref->buf + out->len, ref->len - out->len);
+ }
+ out->trunc |= ref->trunc;
+}
+
+
+
+/*
+** Returns the cycle budget of the runs for hang detection (zero: none):
+** the configured multiple of the length of the reference run.
+*/
+static auint camp_hang_budget(void)
+{
+ auint len = camp_rcyc - camp_rbeg;
+ auint bud;
+
+ if ((camp_hmul == 0U) || (len == 0U)){ return 0U; }
+ if (len > ((~0U - camp_rbeg) / camp_hmul)){ return 0U; } /* Beyond the cycle counter */
+ bud = camp_rbeg + (camp_hmul * len);
+
+ return bud;
+}
+
+
+
+/*
+** Executes a run on an emulator instance.
+*/
+static void camp_exec(cu_avr_ctx_t* avr, auint run)
+{
+ auint i;
+
+ cu_avr_set_output(avr, &camp_print, &(camp_outs[run]));
+ cu_avr_set_golden(avr, camp_gbuf, camp_glen, camp_gpfx);
+ cu_avr_set_conv(avr, camp_conv, FALSE);
+ cu_avr_set_hang(avr, camp_hivl, camp_rcyc, camp_hang_budget());
+ if (camp_ress != NULL){
+  cu_avr_set_result(avr, &camp_result, &(camp_ress[run]));
+ }
+ camp_start(avr);
+
+ for (i = camp_runs[run]; i < camp_runs[run + 1U]; i++){
+  cu_avr_write_port(avr, camp_cfg[(i << 1)     ],
+                         camp_cfg[(i << 1) + 1U]);
+ }
+
+ cu_avr_run(avr);
+ camp_outs[run].lost = cu_avr_stuck_lost(avr);
+
+ if (camp_stat != NULL){
+  camp_stat[run] = cu_avr_get_status(avr);
+ }
+ if (camp_gold != NULL){
+  camp_gold[(run * 3U)] = cu_avr_get_golden(avr, &camp_gold[(run * 3U) + 1U],
+                                                 &camp_gold[(run * 3U) + 2U]);
+ }
+
+ if (camp_cst != NULL){
+  camp_cst[(run * 3U)] = cu_avr_get_conv(avr, &camp_cst[(run * 3U) + 1U],
+                                              &camp_cst[(run * 3U) + 2U]);
+  if (camp_cst[(run * 3U)] == CU_AVR_CONV_MASKED){
+   camp_complete(&(camp_outs[run]), &camp_rout);
+   if (camp_ress != NULL){
+    camp_complete(&(camp_ress[run]), &camp_rres);
+    camp_stat[run] = camp_rstat;
+   }
+   if (camp_gold != NULL){
+    memcpy(&camp_gold[(run * 3U)], &camp_rgold[0], sizeof(camp_rgold));
+   }
+  }
+ }
+
+ if (camp_hst != NULL){
+  camp_hst[(run * 3U)] = cu_avr_get_hang(avr, &camp_hst[(run * 3U) + 1U],
+                                              &camp_hst[(run * 3U) + 2U]);
+ }
+}
+
+
+
+/*
+** Worker: executes runs while there are any.
+*/
+static void* camp_worker(void* arg)
+{
+ auint wid = (auint)((camp_worker_t*)(arg) - &(camp_wrk[0]));
+ auint run;
+
+ while (camp_take(wid, &run)){
+  camp_exec(camp_wrk[wid].avr, run);
+ }
+
+ return NULL;
+}
+
+
+
+/*
+** Parses a hexadecimal byte (one or two digits) from the configuration.
+** Returns FALSE if there is no hexadecimal digit.
+*/
+static boole camp_hex(char const** pos, auint* val)
+{
+ auint i;
+ auint ch;
+
+ *val = 0U;
+ for (i = 0U; i < 2U; i++){
+  ch = (uint8)(**pos);
+  if       ( (ch >= (uint8)('0')) &&
+             (ch <= (uint8)('9')) ){
+   *val = (*val << 4) | (ch - (uint8)('0'));
+  }else if ( (ch >= (uint8)('a')) &&
+             (ch <= (uint8)('f')) ){
+   *val = (*val << 4) | (ch - (uint8)('a') + 10U);
+  }else if ( (ch >= (uint8)('A')) &&
+             (ch <= (uint8)('F')) ){
+   *val = (*val << 4) | (ch - (uint8)('A') + 10U);
+  }else{
+   break;
+  }
+  (*pos) ++;
+ }
+
+ return (i != 0U);
+}
+
+
+
+/*
+** Loads and parses the campaign file. Returns TRUE on success.
+*/
+static boole camp_load(char const* fname)
+{
+ char*       text = NULL;
+ char*       ntext;
+ char const* pos;
+ auint       tlen = 0U;
+ auint       tsize = 0U;
+ auint       rb;
+ auint       ncfg = 0U;
+ auint       lpos = 1U;
+ auint       port;
+ auint       val;
+ boole       isrun;
+
+ if (!filesys_open(FILESYS_CH_EMU, fname)){
+  print_error("%s%sCouldn't open %s.\n", cu_id, cu_err, fname);
+  return FALSE;
+ }
+
+ /* Read the whole file, terminated */
+
+ do{
+  if ((tlen + 1024U + 1U) > tsize){
+   tsize = (tsize == 0U) ? 4096U : (tsize << 1);
+   ntext = realloc(text, tsize);
+   if (ntext == NULL){
+    print_error("%s%sOut of memory loading %s.\n", cu_id, cu_err, fname);
+    goto ex_file;
+   }
+   text = ntext;
+  }
+  rb = filesys_read(FILESYS_CH_EMU, (uint8*)(text + tlen), 1024U);
+  tlen += rb;
+ }while (rb != 0U);
+ text[tlen] = 0;
+ filesys_flush(FILESYS_CH_EMU);
+
+ /* Allocate for the worst case: a run on every line, a port write for every
+ ** two characters. */
+
+ camp_nrun = 0U;
+ for (rb = 0U; rb < tlen; rb++){
+  if (text[rb] == '\n'){ camp_nrun ++; }
+ }
+ camp_runs = malloc(sizeof(auint) * (camp_nrun + 2U));
+ camp_cfg  = malloc(tlen + 2U);
+ if ((camp_runs == NULL) || (camp_cfg == NULL)){
+  print_error("%s%sOut of memory loading %s.\n", cu_id, cu_err, fname);
+  goto ex_text;
+ }
+
+ /* Parse the configurations */
+
+ camp_nrun = 0U;
+ camp_runs[0] = 0U;
+ pos   = text;
+ isrun = FALSE;
+ while (TRUE){
+
+  if       ( (*pos == ' ') ||
+             (*pos == '\t') ||
+             (*pos == '\r') ){
+   pos ++;
+
+  }else if (*pos == '#'){
+   while ((*pos != '\n') && (*pos != 0)){ pos ++; }
+
+  }else if ( (*pos == '\n') ||
+             (*pos == 0) ){
+   if (isrun){ camp_nrun ++; }
+   camp_runs[camp_nrun] = ncfg;
+   isrun = FALSE;
+   if (*pos == 0){ break; }
+   pos ++;
+   lpos ++;
+
+  }else if ( (*pos == '-') && (!isrun) ){
+   isrun = TRUE;
+   pos ++;
+
+  }else if (camp_hex(&pos, &port) && (*pos == ':')){
+   isrun = TRUE;
+   do{
+    pos ++;
+    if (!camp_hex(&pos, &val)){
+     print_error("%s%sInvalid value on line %u in %s.\n", cu_id, cu_err, lpos, fname);
+     goto ex_text;
+    }
+    camp_cfg[(ncfg << 1)     ] = port;
+    camp_cfg[(ncfg << 1) + 1U] = val;
+    ncfg ++;
+   }while (*pos == ',');
+
+  }else{
+   print_error("%s%sInvalid content on line %u in %s.\n", cu_id, cu_err, lpos, fname);
+   goto ex_text;
+  }
+
+ }
+
+ free(text);
+ return TRUE;
+
+ex_file:
+ filesys_flush(FILESYS_CH_EMU);
+
+ex_text:
+ free(text);
+ return FALSE;
+}
+
+
+
+/*
+** Runs the program up to its checkpoint (normally where it enables the
+** behaviour modifications), so the runs may start from there. Leaves
+** camp_ckpt NULL if the program doesn't reach one.
+*/
+static void camp_prefix(cu_avr_ctx_t* avr)
+{
+ cu_avr_set_output(avr, &camp_print, &camp_pre);
+ cu_avr_set_golden(avr, camp_gbuf, camp_glen, camp_gpfx);
+ if (camp_ress != NULL){
+  cu_avr_set_result(avr, &camp_result, &camp_pres);
+ }
+ cu_avr_reset_to(avr, camp_init);
+ cu_avr_ckpt_request(avr);
+ cu_avr_run(avr);
+
+ if (cu_avr_ckpt_reached(avr)){
+  camp_ckpt = cu_avr_ckpt_save(avr);
+ }
+ if (camp_ckpt == NULL){
+  camp_pre.len  = 0U; /* Runs start from reset producing this output */
+  camp_pres.len = 0U;
+ }
+}
+
+
+
+/*
+** Runs the program from the start of the runs without port writes,
+** recording the state hash trace the runs are compared with for the state
+** convergence check, and the cycles it took for hang detection.
+*/
+static void camp_reference(cu_avr_ctx_t* avr)
+{
+ cu_avr_set_output(avr, &camp_print, &camp_rout);
+ cu_avr_set_golden(avr, camp_gbuf, camp_glen, camp_gpfx);
+ cu_avr_set_conv(avr, camp_conv, TRUE);
+ cu_avr_set_hang(avr, 0U, 0U, 0U);
+ if (camp_ress != NULL){
+  cu_avr_set_result(avr, &camp_result, &camp_rres);
+ }
+ camp_start(avr);
+ camp_rbeg = cu_avr_getcycle(avr);
+ cu_avr_run(avr);
+ camp_rcyc = cu_avr_getcycle(avr);
+
+ camp_rstat    = cu_avr_get_status(avr);
+ camp_rgold[0] = cu_avr_get_golden(avr, &camp_rgold[1], &camp_rgold[2]);
+}
+
+
+
+/*
+** Writes the header of a record into a binary result file. Returns TRUE on
+** success.
+*/
+static boole camp_rec_hdr(FILE* fp, auint run, auint status, auint len)
+{
+ uint8 hdr[12];
+ auint i;
+
+ for (i = 0U; i < 4U; i++){
+  hdr[i     ] = (uint8)(run    >> (i * 8U));
+  hdr[i + 4U] = (uint8)(status >> (i * 8U));
+  hdr[i + 8U] = (uint8)(len    >> (i * 8U));
+ }
+
+ return (fwrite(&hdr[0], 1U, 12U, fp) == 12U);
+}
+
+
+
+/*
+** Writes a record into a binary result file: the run's number, its exit
+** status and the length of its results (32 bit little endian values), then
+** its results. Returns TRUE on success.
+*/
+boole campaign_result(FILE* fp, auint run, auint status,
+                      uint8 const* data, auint len)
+{
+ if (!camp_rec_hdr(fp, run, status, len)){ return FALSE; }
+ if ((len != 0U) && (fwrite(data, 1U, len, fp) != len)){ return FALSE; }
+
+ return TRUE;
+}
+
+
+
+/*
+** Writes the binary results of the runs into the given file (in the order
+** of the configurations). Returns TRUE on success.
+*/
+static boole camp_results(char const* rname)
+{
+ FILE* fp = fopen(rname, "wb");
+ auint i;
+ boole ret = TRUE;
+
+ if (fp == NULL){
+  print_error("%s%sCouldn't open %s for writing.\n", cu_id, cu_err, rname);
+  return FALSE;
+ }
+
+ for (i = 0U; i < camp_nrun; i++){
+  if (camp_ress[i].trunc || camp_pres.trunc){
+   print_error("%s%sResults of run %u truncated.\n", cu_id, cu_err, i);
+  }
+  ret = camp_rec_hdr(fp, i, camp_stat[i], camp_pres.len + camp_ress[i].len);
+  if (ret && (camp_pres.len != 0U)){
+   ret = (fwrite(camp_pres.buf, 1U, camp_pres.len, fp) == camp_pres.len);
+  }
+  if (ret && (camp_ress[i].len != 0U)){
+   ret = (fwrite(camp_ress[i].buf, 1U, camp_ress[i].len, fp) == camp_ress[i].len);
+  }
+  if (!ret){ break; }
+ }
+
+ if ((fclose(fp) != 0) || (!ret)){
+  print_error("%s%sCouldn't write %s.\n", cu_id, cu_err, rname);
+  return FALSE;
+ }
+
+ return TRUE;
+}
+
+
+
+/*
+** Writes the outcome of a golden output comparison as a line of text.
+*/
+void  campaign_golden(FILE* fp, auint st, auint pos, auint cycle, auint len)
+{
+ if       (st == CU_AVR_GOLD_DIFF){
+  fprintf(fp, "Golden: diverged at byte %u, cycle %u.\n", pos, cycle);
+ }else if (st == CU_AVR_GOLD_PREFIX){
+  fprintf(fp, "Golden: prefix of %u bytes matched, cycle %u.\n", pos, cycle);
+ }else if (pos < len){
+  fprintf(fp, "Golden: output ended at byte %u.\n", pos);
+ }else{
+  fprintf(fp, "Golden: matched.\n");
+ }
+}
+
+
+
+/*
+** Sets the golden output the text output of the runs is compared with.
+*/
+void  campaign_set_golden(char const* gold, auint len, auint prefix)
+{
+ camp_gbuf = gold;
+ camp_glen = len;
+ camp_gpfx = prefix;
+}
+
+
+
+/*
+** Writes the outcome of a state convergence check as a line of text.
+*/
+static void camp_conv_print(auint st, auint dcyc, auint cycle)
+{
+ if       (st == CU_AVR_CONV_MASKED){
+  if (dcyc != 0U){
+   print_message("State: masked at cycle %u, diverged at cycle %u.\n", cycle, dcyc);
+  }else{
+   print_message("State: masked at cycle %u.\n", cycle);
+  }
+ }else if (st == CU_AVR_CONV_DIFF){
+  print_message("State: diverged at cycle %u.\n", dcyc);
+ }else{
+  print_message("State: no divergence seen.\n");
+ }
+}
+
+
+
+/*
+** Sets the interval of the state convergence check in cycles (zero turns
+** it off).
+*/
+void  campaign_set_conv(auint ival)
+{
+ camp_civl = ival;
+}
+
+
+
+/*
+** Writes the outcome of hang detection as a line of text.
+*/
+void  campaign_hang(FILE* fp, auint st, auint cycle, auint period)
+{
+ if       (st == CU_AVR_HANG_LOOP){
+  fprintf(fp, "Hang: loop of %u cycles at cycle %u.\n", period, cycle);
+ }else if (st == CU_AVR_HANG_BUDGET){
+  fprintf(fp, "Hang: cycle budget exhausted at cycle %u.\n", cycle);
+ }else{
+  fprintf(fp, "Hang: none detected.\n");
+ }
+}
+
+
+
+/*
+** Sets up hang detection for the runs.
+*/
+void  campaign_set_hang(auint ival, auint mult)
+{
+ camp_hivl = ival;
+ camp_hmul = mult;
+}
+
+
+
+/*
+** Runs a fault campaign.
+*/
+boole campaign_run(cu_state_cpu_t const* init, char const* fname, auint threads,
+                   char const* rname)
+{
+ auint i;
+ boole ret = FALSE;
+
+ camp_init = init;
+ camp_ckpt = NULL;
+ camp_cfg  = NULL;
+ camp_runs = NULL;
+ camp_outs = NULL;
+ camp_ress = NULL;
+ camp_stat = NULL;
+ camp_gold = NULL;
+ camp_conv = NULL;
+ camp_cst  = NULL;
+ camp_hst  = NULL;
+ camp_rbeg = 0U;
+ camp_rcyc = 0U;
+ memset(&camp_pre,  0, sizeof(camp_pre));
+ memset(&camp_pres, 0, sizeof(camp_pres));
+ memset(&camp_rout, 0, sizeof(camp_rout));
+ memset(&camp_rres, 0, sizeof(camp_rres));
+
+ if (!camp_load(fname)){ goto ex_free; }
+
+ camp_outs = calloc(camp_nrun + 1U, sizeof(camp_out_t));
+ if (camp_outs == NULL){
+  print_error("%s%sOut of memory.\n", cu_id, cu_err);
+  goto ex_free;
+ }
+ if (camp_gbuf != NULL){
+  camp_gold = calloc((camp_nrun + 1U) * 3U, sizeof(auint));
+  if (camp_gold == NULL){
+   print_error("%s%sOut of memory.\n", cu_id, cu_err);
+   goto ex_free;
+  }
+ }
+ if (camp_civl != 0U){
+  camp_conv = cu_avr_conv_new(camp_civl);
+  camp_cst  = calloc((camp_nrun + 1U) * 3U, sizeof(auint));
+  if ((camp_conv == NULL) || (camp_cst == NULL)){
+   print_error("%s%sOut of memory.\n", cu_id, cu_err);
+   goto ex_free;
+  }
+ }
+ if ((camp_hivl != 0U) || (camp_hmul != 0U)){
+  camp_hst  = calloc((camp_nrun + 1U) * 3U, sizeof(auint));
+  if (camp_hst == NULL){
+   print_error("%s%sOut of memory.\n", cu_id, cu_err);
+   goto ex_free;
+  }
+ }
+ if (rname != NULL){
+  camp_ress = calloc(camp_nrun + 1U, sizeof(camp_out_t));
+  camp_stat = calloc(camp_nrun + 1U, sizeof(auint));
+  if ((camp_ress == NULL) || (camp_stat == NULL)){
+   print_error("%s%sOut of memory.\n", cu_id, cu_err);
+   goto ex_free;
+  }
+ }
+
+ /* Set up the workers, giving each an even share of the runs */
+
+#ifdef CAMP_THREADS
+ if (threads == 0U){
+  threads = (auint)(sysconf(_SC_NPROCESSORS_ONLN));
+ }
+#else
+ threads = 1U;
+#endif
+ if (threads > CAMP_WORKERS_MAX){ threads = CAMP_WORKERS_MAX; }
+ if (threads > camp_nrun){        threads = camp_nrun; }
+ if (threads == 0U){              threads = 1U; }
+
+ camp_nwrk = threads;
+ for (i = 0U; i < camp_nwrk; i++){
+  camp_wrk[i].lo  = (camp_nrun * (i     )) / camp_nwrk;
+  camp_wrk[i].hi  = (camp_nrun * (i + 1U)) / camp_nwrk;
+  camp_wrk[i].avr = cu_avr_new();
+#ifdef CAMP_THREADS
+  pthread_mutex_init(&(camp_wrk[i].lock), NULL);
+#endif
+ }
+
+ if (camp_wrk[0].avr == NULL){
+  print_error("%s%sOut of memory.\n", cu_id, cu_err);
+  goto ex_wrk;
+ }
+
+ /* Run them. The caller is the first worker, the runs of workers which
+ ** could not be started are stolen by the others. The runs start from the
+ ** checkpoint of the program if it has one. */
+
+ camp_prefix(camp_wrk[0].avr);
+ if ((camp_conv != NULL) || (camp_hst != NULL)){
+  camp_reference(camp_wrk[0].avr);
+ }
+
+#ifdef CAMP_THREADS
+ for (i = 1U; i < camp_nwrk; i++){
+  if (camp_wrk[i].avr != NULL){
+   if (pthread_create(&(camp_wrk[i].thrd), NULL, &camp_worker, &(camp_wrk[i])) != 0){
+    cu_avr_free(camp_wrk[i].avr);
+    camp_wrk[i].avr = NULL;
+   }
+  }
+ }
+#endif
+
+ (void)(camp_worker(&(camp_wrk[0])));
+
+#ifdef CAMP_THREADS
+ for (i = 1U; i < camp_nwrk; i++){
+  if (camp_wrk[i].avr != NULL){
+   pthread_join(camp_wrk[i].thrd, NULL);
+  }
+ }
+#endif
+
+ /* Output results in the order of the configurations */
+
+ for (i = 0U; i < camp_nrun; i++){
+  print_message("Run %u:\n", i);
+  if (camp_pre.len != 0U){
+   fwrite(camp_pre.buf, 1U, camp_pre.len, stdout);
+  }
+  if (camp_outs[i].len != 0U){
+   fwrite(camp_outs[i].buf, 1U, camp_outs[i].len, stdout);
+  }
+  print_unf("\n");
+  if (camp_gold != NULL){
+   campaign_golden(stdout, camp_gold[(i * 3U)], camp_gold[(i * 3U) + 1U],
+                   camp_gold[(i * 3U) + 2U], camp_glen);
+  }
+  if (camp_cst != NULL){
+   camp_conv_print(camp_cst[(i * 3U)], camp_cst[(i * 3U) + 1U],
+                   camp_cst[(i * 3U) + 2U]);
+  }
+  if (camp_hst != NULL){
+   campaign_hang(stdout, camp_hst[(i * 3U)], camp_hst[(i * 3U) + 1U],
+                 camp_hst[(i * 3U) + 2U]);
+  }
+  if (camp_outs[i].trunc || camp_pre.trunc){
+   print_error("%s%sOutput of run %u truncated.\n", cu_id, cu_err, i);
+  }
+  if (camp_outs[i].lost){
+   print_error("%s%sRun %u is invalid: out of memory for its stuck bit faults.\n", cu_id, cu_err, i);
+  }
+ }
+ ret = (rname != NULL) ? camp_results(rname) : TRUE;
+
+ex_wrk:
+ for (i = 0U; i < camp_nwrk; i++){
+  cu_avr_free(camp_wrk[i].avr);
+  camp_wrk[i].avr = NULL;
+#ifdef CAMP_THREADS
+  pthread_mutex_destroy(&(camp_wrk[i].lock));
+#endif
+ }
+
+ex_free:
+ if (camp_outs != NULL){
+  for (i = 0U; i < camp_nrun; i++){
+   free(camp_outs[i].buf);
+  }
+ }
+ free(camp_outs);
+ if (camp_ress != NULL){
+  for (i = 0U; i < camp_nrun; i++){
+   free(camp_ress[i].buf);
+  }
+ }
+ free(camp_ress);
+ free(camp_stat);
+ free(camp_gold);
+ free(camp_cst);
+ free(camp_hst);
+ cu_avr_conv_free(camp_conv);
+ free(camp_rout.buf);
+ free(camp_rres.buf);
+ free(camp_pre.buf);
+ free(camp_pres.buf);
+ cu_avr_ckpt_free(camp_ckpt);
+ free(camp_runs);
+ free(camp_cfg);
+
+ return ret;
+}
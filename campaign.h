@@ -0,0 +1,121 @@
+/*
+ *  Fault campaign runner
+ *
+ *  Copyright (C) 2016
+ *    Sandor Zsuga (Jubatian)
+ *  Uzem (the base of CUzeBox) is copyright (C)
+ *    David Etherton,
+ *    Eric Anderton,
+ *    Alec Bourque (Uze),
+ *    Filipe Rinaldi,
+ *    Sandor Zsuga (Jubatian),
+ *    Matt Pandina (Artcfox)
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+
+#ifndef CAMPAIGN_H
+#define CAMPAIGN_H
+
+
+
+#include "types.h"
+#include "cu_types.h"
+
+
+
+/*
+** Runs a fault campaign: the program is run once for every configuration
+** in the campaign file, starting from the passed initial CPU state
+** (normally all zero except the loaded Code ROM and the watchdog seed). The
+** runs are distributed across the given count of worker threads (zero: one
+** for every processor), then the output of each is written onto the
+** standard output in the order of the configurations.
+**
+** The campaign file holds one configuration on each line, "#" starts a
+** comment. A configuration is a list of port writes in hexadecimal, such as
+** "F1:00,FE,20,01 F6:FF,FF,00,94" to set up a stuck bit and an instruction
+** skip, as if the program wrote these bytes into the ports 0xF1 and 0xF6.
+** A line of a single "-" is a run without port writes.
+**
+** The program is run only once up to its checkpoint (as defined at
+** cu_avr_ckpt_request()), then each run continues from there performing its
+** port writes. If the program has no checkpoint, each run starts from reset,
+** performing its port writes after it.
+**
+** If rname is non-NULL, the binary results of the runs are written into
+** that file (see campaign_result()), each beginning with those produced
+** before the checkpoint.
+**
+** Returns TRUE if the campaign could be run.
+*/
+boole campaign_run(cu_state_cpu_t const* init, char const* fname, auint threads,
+                   char const* rname);
+
+
+/*
+** Sets the golden output (of len bytes, NULL to turn off) the text output of
+** the runs is compared with (see cu_avr_set_golden()), the runs stopping
+** when it diverges, or if prefix is nonzero, when that many bytes matched.
+** The outcome of each run is reported after its output. The buffer is not
+** copied.
+*/
+void  campaign_set_golden(char const* gold, auint len, auint prefix);
+
+
+/*
+** Sets the interval of the state convergence check in cycles (zero turns
+** it off, see cu_avr_set_conv()). A reference run without port writes is
+** made first, the runs whose state converges to it are stopped, their
+** output and results completed from the reference's. The outcome of each
+** run is reported after its output.
+*/
+void  campaign_set_conv(auint ival);
+
+
+/*
+** Sets up hang detection for the runs (see cu_avr_set_hang()): probing
+** every ival cycles (zero turns it off) from the cycle the reference run
+** (the run without port writes) ended at, and if mult is nonzero, stopping
+** the runs taking more than mult times the cycles of the reference. The
+** outcome of each run is reported after its output.
+*/
+void  campaign_set_hang(auint ival, auint mult);
+
+
+/*
+** Writes the outcome of a golden output comparison as a line of text.
+*/
+void  campaign_golden(FILE* fp, auint st, auint pos, auint cycle, auint len);
+
+
+/*
+** Writes the outcome of hang detection as a line of text.
+*/
+void  campaign_hang(FILE* fp, auint st, auint cycle, auint period);
+
+
+/*
+** Writes a record into a binary result file: the run's number, its exit
+** status and the length of its results (32 bit little endian values), then
+** its results. Returns TRUE on success.
+*/
+boole campaign_result(FILE* fp, auint run, auint status,
+                      uint8 const* data, auint len);
+
+
+#endif
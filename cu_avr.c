@@ -30,6 +30,7 @@
 #include "cu_avr.h"
 #include "cu_avrc.h"
 #include "cu_avrfg.h"
+#include <stddef.h>
 
 
 
@@ -38,111 +39,386 @@
 
 
 
-/* CPU state */
-cu_state_cpu_t  cpu_state;
+/* SRAM page size (as shift) for tracking the altered areas of the SRAM */
+#define MEM_PAGE_SH    6U
 
-/* Compiled AVR instructions */
-uint32          cpu_code[32768];
+/* Initial size (as shift) of the stuck bit fault set, it grows as needed */
+#define STUCK_SET_SH   6U
 
-/* Access info structure for SRAM */
-uint8           access_mem[4096U];
+/* Stuck bit fault regions (added to the address to form the key) */
+#define STUCK_IO       0x10000U
+#define STUCK_MEM      0x20000U
+#define STUCK_ROM      0x40000U
 
-/* Access info structure for I/O */
-uint8           access_io[256U];
+/* Size of the text output buffer */
+#define OUT_SIZE       4096U
 
-/* Precalculated flags */
-uint8           cpu_pflags[CU_AVRFG_SIZE];
 
-/* Whether the flags were already precalculated */
-boole           pflags_done = FALSE;
 
-/* Next hardware event's cycle. It can be safely set to
-** WRAP32(cpu_state.cycle + 1U) to force full processing next time. */
-auint           cycle_next_event;
+/* Stuck bit fault (AND and OR masks applied on reads of an address) */
+typedef struct{
+ auint key;           /* Region and address, 0 for a free slot */
+ uint8 and_m;         /* AND mask (stuck at 0 bits) */
+ uint8 or_m;          /* OR mask (stuck at 1 bits) */
+}cu_avr_stuck_t;
 
-/* Timer1 TCNT1 adjustment value: WRAP32(cpu_state.cycle - timer1_base)
-** gives the correct TCNT1 any time. */
-auint           timer1_base;
 
-/* Interrupt might be waiting to be serviced flag. This is set nonzero by
-** any event which should trigger an IT including setting the I flag in the
-** status register. It can be safely set nonzero to ask for a certain IT
-** check. */
-boole           event_it;
+/* Sample of a state hash trace */
+typedef struct{
+ auint    cycle;      /* Cycle of the sample, 0 if there is none */
+ uint64   hash;       /* Hash of the state */
+}cu_avr_conv_ent_t;
 
-/* Interrupt entry necessary if set. */
-boole           event_it_enter;
 
-/* Vector to call when entering interrupt */
-auint           event_it_vect;
+/* State hash trace of a reference run: a sample for each interval, taken on
+** the first instruction boundary reaching it with the behaviour
+** modifications disabled */
+struct cu_avr_conv_s{
+ auint              ival;   /* Sampling interval in cycles */
+ auint              len;    /* Count of intervals recorded */
+ auint              size;   /* Allocated count of samples */
+ auint              mcyc;   /* Last cycle the reference enabled modifications */
+ cu_avr_conv_ent_t* ent;    /* Samples by interval (cycle / ival) */
+};
 
-/* ALU behaviour modification: Set if enabled. */
-boole           alu_ismod;
 
-/* Maximal number of cycles to emulate. */
-auint           cycle_count_max;
 
-/* Guard port accessed (second access terminates) */
-boole           guard_isacc;
+/* Emulator instance. All emulation state is held here, so any number of
+** instances may be used, each from one thread at a time. */
+struct cu_avr_ctx_s{
 
-/* Port state machines for 0xE0 - 0xFF */
-auint           port_states[0x20U];
+ /* CPU state */
+ cu_state_cpu_t  cpu_state;
 
-/* Port data for 0xE0 - 0xFF */
-uint8           port_data[0x20U][8U];
+ /* Compiled AVR instructions */
+ uint32          cpu_code[32768];
 
-/* Stuck bits, AND mask, RAM */
-uint8           stuck_0_mem[4096U];
+ /* Fault descriptors of the AVR instructions (FDSC_ flags) */
+ uint8           cpu_fdsc[32768];
 
-/* Stuck bits, OR mask, RAM */
-uint8           stuck_1_mem[4096U];
+ /* Access info structure for SRAM */
+ uint8           access_mem[4096U];
 
-/* Stuck bits, AND mask, IO */
-uint8           stuck_0_io[256U];
-
-/* Stuck bits, OR mask, IO */
-uint8           stuck_1_io[256U];
-
-/* Stuck bits, AND mask, ROM */
-uint8           stuck_0_rom[65536U];
-
-/* Stuck bits, OR mask, ROM */
-uint8           stuck_1_rom[65536U];
-
-/* Skip mask */
-auint           skip_mask;
-
-/* Skip compare value */
-auint           skip_comp;
-
-/* Condition disable mask */
-auint           cond_mask;
-
-/* Condition disable compare value */
-auint           cond_comp;
-
-/* Condition disable: Perform unconditional jump / skip if set */
-boole           cond_jmp;
-
-/* Inc/dec anomalies: Value to match */
-auint           idc_val;
-
-/* Inc/dec anomalies: Affected translated opcode */
-auint           idc_opc;
-
-/* Flag behaviour anomalies, instruction mask */
-auint           flag_mask;
-
-/* Flag behaviour anomalies, instruction compare */
-auint           flag_comp;
-
-/* Flag behaviour anomalies, OR mask */
-auint           flag_or;
-
-/* Flag behaviour anomalies, AND mask */
-auint           flag_and;
+ /* Access info structure for I/O */
+ uint8           access_io[256U];
 
+ /* SRAM pages accessed (so their contents or access info may be altered)
+ ** since the last reset, checkpoint save or restore, and the pages which may
+ ** have nonzero access info as of the last checkpoint save or restore.
+ ** Resets and restores only have to process these. */
+ boole           mem_dirty[4096U >> MEM_PAGE_SH];
+ boole           mem_ckpt[4096U >> MEM_PAGE_SH];
 
+ /* Fingerprint of the SRAM, its access info and the fault descriptors as of
+ ** the last checkpoint save or restore, valid if ckpt_fpv is set. Restoring a
+ ** checkpoint of the same fingerprint only has to copy what was altered since
+ ** (the dirty pages and fault descriptors). */
+ uint64          ckpt_fp;
+ boole           ckpt_fpv;
+
+ /* Memories the instance was last reset to by cu_avr_reset_to() (NULL if
+ ** not, or they may have been altered other than by emulation since) */
+ cu_state_cpu_t const* reset_init;
+
+ /* Fault descriptors may be nonzero (fault matching was configured) */
+ boole           fdsc_set;
+
+ /* Range of fault descriptors rebuilt since the last checkpoint save or
+ ** restore (empty if fdsc_lo >= fdsc_hi) */
+ auint           fdsc_lo;
+ auint           fdsc_hi;
+
+ /* Hash of the Code ROM the compiled code was made from, only valid if
+ ** crom_hv is set (cu_avr_crom_update() clears it instead of hashing the
+ ** whole Code ROM). If crom_chk is set, the Code ROM may have been written
+ ** since (such as through cu_avr_get_state()), so it has to be checked
+ ** against the compiled code before it is relied on. */
+ uint64          crom_hash;
+ boole           crom_hv;
+ boole           crom_chk;
+
+ /* Lazily evaluated flags of the plain opcode handlers (only with
+ ** CU_AVR_LAZY_SREG): SREG is (SREG & sreg_keep) | CU_AVRFG_FVAL(sreg_fidx)
+ ** while sreg_keep is nonzero. The I and T flags are always kept, so these
+ ** are valid in SREG. */
+ auint           sreg_keep;
+ auint           sreg_fidx;
+
+ /* Next hardware event's cycle. It can be safely set to
+ ** WRAP32(cpu_state.cycle + 1U) to force full processing next time. */
+ auint           cycle_next_event;
+
+ /* Timer1 TCNT1 adjustment value: WRAP32(cpu_state.cycle - timer1_base)
+ ** gives the correct TCNT1 any time. */
+ auint           timer1_base;
+
+ /* Interrupt might be waiting to be serviced flag. This is set nonzero by
+ ** any event which should trigger an IT including setting the I flag in the
+ ** status register. It can be safely set nonzero to ask for a certain IT
+ ** check. */
+ boole           event_it;
+
+ /* Interrupt entry necessary if set. */
+ boole           event_it_enter;
+
+ /* Vector to call when entering interrupt */
+ auint           event_it_vect;
+
+ /* ALU behaviour modification: Set if enabled. */
+ boole           alu_ismod;
+
+ /* Maximal number of cycles to emulate. */
+ auint           cycle_count_max;
+
+ /* Event horizon: below this cycle neither a hardware event nor the end of
+ ** emulation may happen within an instruction, so instructions may be
+ ** emulated without checking them. Zero it to request recalculation. */
+ auint           cycle_horizon;
+
+ /* Guard port accessed (second access terminates) */
+ boole           guard_isacc;
+
+ /* Output function for the text output ports (NULL: standard output) */
+ cu_avr_out_t*   out_func;
+ void*           out_user;
+
+ /* Text output buffer, passed to the output when full and when emulation
+ ** returns */
+ auint           out_len;
+ char            out_buf[OUT_SIZE];
+
+ /* Result function for the binary result port (NULL: discarded), and its
+ ** buffer like the text output's */
+ cu_avr_res_t*   res_func;
+ void*           res_user;
+ auint           res_len;
+ uint8           res_buf[OUT_SIZE];
+
+ /* Golden output the text output is compared with (NULL: none), its
+ ** length and the prefix to stop at when matched (zero: none). The count of
+ ** matching bytes so far, the outcome (CU_AVR_GOLD_) and its cycle. */
+ char const*     gold_buf;
+ auint           gold_len;
+ auint           gold_pfx;
+ auint           gold_pos;
+ auint           gold_st;
+ auint           gold_cyc;
+
+ /* Hash of the writes to the text output and binary result ports */
+ uint64          out_hash;
+
+ /* Last cycle the behaviour modifications were enabled at */
+ auint           alu_modcyc;
+
+ /* State hashes: the hashes of the SRAM pages and their sum, valid if
+ ** state_valid is set. Only the pages in hash_dirty (written since they
+ ** were last hashed) are hashed again. */
+ uint64          state_page[4096U >> MEM_PAGE_SH];
+ uint64          state_mem;
+ boole           state_valid;
+ boole           hash_dirty[4096U >> MEM_PAGE_SH];
+
+ /* State convergence check: the trace of the reference run (NULL: none),
+ ** recorded into or compared with, and the cycle of the next sample (zero:
+ ** not scheduled yet). The outcome (CU_AVR_CONV_), the cycle of the first
+ ** divergence and the cycle masking was detected at. */
+ cu_avr_conv_t*  conv;
+ boole           conv_rec;
+ auint           conv_next;
+ auint           conv_st;
+ auint           conv_dcyc;
+ auint           conv_cyc;
+
+ /* Hang detection: enabled, the probing interval (zero: no probing), the
+ ** cycle to start probing at and the cycle budget (~0U: none). A probe is
+ ** in progress (stepping instructions) until hang_end, otherwise the next
+ ** starts at hang_next. The loop head candidate of the probe (the target of
+ ** a backward jump, hang_lim zero: none yet) with its cycle, timer phase and
+ ** distance to the next hardware event, I/O registers and state hash,
+ ** whether the timer was read since it, the count of backward jumps since
+ ** it, and their limit for moving the candidate. The outcome (CU_AVR_HANG_),
+ ** its cycle and the period of the loop. */
+ boole           hang_on;
+ auint           hang_ival;
+ auint           hang_start;
+ auint           hang_budget;
+ boole           hang_probe;
+ auint           hang_end;
+ auint           hang_next;
+ auint           hang_apc;
+ auint           hang_acyc;
+ auint           hang_atph;
+ auint           hang_atev;
+ uint8           hang_aio[256U];
+ uint64          hang_ahash;
+ boole           hang_tread;
+ auint           hang_cnt;
+ auint           hang_lim;
+ auint           hang_st;
+ auint           hang_cyc;
+ auint           hang_per;
+
+ /* Cycle profile (prof NULL: none): the counters of the Code ROM words the
+ ** samples are added to, the interval of the samples and the cycle of the
+ ** next one (~0U: no more). */
+ auint*          prof;
+ auint           prof_ival;
+ auint           prof_next;
+
+ /* Checkpoint requested: stop emulation when reaching the next one */
+ boole           ckpt_req;
+
+ /* Checkpoint reached: emulation stopped there, cycle_count_max is saved
+ ** in ckpt_cmax */
+ boole           ckpt_hit;
+ auint           ckpt_cmax;
+
+ /* Port state machines for 0xE0 - 0xFF */
+ auint           port_states[0x20U];
+
+ /* Port data for 0xE0 - 0xFF */
+ uint8           port_data[0x20U][8U];
+
+ /* Stuck bit faults: an open addressing hash set of (1 << stuck_sh) slots
+ ** holding stuck_cnt faults */
+ cu_avr_stuck_t* stuck_set;
+ auint           stuck_sh;
+ auint           stuck_cnt;
+
+ /* A stuck bit fault could not be added (out of memory) */
+ boole           stuck_lost;
+
+ /* Stuck bit fault presence bitmaps, only the addresses marked here have
+ ** faults in the set */
+ uint8           stuck_map_mem[4096U  >> 3];
+ uint8           stuck_map_io[256U    >> 3];
+ uint8           stuck_map_rom[65536U >> 3];
+
+ /* Skip mask */
+ auint           skip_mask;
+
+ /* Skip compare value */
+ auint           skip_comp;
+
+ /* Condition disable mask */
+ auint           cond_mask;
+
+ /* Condition disable compare value */
+ auint           cond_comp;
+
+ /* Condition disable: Perform unconditional jump / skip if set (always FALSE
+ ** while behaviour modifications are disabled) */
+ boole           cond_jmp;
+
+ /* Inc/dec anomalies: Value to match */
+ auint           idc_val;
+
+ /* Inc/dec anomalies: Affected translated opcode */
+ auint           idc_opc;
+
+ /* Flag behaviour anomalies, instruction mask */
+ auint           flag_mask;
+
+ /* Flag behaviour anomalies, instruction compare */
+ auint           flag_comp;
+
+ /* Flag behaviour anomalies, OR mask */
+ auint           flag_or;
+
+ /* Flag behaviour anomalies, AND mask */
+ auint           flag_and;
+
+#ifdef CU_AVR_THREADED
+ /* Handler addresses of the compiled AVR instructions */
+ void*           cpu_thrd[32768];
+
+ /* Handler address table by opcode, retrieved from cu_avr_thrd_exec() */
+ void* const*    thrd_table;
+#endif
+
+#ifdef CU_AVR_JIT
+ /* Code cache (NULL if translation is not possible) */
+ uint8*          jit_cache;
+
+ /* Whether the code cache allocation was already attempted */
+ boole           jit_inited;
+
+ /* Code cache fill offset and offset of the first translated block */
+ auint           jit_fill;
+ auint           jit_base;
+
+ /* Translated blocks by word address (NULL: not translated) */
+ void*           jit_blocks[32768U];
+
+ /* Host flags (AH after LAHF, OF in bit 8) to AVR flags */
+ uint8           jit_fmap[512U];
+
+ /* Entry, exits and dispatch of the translated code (see cu_avr_j.h) */
+ auint         (*jit_enter)(void* blk);
+ uint8*          jit_exit0;
+ uint8*          jit_exit1;
+ uint8*          jit_dispatch;
+#endif
+
+};
+
+
+
+/* Checkpoint: the state of an instance to continue emulation from. This is
+** everything altered by emulation except for the compiled code (which
+** follows from the Code ROM). */
+struct cu_avr_ckpt_s{
+
+ cu_state_cpu_t  cpu_state;
+ uint8           cpu_fdsc[32768];
+ uint8           access_mem[4096U];
+ uint8           access_io[256U];
+ boole           mem_used[4096U >> MEM_PAGE_SH]; /* May have nonzero access info */
+ uint64          mem_fp;       /* Fingerprint (see ckpt_fp in the instance) */
+ boole           fdsc_set;
+ uint64          crom_hash;
+ auint           cycle_next_event;
+ auint           timer1_base;
+ boole           event_it;
+ boole           event_it_enter;
+ auint           event_it_vect;
+ boole           alu_ismod;
+ auint           cycle_count_max;
+ boole           guard_isacc;
+ auint           gold_pos;
+ auint           gold_st;
+ auint           gold_cyc;
+ uint64          out_hash;
+ auint           alu_modcyc;
+ auint           port_states[0x20U];
+ uint8           port_data[0x20U][8U];
+ cu_avr_stuck_t* stuck_set;    /* The faults (stuck_cnt), packed */
+ auint           stuck_cnt;
+ boole           stuck_lost;
+ auint           skip_mask;
+ auint           skip_comp;
+ auint           cond_mask;
+ auint           cond_comp;
+ boole           cond_jmp;
+ auint           idc_val;
+ auint           idc_opc;
+ auint           flag_mask;
+ auint           flag_comp;
+ auint           flag_or;
+ auint           flag_and;
+
+};
+
+
+
+/* Whether flags are evaluated lazily (see cu_avr_sreg_sync()). This pays
+** off on code which rarely uses the flags of arithmetic results, otherwise
+** the bookkeeping costs more than computing the flags. */
+#ifdef CU_AVR_LAZY_SREG
+#define SREG_LAZY TRUE
+#else
+#define SREG_LAZY FALSE
+#endif
 
 /* Initial maximal number of cycles */
 #define CYCLE_COUNT_MAX_INI 8000000U
@@ -209,20 +485,72 @@ auint           flag_and;
  }while(0)
 
 
+/* Macro for marking an access in the SRAM access info, also marking the page
+** of the SRAM as altered */
+#define MEM_ACCESS(off, acc) \
+ do{ \
+  ctx->access_mem[off] |= (acc); \
+  ctx->mem_dirty[(off) >> MEM_PAGE_SH] = TRUE; \
+ }while(0)
+
+
+/* Macro for marking a write in the SRAM access info, also marking the page
+** to be hashed again for the state hash */
+#define MEM_WRITE(off) \
+ do{ \
+  MEM_ACCESS(off, CU_MEM_W); \
+  ctx->hash_dirty[(off) >> MEM_PAGE_SH] = TRUE; \
+ }while(0)
+
+
+/* Macro for checking the presence bitmap of stuck bit faults */
+#define STUCK_HAS(map, off) \
+ (((map)[(off) >> 3] & (1U << ((off) & 7U))) != 0U)
+
+
 /* Macro for updating hardware from within instructions */
 #define UPDATE_HARDWARE \
  do{ \
-  cpu_state.cycle = WRAP32(cpu_state.cycle + 1U); \
-  if (cycle_next_event == cpu_state.cycle){ cu_avr_hwexec(); } \
+  ctx->cpu_state.cycle = WRAP32(ctx->cpu_state.cycle + 1U); \
+  if (ctx->cycle_next_event == ctx->cpu_state.cycle){ cu_avr_hwexec(ctx); } \
  }while(0)
 
 /* Macro for consuming last instruction cycle before which ITs are triggered */
 #define UPDATE_HARDWARE_IT \
  do{ \
-  if (event_it){ cu_avr_itcheck(); } \
+  if (ctx->event_it){ cu_avr_itcheck(ctx); } \
   UPDATE_HARDWARE; \
  }while(0)
 
+/* Macros for the same below the event horizon (no HW event may happen) */
+#define UPDATE_CYCLE \
+ do{ \
+  ctx->cpu_state.cycle = WRAP32(ctx->cpu_state.cycle + 1U); \
+ }while(0)
+
+#define UPDATE_CYCLE_IT \
+ do{ \
+  if (ctx->event_it){ cu_avr_itcheck(ctx); } \
+  UPDATE_CYCLE; \
+ }while(0)
+
+/* Maximal number of cycles an instruction may take (excluding interrupt
+** entry which always processes HW events) */
+#define CYCLE_INSTR_MAX 4U
+
+
+/* Fault descriptor flags: instruction word matches the skip, condition
+** disable or flag anomaly configuration */
+#define FDSC_SKIP      0x01U
+#define FDSC_COND      0x02U
+#define FDSC_FLAG      0x04U
+
+
+/* Compiled opcode of instructions not compiled yet (decoded lazily, on
+** their first execution, in blocks of (1 << CODE_BLOCK_SH) words) */
+#define OP_LAZY        0x60U
+#define CODE_BLOCK_SH  6U
+
 
 /* Vectors base when IVSEL is 1 (MCUCR.1; Boot loader base) */
 #define VBASE_BOOT     0x7800U
@@ -241,12 +569,18 @@ auint           flag_and;
 
 
 
+/* Updates decoder specific data after compiling a range of the Code ROM
+** (defined by the instruction decoder) */
+static void cu_avr_exec_fill(cu_avr_ctx_t* ctx, auint wbase, auint wlen);
+
+
+
 /*
 ** Emulates cycle-precise hardware tasks. This is called through the
 ** UPDATE_HARDWARE macro if cycle_next_event matches the cycle counter (a new
 ** HW event is to be processed).
 */
-static void cu_avr_hwexec(void)
+static void cu_avr_hwexec(cu_avr_ctx_t* ctx)
 {
  auint nextev = ~0U;
  auint t0;
@@ -255,31 +589,31 @@ static void cu_avr_hwexec(void)
 
  /* Timer 1 */
 
- if ((cpu_state.iors[CU_IO_TCCR1B] & 0x07U) != 0U){ /* Timer 1 started */
+ if ((ctx->cpu_state.iors[CU_IO_TCCR1B] & 0x07U) != 0U){ /* Timer 1 started */
 
-  t0 = (cpu_state.cycle - timer1_base) & 0xFFFFU;   /* Current TCNT1 value */
-  t1 = ( ( ((auint)(cpu_state.iors[CU_IO_OCR1AL])     ) |
-           ((auint)(cpu_state.iors[CU_IO_OCR1AH]) << 8) ) + 1U) & 0xFFFFU;
-  t2 = ( ( ((auint)(cpu_state.iors[CU_IO_OCR1BL])     ) |
-           ((auint)(cpu_state.iors[CU_IO_OCR1BH]) << 8) ) + 1U) & 0xFFFFU;
+  t0 = (ctx->cpu_state.cycle - ctx->timer1_base) & 0xFFFFU;   /* Current TCNT1 value */
+  t1 = ( ( ((auint)(ctx->cpu_state.iors[CU_IO_OCR1AL])     ) |
+           ((auint)(ctx->cpu_state.iors[CU_IO_OCR1AH]) << 8) ) + 1U) & 0xFFFFU;
+  t2 = ( ( ((auint)(ctx->cpu_state.iors[CU_IO_OCR1BL])     ) |
+           ((auint)(ctx->cpu_state.iors[CU_IO_OCR1BH]) << 8) ) + 1U) & 0xFFFFU;
 
-  if ((cpu_state.iors[CU_IO_TCCR1B] & 0x08U) != 0U){ /* Timer 1 in CTC mode: Counts to OCR1A, then resets */
+  if ((ctx->cpu_state.iors[CU_IO_TCCR1B] & 0x08U) != 0U){ /* Timer 1 in CTC mode: Counts to OCR1A, then resets */
 
    if (t0 == 0x0000U){                    /* Timer overflow (might happen if it starts above Comp. A, or Comp. A is 0) */
-    cpu_state.iors[CU_IO_TIFR1] |= 0x01U;
-    event_it = TRUE;
+    ctx->cpu_state.iors[CU_IO_TIFR1] |= 0x01U;
+    ctx->event_it = TRUE;
    }
 
    if (t0 == t2){
-    cpu_state.iors[CU_IO_TIFR1] |= 0x04U; /* Comparator B interrupt */
-    event_it = TRUE;
+    ctx->cpu_state.iors[CU_IO_TIFR1] |= 0x04U; /* Comparator B interrupt */
+    ctx->event_it = TRUE;
    }
 
    if (t0 == t1){
-    cpu_state.iors[CU_IO_TIFR1] |= 0x02U; /* Comparator A interrupt */
-    event_it = TRUE;
-    timer1_base = cpu_state.cycle;        /* Reset timer to zero */
-    t0 = 0U;                              /* Also reset for event calculation */
+    ctx->cpu_state.iors[CU_IO_TIFR1] |= 0x02U; /* Comparator A interrupt */
+    ctx->event_it = TRUE;
+    ctx->timer1_base = ctx->cpu_state.cycle; /* Reset timer to zero */
+    t0 = 0U;                                 /* Also reset for event calculation */
    }
 
    if ( (t0 != t2) &&
@@ -290,9 +624,9 @@ static void cu_avr_hwexec(void)
   }else{ /* Timer 1 in normal mode: wrapping 16 bit counter */
 
    if (t0 == 0x0000U){
-    cpu_state.iors[CU_IO_TIFR1] |= 0x01U; /* Overflow interrupt */
-    event_it = TRUE;
-    timer1_base = cpu_state.cycle;        /* Reset timer to zero */
+    ctx->cpu_state.iors[CU_IO_TIFR1] |= 0x01U; /* Overflow interrupt */
+    ctx->event_it = TRUE;
+    ctx->timer1_base = ctx->cpu_state.cycle;   /* Reset timer to zero */
    }
 
    if (nextev > (0x10000U - t0)){ nextev = 0x10000U - t0; }
@@ -303,7 +637,38 @@ static void cu_avr_hwexec(void)
 
  /* Calculate next event's cycle */
 
- cycle_next_event = WRAP32(cpu_state.cycle + nextev);
+ ctx->cycle_next_event = WRAP32(ctx->cpu_state.cycle + nextev);
+ ctx->cycle_horizon    = 0U;
+}
+
+
+
+/*
+** Materializes lazily evaluated flags into SREG. It has to be called before
+** anything other than the I and T flags of SREG are accessed.
+*/
+static void cu_avr_sreg_sync(cu_avr_ctx_t* ctx)
+{
+ if (SREG_LAZY && (ctx->sreg_keep != 0U)){
+  ctx->cpu_state.iors[CU_IO_SREG] = (ctx->cpu_state.iors[CU_IO_SREG] & ctx->sreg_keep) |
+                                    CU_AVRFG_FVAL(ctx->sreg_fidx);
+  ctx->sreg_keep = 0U;
+ }
+}
+
+
+
+/*
+** Stops emulation at a checkpoint (if one was requested). The instruction
+** being emulated completes, then cu_avr_run() returns.
+*/
+static void cu_avr_ckpt_stop(cu_avr_ctx_t* ctx)
+{
+ ctx->ckpt_req        = FALSE;
+ ctx->ckpt_hit        = TRUE;
+ ctx->ckpt_cmax       = ctx->cycle_count_max;
+ ctx->cycle_count_max = ctx->cpu_state.cycle;
+ ctx->cycle_horizon   = 0U;
 }
 
 
@@ -311,26 +676,26 @@ static void cu_avr_hwexec(void)
 /*
 ** Enters requested interrupt (event_it_enter must be true)
 */
-static void cu_avr_interrupt(void)
+static void cu_avr_interrupt(cu_avr_ctx_t* ctx)
 {
  auint tmp;
 
- event_it_enter = FALSE; /* Requested IT entry performed */
+ ctx->event_it_enter = FALSE; /* Requested IT entry performed */
 
- SREG_CLR(cpu_state.iors[CU_IO_SREG], SREG_IM);
+ SREG_CLR(ctx->cpu_state.iors[CU_IO_SREG], SREG_IM);
 
- tmp   = ((auint)(cpu_state.iors[CU_IO_SPL])     ) +
-         ((auint)(cpu_state.iors[CU_IO_SPH]) << 8);
- cpu_state.sram[tmp & 0x0FFFU] = (cpu_state.pc     ) & 0xFFU;
- access_mem[tmp & 0x0FFFU] |= CU_MEM_W;
+ tmp   = ((auint)(ctx->cpu_state.iors[CU_IO_SPL])     ) +
+         ((auint)(ctx->cpu_state.iors[CU_IO_SPH]) << 8);
+ ctx->cpu_state.sram[tmp & 0x0FFFU] = (ctx->cpu_state.pc     ) & 0xFFU;
+ MEM_WRITE(tmp & 0x0FFFU);
  tmp --;
- cpu_state.sram[tmp & 0x0FFFU] = (cpu_state.pc >> 8) & 0xFFU;
- access_mem[tmp & 0x0FFFU] |= CU_MEM_W;
+ ctx->cpu_state.sram[tmp & 0x0FFFU] = (ctx->cpu_state.pc >> 8) & 0xFFU;
+ MEM_WRITE(tmp & 0x0FFFU);
  tmp --;
- cpu_state.iors[CU_IO_SPL] = (tmp     ) & 0xFFU;
- cpu_state.iors[CU_IO_SPH] = (tmp >> 8) & 0xFFU;
+ ctx->cpu_state.iors[CU_IO_SPL] = (tmp     ) & 0xFFU;
+ ctx->cpu_state.iors[CU_IO_SPH] = (tmp >> 8) & 0xFFU;
 
- cpu_state.pc = event_it_vect;
+ ctx->cpu_state.pc = ctx->event_it_vect;
 
  UPDATE_HARDWARE;
  UPDATE_HARDWARE;
@@ -343,46 +708,790 @@ static void cu_avr_interrupt(void)
 ** Checks for interrupts and triggers if any is pending. Clears event_it when
 ** there are no more interrupts waiting for servicing.
 */
-static void cu_avr_itcheck(void)
+static void cu_avr_itcheck(cu_avr_ctx_t* ctx)
 {
  auint vbase;
 
  /* Global interrupt enable? */
 
- if ((cpu_state.iors[CU_IO_SREG] & SREG_IM) == 0U){
-  event_it = FALSE;
+ if ((ctx->cpu_state.iors[CU_IO_SREG] & SREG_IM) == 0U){
+  ctx->event_it = FALSE;
   return;
  }
 
  /* Interrupts are enabled, so check them */
 
- vbase = ((cpu_state.iors[CU_IO_MCUCR] >> 1) & 1U) * VBASE_BOOT;
+ vbase = ((ctx->cpu_state.iors[CU_IO_MCUCR] >> 1) & 1U) * VBASE_BOOT;
+
+ if       ( (ctx->cpu_state.iors[CU_IO_TIFR1] &
+             ctx->cpu_state.iors[CU_IO_TIMSK1] & 0x02U) !=    0U ){ /* Timer 1 Comparator A */
+
+  ctx->cpu_state.iors[CU_IO_TIFR1] ^= 0x02U;
+  ctx->event_it_enter = TRUE;
+  ctx->event_it_vect  = vbase + VECT_T1COMPA;
+
+ }else if ( (ctx->cpu_state.iors[CU_IO_TIFR1] &
+             ctx->cpu_state.iors[CU_IO_TIMSK1] & 0x04U) !=    0U ){ /* Timer 1 Comparator B */
+
+  ctx->cpu_state.iors[CU_IO_TIFR1] ^= 0x04U;
+  ctx->event_it_enter = TRUE;
+  ctx->event_it_vect  = vbase + VECT_T1COMPB;
+
+ }else if ( (ctx->cpu_state.iors[CU_IO_TIFR1] &
+             ctx->cpu_state.iors[CU_IO_TIMSK1] & 0x01U) !=    0U ){ /* Timer 1 Overflow */
+
+  ctx->cpu_state.iors[CU_IO_TIFR1] ^= 0x01U;
+  ctx->event_it_enter = TRUE;
+  ctx->event_it_vect  = vbase + VECT_T1OVF;
+
+ }else{ /* No interrupts are pending */
+
+  ctx->event_it = FALSE;
+
+ }
+}
+
+
+
+/*
+** Folds a value into a state hash.
+*/
+static uint64 cu_avr_hash_fold(uint64 h, auint val)
+{
+ return (h ^ val) * 0x100000001B3U;
+}
+
+
+
+/*
+** Calculates the hash of the state of the program: the SRAM (by pages,
+** rehashing those written since), the I/O registers (including the CPU
+** registers), the timer and pending hardware events relative to the cycle,
+** the port sequences in progress, and the output so far. Neither the cycle
+** nor the cycle budget are included, so repeated states hash the same. The
+** values last written to the behaviour modification configuration ports
+** (0xF1 - 0xF7) are also left out, so runs configured differently may match
+** (the configuration has no effect while the modifications are disabled,
+** and can't change while they are enabled). The timer is only included if
+** tmr is set, then the next hardware event only if the timer is started
+** (otherwise the event does nothing).
+*/
+static uint64 cu_avr_state_hash(cu_avr_ctx_t* ctx, boole tmr)
+{
+ uint8 const* mem;
+ uint64       h;
+ auint        p;
+ auint        i;
+
+ if (!ctx->state_valid){ /* Hash all pages */
+  memset(&ctx->state_page[0], 0, sizeof(ctx->state_page));
+  ctx->state_mem = 0U;
+ }
+
+ for (p = 0U; p < (4096U >> MEM_PAGE_SH); p++){
+  if ((!ctx->state_valid) || ctx->hash_dirty[p]){
+   ctx->hash_dirty[p] = FALSE;
+   mem = &ctx->cpu_state.sram[p << MEM_PAGE_SH];
+   h   = 0xCBF29CE484222325U ^ p;
+   for (i = 0U; i < (1U << MEM_PAGE_SH); i += 4U){
+    h = cu_avr_hash_fold(h, ((auint)(mem[i     ])      ) |
+                            ((auint)(mem[i + 1U]) <<  8) |
+                            ((auint)(mem[i + 2U]) << 16) |
+                            ((auint)(mem[i + 3U]) << 24));
+   }
+   h ^= h >> 29;
+   ctx->state_mem    -= ctx->state_page[p];
+   ctx->state_page[p] = h;
+   ctx->state_mem    += h;
+  }
+ }
+ ctx->state_valid = TRUE;
+
+ cu_avr_sreg_sync(ctx);
+
+ h   = ctx->state_mem;
+ mem = &ctx->cpu_state.iors[0];
+ for (i = 0U; i < 0xF0U; i += 4U){
+  h = cu_avr_hash_fold(h, ((auint)(mem[i     ])      ) |
+                          ((auint)(mem[i + 1U]) <<  8) |
+                          ((auint)(mem[i + 2U]) << 16) |
+                          ((auint)(mem[i + 3U]) << 24));
+ }
+ h = cu_avr_hash_fold(h, mem[0xF0U]);
+ for (i = 0xF8U; i < 256U; i += 4U){
+  h = cu_avr_hash_fold(h, ((auint)(mem[i     ])      ) |
+                          ((auint)(mem[i + 1U]) <<  8) |
+                          ((auint)(mem[i + 2U]) << 16) |
+                          ((auint)(mem[i + 3U]) << 24));
+ }
+ for (p = 0U; p < 0x20U; p++){ /* Sequences in progress */
+  h = cu_avr_hash_fold(h, ctx->port_states[p]);
+  for (i = 0U; (i < ctx->port_states[p]) && (i < 8U); i++){
+   h = cu_avr_hash_fold(h, ctx->port_data[p][i]);
+  }
+ }
+ h = cu_avr_hash_fold(h, ctx->cpu_state.pc & 0xFFFFU); /* Bits above unused */
+ h = cu_avr_hash_fold(h, ctx->cpu_state.latch);
+ if (tmr){
+  if ((ctx->cpu_state.iors[CU_IO_TCCR1B] & 0x07U) != 0U){ /* Timer 1 started */
+   h = cu_avr_hash_fold(h, WRAP32(ctx->cycle_next_event - ctx->cpu_state.cycle));
+  }
+  h = cu_avr_hash_fold(h, (ctx->cpu_state.cycle - ctx->timer1_base) & 0xFFFFU);
+ }
+ h = cu_avr_hash_fold(h, ctx->event_it);
+ h = cu_avr_hash_fold(h, ctx->event_it_enter);
+ h = cu_avr_hash_fold(h, (ctx->event_it_enter) ? ctx->event_it_vect : 0U); /* Only valid if entering */
+ h = cu_avr_hash_fold(h, ctx->alu_ismod);
+ h = cu_avr_hash_fold(h, ctx->guard_isacc);
+ h = cu_avr_hash_fold(h, (auint)(ctx->out_hash));
+ h = cu_avr_hash_fold(h, (auint)(ctx->out_hash >> 32));
+ h ^= h >> 29;
+
+ return h;
+}
+
+
+
+/*
+** Takes a sample of the state for the convergence check (with the behaviour
+** modifications disabled, on an instruction boundary at or after
+** conv_next), recording it, or comparing it with the reference's at the
+** same cycle. When it matches, and the reference doesn't enable the
+** behaviour modifications any more, the rest of the run would be identical
+** to the reference's, so emulation stops (like for a checkpoint).
+*/
+static void cu_avr_conv_sample(cu_avr_ctx_t* ctx)
+{
+ cu_avr_conv_t*     conv = ctx->conv;
+ cu_avr_conv_ent_t* ent;
+ auint              cyc  = ctx->cpu_state.cycle;
+ auint              k    = cyc / conv->ival;
+ auint              nsize;
+ uint64             h;
+
+ if (ctx->conv_next != 0U){ /* Zero: start of a run, only scheduling */
+  h = cu_avr_hash_fold(cu_avr_state_hash(ctx, TRUE), ctx->cycle_count_max);
+  if (ctx->conv_rec){
+   if (k >= conv->size){
+    nsize = (conv->size == 0U) ? 256U : (conv->size << 1);
+    while (nsize <= k){ nsize <<= 1; }
+    ent = realloc(conv->ent, nsize * sizeof(cu_avr_conv_ent_t));
+    if (ent != NULL){
+     memset(&ent[conv->size], 0, (nsize - conv->size) * sizeof(cu_avr_conv_ent_t));
+     conv->ent  = ent;
+     conv->size = nsize;
+    }
+   }
+   if (k < conv->size){    /* The trace just ends if it can't grow */
+    conv->ent[k].cycle = cyc;
+    conv->ent[k].hash  = h;
+    if (conv->len <= k){ conv->len = k + 1U; }
+   }
+  }else{
+   if ( (k < conv->len) &&
+        (conv->ent[k].cycle == cyc) &&
+        (conv->ent[k].hash  == h) ){
+    if (cyc > conv->mcyc){
+     ctx->conv_st         = CU_AVR_CONV_MASKED;
+     ctx->conv_cyc        = cyc;
+     ctx->cycle_count_max = cyc;
+    }
+   }else if (ctx->conv_st == CU_AVR_CONV_NONE){
+    ctx->conv_st   = CU_AVR_CONV_DIFF;
+    ctx->conv_dcyc = cyc;
+   }
+  }
+ }
+
+ ctx->conv_next = (k + 1U) * conv->ival;
+ if (ctx->conv_next <= cyc){ ctx->conv_next = ~0U; } /* Wrapped: no more */
+}
+
+
+
+/*
+** Stops emulation as hung (CU_AVR_HANG_), the instruction being emulated
+** completes, then cu_avr_run() returns.
+*/
+static void cu_avr_hang_stop(cu_avr_ctx_t* ctx, auint st)
+{
+ ctx->hang_st         = st;
+ ctx->hang_cyc        = ctx->cpu_state.cycle;
+ ctx->hang_probe      = FALSE;
+ ctx->cycle_count_max = ctx->cpu_state.cycle;
+ ctx->cycle_horizon   = 0U;
+}
+
+
+
+/*
+** Prepares hang detection for a run (by the configuration).
+*/
+static void cu_avr_hang_init(cu_avr_ctx_t* ctx)
+{
+ ctx->hang_probe = FALSE;
+ ctx->hang_next  = (ctx->hang_ival != 0U) ? ctx->hang_start : ~0U;
+ ctx->hang_st    = CU_AVR_HANG_NONE;
+ ctx->hang_cyc   = 0U;
+ ctx->hang_per   = 0U;
+}
+
+
+
+/*
+** Hang detection, called after each instruction stepped with the program
+** counter before it. Enforces the cycle budget and starts the probes. While
+** probing, the targets of backward jumps are loop head candidates: if the
+** state repeats exactly at one (the timer in the same phase), the program
+** would loop the same way until the end of emulation. The candidate is
+** moved after 1, 2, 4 ... backward jumps (as in Brent's cycle detection),
+** and only compared when its I/O registers match, to avoid hashing (which
+** then only has to rehash the SRAM pages written since the last hash). The
+** timer only has to be in the same phase if it is started or it was read
+** since the candidate, otherwise it can't affect the loop.
+*/
+static void cu_avr_hang_step(cu_avr_ctx_t* ctx, auint opc)
+{
+ auint cyc = ctx->cpu_state.cycle;
+ auint pc  = ctx->cpu_state.pc & 0xFFFFU;
+ auint tph;
+ auint tev;
+ boole tmr;
+
+ if (cyc >= ctx->hang_budget){
+  cu_avr_hang_stop(ctx, CU_AVR_HANG_BUDGET);
+  return;
+ }
+
+ if (!ctx->hang_probe){
+  if (cyc < ctx->hang_next){ return; }
+  ctx->hang_probe = TRUE;
+  ctx->hang_end   = cyc + (ctx->hang_ival >> 3);
+  if (ctx->hang_end < cyc){ ctx->hang_end = ~0U; }
+  ctx->hang_cnt   = 0U;
+  ctx->hang_lim   = 0U;
+  ctx->hang_tread = FALSE;
+ }
+
+ if ((pc & 0x7FFFU) <= (opc & 0x7FFFU)){ /* Backward jump (or wrap) */
+  cu_avr_sreg_sync(ctx);
+  tph = (cyc - ctx->timer1_base) & 0xFFFFU;
+  tev = WRAP32(ctx->cycle_next_event - cyc);
+  tmr = ctx->hang_tread ||
+        ((ctx->cpu_state.iors[CU_IO_TCCR1B] & 0x07U) != 0U);
+  if ( (ctx->hang_lim != 0U) &&
+       (pc == ctx->hang_apc) &&
+       ((!tmr) || ((tph == ctx->hang_atph) && (tev == ctx->hang_atev))) &&
+       (memcmp(&ctx->hang_aio[0], &ctx->cpu_state.iors[0], 256U) == 0) &&
+       (cu_avr_state_hash(ctx, FALSE) == ctx->hang_ahash) ){
+   ctx->hang_per = cyc - ctx->hang_acyc;
+   cu_avr_hang_stop(ctx, CU_AVR_HANG_LOOP);
+   return;
+  }
+  ctx->hang_cnt ++;
+  if (ctx->hang_cnt >= ctx->hang_lim){
+   ctx->hang_apc   = pc;
+   ctx->hang_acyc  = cyc;
+   ctx->hang_atph  = tph;
+   ctx->hang_atev  = tev;
+   memcpy(&ctx->hang_aio[0], &ctx->cpu_state.iors[0], 256U);
+   ctx->hang_ahash = cu_avr_state_hash(ctx, FALSE);
+   ctx->hang_tread = FALSE;
+   ctx->hang_cnt   = 0U;
+   ctx->hang_lim   = (ctx->hang_lim == 0U) ? 1U : (ctx->hang_lim << 1);
+  }
+ }
+
+ if (cyc >= ctx->hang_end){     /* End of the probe */
+  ctx->hang_probe = FALSE;
+  ctx->hang_next  = cyc + ctx->hang_ival;
+  if (ctx->hang_next < cyc){ ctx->hang_next = ~0U; }
+ }
+}
+
+
+
+/*
+** Prepares the cycle profile for a run (by the configuration), the first
+** sample is an interval from the current cycle.
+*/
+static void cu_avr_prof_init(cu_avr_ctx_t* ctx)
+{
+ ctx->prof_next = ctx->cpu_state.cycle + ctx->prof_ival;
+ if ((ctx->prof == NULL) || (ctx->prof_next < ctx->cpu_state.cycle)){
+  ctx->prof_next = ~0U;
+ }
+}
+
+
+
+/*
+** Takes the cycle profile samples due after the instruction at pc was
+** emulated: the cycles since the last sample were spent on it.
+*/
+static void cu_avr_prof_sample(cu_avr_ctx_t* ctx, auint pc)
+{
+ auint cyc = ctx->cpu_state.cycle;
+ auint cnt;
+
+ if (ctx->prof == NULL){ return; } /* At the last cycle without a profile */
+
+ cnt = ((cyc - ctx->prof_next) / ctx->prof_ival) + 1U;
+ ctx->prof[pc & 0x7FFFU] += cnt;
+ ctx->prof_next += cnt * ctx->prof_ival;
+ if (ctx->prof_next <= cyc){ ctx->prof_next = ~0U; } /* Wrapped: no more */
+}
+
+
+
+/*
+** Calculates the event horizon. It is zero (so no instruction can be
+** emulated without checks) if a hardware event, a state sample, a profile
+** sample or a hang detection probe may happen within the next instruction,
+** the cycle budget is exhausted, or the behaviour modifications are
+** enabled.
+*/
+static void cu_avr_horizon(cu_avr_ctx_t* ctx)
+{
+ auint dist = WRAP32(ctx->cycle_next_event - ctx->cpu_state.cycle);
+
+ ctx->cycle_horizon = 0U;
+
+ if (ctx->alu_ismod){ return; }
+ if (ctx->conv != NULL){ /* The next state sample is like a hardware event */
+  if (ctx->cpu_state.cycle >= ctx->conv_next){ cu_avr_conv_sample(ctx); }
+  if (dist > (ctx->conv_next - ctx->cpu_state.cycle)){
+   dist = ctx->conv_next - ctx->cpu_state.cycle;
+  }
+ }
+ if (ctx->prof != NULL){ /* Profile samples are taken by stepping */
+  if (ctx->cpu_state.cycle >= ctx->prof_next){ return; }
+  if (dist > (ctx->prof_next - ctx->cpu_state.cycle)){
+   dist = ctx->prof_next - ctx->cpu_state.cycle;
+  }
+ }
+ if (ctx->hang_on){ /* Probes and the budget are checked by stepping */
+  if ( ctx->hang_probe ||
+       (ctx->cpu_state.cycle >= ctx->hang_next) ||
+       (ctx->cpu_state.cycle >= ctx->hang_budget) ){ return; }
+  if (dist > (ctx->hang_next - ctx->cpu_state.cycle)){
+   dist = ctx->hang_next - ctx->cpu_state.cycle;
+  }
+  if (dist > (ctx->hang_budget - ctx->cpu_state.cycle)){
+   dist = ctx->hang_budget - ctx->cpu_state.cycle;
+  }
+ }
+ if (ctx->cpu_state.cycle >= ctx->cycle_count_max){ return; }
+ if (dist <= CYCLE_INSTR_MAX){ return; }
+
+ dist -= CYCLE_INSTR_MAX;
+ if (dist > (ctx->cycle_count_max - ctx->cpu_state.cycle)){
+  ctx->cycle_horizon = ctx->cycle_count_max;
+ }else{
+  ctx->cycle_horizon = ctx->cpu_state.cycle + dist;
+ }
+}
+
+
+
+/*
+** Rebuilds the fault descriptors of a range of Code ROM words from the skip,
+** condition disable and flag anomaly configurations. The range must not
+** wrap around. The loop is kept simple so the compiler may vectorize it.
+*/
+static void cu_avr_fdsc_update(cu_avr_ctx_t* ctx, auint wbase, auint wlen)
+{
+ auint i;
+ auint w;
+ auint smask = ctx->skip_mask;
+ auint scomp = ctx->skip_comp;
+ auint cmask = ctx->cond_mask;
+ auint ccomp = ctx->cond_comp;
+ auint fmask = ctx->flag_mask;
+ auint fcomp = ctx->flag_comp;
+
+ /* Nothing to do if the descriptors are all zero and would remain so */
+
+ if (((smask | cmask | fmask) == 0U) && (!ctx->fdsc_set)){ return; }
+
+ /* A zero mask disables the feature: make the compare fail */
+
+ if (smask == 0U){ scomp = 0x10000U; }
+ if (cmask == 0U){ ccomp = 0x10000U; }
+ if (fmask == 0U){ fcomp = 0x10000U; }
+
+ for (i = wbase; i < (wbase + wlen); i++){
+  w = ((auint)(ctx->cpu_state.crom[(i << 1)     ])     ) |
+      ((auint)(ctx->cpu_state.crom[(i << 1) + 1U]) << 8);
+  ctx->cpu_fdsc[i] = (uint8)( (((w & smask) == scomp) ? FDSC_SKIP : 0U) |
+                              (((w & cmask) == ccomp) ? FDSC_COND : 0U) |
+                              (((w & fmask) == fcomp) ? FDSC_FLAG : 0U) );
+ }
+
+ if (ctx->fdsc_lo > wbase){ ctx->fdsc_lo = wbase; }
+ if (ctx->fdsc_hi < (wbase + wlen)){ ctx->fdsc_hi = wbase + wlen; }
+
+ if      ((smask | cmask | fmask) != 0U){ ctx->fdsc_set = TRUE; }
+ else if ((wbase == 0U) && (wlen >= 0x8000U)){ ctx->fdsc_set = FALSE; }
+}
+
+
+
+/*
+** Compiles a single word of the Code ROM (without forming superinstructions).
+*/
+static auint cu_avr_compile(cu_avr_ctx_t* ctx, auint i)
+{
+ return cu_avrc_compile(
+     ((auint)(ctx->cpu_state.crom[((i << 1) + 0U) & 0xFFFFU])     ) |
+     ((auint)(ctx->cpu_state.crom[((i << 1) + 1U) & 0xFFFFU]) << 8),
+     ((auint)(ctx->cpu_state.crom[((i << 1) + 2U) & 0xFFFFU])     ) |
+     ((auint)(ctx->cpu_state.crom[((i << 1) + 3U) & 0xFFFFU]) << 8) );
+}
+
+
+
+/*
+** Compiles the block of instructions containing the given word address. The
+** two words after the block are also compiled if they weren't yet (without
+** forming superinstructions), since superinstructions in the block may take
+** arguments from them.
+*/
+static void  cu_avr_code_fill(cu_avr_ctx_t* ctx, auint pc)
+{
+ auint wbase = (pc & 0x7FFFU) & (~((1U << CODE_BLOCK_SH) - 1U));
+ auint wext  = (wbase + (1U << CODE_BLOCK_SH)) & 0x7FFFU;
+ auint i;
+ auint op0;
+ auint op1;
+ auint op2;
+
+ op1 = cu_avr_compile(ctx, wbase);
+ op2 = cu_avr_compile(ctx, wbase + 1U);
+ for (i = wbase; i < (wbase + (1U << CODE_BLOCK_SH)); i++){
+  op0 = op1;
+  op1 = op2;
+  op2 = cu_avr_compile(ctx, i + 2U);
+  ctx->cpu_code[i] = cu_avrc_fuse(op0, op1, op2);
+ }
+ cu_avr_exec_fill(ctx, wbase, 1U << CODE_BLOCK_SH);
+
+ for (i = wext; i < (wext + 2U); i++){
+  if ((ctx->cpu_code[i] & 0x7FU) == OP_LAZY){
+   ctx->cpu_code[i] = cu_avr_compile(ctx, i);
+  }
+ }
+ cu_avr_exec_fill(ctx, wext, 2U);
+}
+
+
+
+/*
+** Returns the compiled opcode at the given word address, compiling it if
+** necessary.
+*/
+static auint cu_avr_code_get(cu_avr_ctx_t* ctx, auint pc)
+{
+ auint opcode = ctx->cpu_code[pc & 0x7FFFU];
+
+ if ((opcode & 0x7FU) == OP_LAZY){
+  cu_avr_code_fill(ctx, pc);
+  opcode = ctx->cpu_code[pc & 0x7FFFU];
+ }
+
+ return opcode;
+}
+
+
+
+/*
+** Returns the presence bitmap byte of a stuck bit fault key (the bit within
+** it is selected by the low 3 bits of the key).
+*/
+static uint8* cu_avr_stuck_map(cu_avr_ctx_t* ctx, auint key)
+{
+ if       ((key & STUCK_IO)  != 0U){
+  return &ctx->stuck_map_io[(key & 0xFFU) >> 3];
+ }else if ((key & STUCK_MEM) != 0U){
+  return &ctx->stuck_map_mem[(key & 0xFFFU) >> 3];
+ }else{
+  return &ctx->stuck_map_rom[(key & 0xFFFFU) >> 3];
+ }
+}
+
+
+
+/*
+** Returns the slot of a stuck bit fault key in the fault set: either the
+** one holding it or the free slot where it should be added.
+*/
+static cu_avr_stuck_t* cu_avr_stuck_slot(cu_avr_stuck_t* set, auint sh, auint key)
+{
+ auint msk = (1U << sh) - 1U;
+ auint i   = ((key * 0x9E3779B1U) & 0xFFFFFFFFU) >> (32U - sh);
+
+ while ((set[i].key != 0U) && (set[i].key != key)){
+  i = (i + 1U) & msk;
+ }
+
+ return &set[i];
+}
+
+
+
+/*
+** Adds or replaces a stuck bit fault. The fault set is grown when it gets
+** half full, if this is not possible, the fault is not added, and FALSE is
+** returned.
+*/
+static boole cu_avr_stuck_set(cu_avr_ctx_t* ctx, auint key, auint and_m, auint or_m)
+{
+ cu_avr_stuck_t* set;
+ cu_avr_stuck_t* ent;
+ auint           i;
+
+ if (((ctx->stuck_cnt + 1U) << 1) > (1U << ctx->stuck_sh)){
+  set = calloc(2U << ctx->stuck_sh, sizeof(cu_avr_stuck_t));
+  if (set == NULL){ return FALSE; }
+  for (i = 0U; i < (1U << ctx->stuck_sh); i++){
+   if (ctx->stuck_set[i].key != 0U){
+    *(cu_avr_stuck_slot(set, ctx->stuck_sh + 1U, ctx->stuck_set[i].key)) =
+        ctx->stuck_set[i];
+   }
+  }
+  free(ctx->stuck_set);
+  ctx->stuck_set = set;
+  ctx->stuck_sh ++;
+ }
+
+ ent = cu_avr_stuck_slot(ctx->stuck_set, ctx->stuck_sh, key);
+ if (ent->key == 0U){
+  ent->key = key;
+  ctx->stuck_cnt ++;
+  *(cu_avr_stuck_map(ctx, key)) |= (uint8)(1U << (key & 7U));
+ }
+ ent->and_m = (uint8)(and_m);
+ ent->or_m  = (uint8)(or_m);
+
+ return TRUE;
+}
+
+
+
+/*
+** Applies the stuck bit fault of a key on a value read. Only call it for
+** keys marked in the presence bitmap.
+*/
+static auint cu_avr_stuck_get(cu_avr_ctx_t* ctx, auint key, auint val)
+{
+ cu_avr_stuck_t const* ent = cu_avr_stuck_slot(ctx->stuck_set, ctx->stuck_sh, key);
+
+ return (val & ent->and_m) | ent->or_m;
+}
+
 
- if       ( (cpu_state.iors[CU_IO_TIFR1] &
-             cpu_state.iors[CU_IO_TIMSK1] & 0x02U) !=    0U ){ /* Timer 1 Comparator A */
 
-  cpu_state.iors[CU_IO_TIFR1] ^= 0x02U;
-  event_it_enter = TRUE;
-  event_it_vect  = vbase + VECT_T1COMPA;
+/*
+** Removes all stuck bit faults.
+*/
+static void  cu_avr_stuck_clear(cu_avr_ctx_t* ctx)
+{
+ auint i;
+
+ ctx->stuck_lost = FALSE;
+
+ if (ctx->stuck_cnt == 0U){ return; }
+
+ for (i = 0U; i < (1U << ctx->stuck_sh); i++){
+  if (ctx->stuck_set[i].key != 0U){
+   *(cu_avr_stuck_map(ctx, ctx->stuck_set[i].key)) = 0U;
+   ctx->stuck_set[i].key = 0U;
+  }
+ }
+
+ ctx->stuck_cnt = 0U;
+}
+
+
+
+/*
+** Calculates the hash of a Code ROM, to tell whether two are identical.
+*/
+static uint64 cu_avr_crom_hash(uint8 const* crom)
+{
+ uint64 h = 0xCBF29CE484222325U;
+ auint  i;
+
+ for (i = 0U; i < 65536U; i += 4U){
+  h ^= ((auint)(crom[i     ])      ) |
+       ((auint)(crom[i + 1U]) <<  8) |
+       ((auint)(crom[i + 2U]) << 16) |
+       ((auint)(crom[i + 3U]) << 24);
+  h *= 0x100000001B3U;
+ }
+ h ^= h >> 29;
+
+ return h;
+}
+
+
+
+/* Digit pairs of decimal numbers 00 - 99 */
+static const char cu_avr_dig2[] =
+ "0001020304050607080910111213141516171819"
+ "2021222324252627282930313233343536373839"
+ "4041424344454647484950515253545556575859"
+ "6061626364656667686970717273747576777879"
+ "8081828384858687888990919293949596979899";
+
+/* Hexadecimal digits */
+static const char cu_avr_hexd[] = "0123456789ABCDEF";
+
+/* Binary digits of nibbles */
+static const char cu_avr_bin4[] =
+ "00000001001000110100010101100111"
+ "10001001101010111100110111101111";
+
+
+
+/*
+** Checks the compiled code against the Code ROM if the latter may have been
+** written since it was compiled (crom_chk), recompiling it if it doesn't
+** match (or its hash is not known). Returns TRUE if it was recompiled.
+*/
+static boole cu_avr_crom_check(cu_avr_ctx_t* ctx)
+{
+ uint64 h;
+ boole  ret = FALSE;
+
+ if (!ctx->crom_chk){ return FALSE; }
+
+ h = cu_avr_crom_hash(&ctx->cpu_state.crom[0]);
+ if ((!ctx->crom_hv) || (h != ctx->crom_hash)){
+  cu_avr_crom_update(ctx, 0U, 65536U);
+  ret = TRUE;
+ }
+ ctx->crom_hash = h;
+ ctx->crom_hv   = TRUE;
+ ctx->crom_chk  = FALSE;
+
+ return ret;
+}
+
+
+
+/*
+** Passes the buffered text output of the program either onto the standard
+** output or into the output function if any was set, and the buffered
+** binary results into the result function if any was set.
+*/
+static void  cu_avr_out_flush(cu_avr_ctx_t* ctx)
+{
+ if (ctx->out_len != 0U){
+  if (ctx->out_func == NULL){
+   fwrite(&(ctx->out_buf[0]), 1U, ctx->out_len, stdout);
+  }else{
+   ctx->out_func(ctx->out_user, &(ctx->out_buf[0]), ctx->out_len);
+  }
+  ctx->out_len = 0U;
+ }
+
+ if (ctx->res_len != 0U){
+  if (ctx->res_func != NULL){
+   ctx->res_func(ctx->res_user, &(ctx->res_buf[0]), ctx->res_len);
+  }
+  ctx->res_len = 0U;
+ }
+}
+
+
+
+/*
+** Compares text output of the program with the golden output, stopping
+** emulation when it diverges, or when the prefix to check matched. The
+** instruction being emulated completes, then cu_avr_run() returns.
+*/
+static void  cu_avr_out_golden(cu_avr_ctx_t* ctx, char const* str, auint len)
+{
+ auint i;
 
- }else if ( (cpu_state.iors[CU_IO_TIFR1] &
-             cpu_state.iors[CU_IO_TIMSK1] & 0x04U) !=    0U ){ /* Timer 1 Comparator B */
+ for (i = 0U; i < len; i++){
+  if ( (ctx->gold_pos >= ctx->gold_len) ||
+       (ctx->gold_buf[ctx->gold_pos] != str[i]) ){
+   ctx->gold_st = CU_AVR_GOLD_DIFF;
+   break;
+  }
+  ctx->gold_pos ++;
+ }
+ if ( (ctx->gold_st == CU_AVR_GOLD_NONE) &&
+      (ctx->gold_pfx != 0U) &&
+      (ctx->gold_pos >= ctx->gold_pfx) ){
+  ctx->gold_st = CU_AVR_GOLD_PREFIX;
+ }
+
+ if (ctx->gold_st != CU_AVR_GOLD_NONE){
+  ctx->gold_cyc        = ctx->cpu_state.cycle;
+  ctx->cycle_count_max = ctx->cpu_state.cycle;
+  ctx->cycle_horizon   = 0U;
+ }
+}
 
-  cpu_state.iors[CU_IO_TIFR1] ^= 0x04U;
-  event_it_enter = TRUE;
-  event_it_vect  = vbase + VECT_T1COMPB;
 
- }else if ( (cpu_state.iors[CU_IO_TIFR1] &
-             cpu_state.iors[CU_IO_TIMSK1] & 0x01U) !=    0U ){ /* Timer 1 Overflow */
 
-  cpu_state.iors[CU_IO_TIFR1] ^= 0x01U;
-  event_it_enter = TRUE;
-  event_it_vect  = vbase + VECT_T1OVF;
+/*
+** Produces text output of the program from an output port (0xE0 - 0xE3).
+*/
+static void  cu_avr_out_port(cu_avr_ctx_t* ctx, auint port, auint val)
+{
+ char* str;
+ auint len;
+
+ if (ctx->out_len > (OUT_SIZE - 8U)){ cu_avr_out_flush(ctx); }
+ str = &(ctx->out_buf[ctx->out_len]);
+
+ switch (port){
+
+  case 0xE0U:         /* Single character output */
+
+   str[0] = (char)(val);
+   len = 1U;
+   break;
+
+  case 0xE1U:         /* Decimal number output */
+
+   if       (val >= 100U){
+    str[0] = (char)('0' + (val / 100U));
+    memcpy(&str[1], &cu_avr_dig2[(val % 100U) * 2U], 2U);
+    len = 3U;
+   }else if (val >= 10U){
+    memcpy(&str[0], &cu_avr_dig2[val * 2U], 2U);
+    len = 2U;
+   }else{
+    str[0] = (char)('0' + val);
+    len = 1U;
+   }
+   break;
+
+  case 0xE2U:         /* Hexadecimal number output */
+
+   str[0] = cu_avr_hexd[val >> 4];
+   str[1] = cu_avr_hexd[val & 0xFU];
+   len = 2U;
+   break;
+
+  default:            /* Binary number output */
+
+   memcpy(&str[0], &cu_avr_bin4[(val >> 4) * 4U], 4U);
+   memcpy(&str[4], &cu_avr_bin4[(val & 0xFU) * 4U], 4U);
+   len = 8U;
+   break;
 
- }else{ /* No interrupts are pending */
+ }
 
-  event_it = FALSE;
+ ctx->out_len += len;
 
+ if ((ctx->gold_buf != NULL) && (ctx->gold_st == CU_AVR_GOLD_NONE)){
+  cu_avr_out_golden(ctx, str, len);
  }
 }
 
@@ -391,13 +1500,15 @@ static void cu_avr_itcheck(void)
 /*
 ** Writes an I/O port
 */
-static void  cu_avr_write_io(auint port, auint val)
+static void  cu_avr_write_io(cu_avr_ctx_t* ctx, auint port, auint val)
 {
- auint pval = cpu_state.iors[port]; /* Previous value */
+ auint pval;
  auint cval = val & 0xFFU;          /* Current (requested) value */
  auint t0;
 
- access_io[port] |= CU_MEM_W;
+ cu_avr_sreg_sync(ctx);
+ pval = ctx->cpu_state.iors[port];       /* Previous value */
+ ctx->access_io[port] |= CU_MEM_W;
 
  switch (port){
 
@@ -416,7 +1527,7 @@ static void  cu_avr_write_io(auint port, auint val)
    /* Special shortcut masking with the DDR register. This port tolerates a
    ** bit of inaccuracy since it is only graphics and is most frequently
    ** written "normally" (the DDR is used for fade effects on it) */
-   cval &= cpu_state.iors[CU_IO_DDRC];
+   cval &= ctx->cpu_state.iors[CU_IO_DDRC];
    break;
 
   case CU_IO_PORTD:   /* SD card Chip Select */
@@ -430,14 +1541,15 @@ static void  cu_avr_write_io(auint port, auint val)
 
   case CU_IO_TCNT1H:  /* Timer1 counter, high */
 
-   cpu_state.latch = cval; /* Write into latch (value written to the port itself is ignored) */
+   ctx->cpu_state.latch = cval; /* Write into latch (value written to the port itself is ignored) */
    break;
 
   case CU_IO_TCNT1L:  /* Timer1 counter, low */
 
-   t0    = (cpu_state.latch << 8) | cval;
-   timer1_base = WRAP32(cpu_state.cycle - t0);
-   cycle_next_event = WRAP32(cpu_state.cycle + 1U); /* Request HW processing */
+   t0    = (ctx->cpu_state.latch << 8) | cval;
+   ctx->timer1_base = WRAP32(ctx->cpu_state.cycle - t0);
+   ctx->cycle_next_event = WRAP32(ctx->cpu_state.cycle + 1U); /* Request HW processing */
+   ctx->cycle_horizon    = 0U;
    break;
 
   case CU_IO_TIFR1:   /* Timer1 interrupt flags */
@@ -451,7 +1563,8 @@ static void  cu_avr_write_io(auint port, auint val)
   case CU_IO_OCR1BH:  /* Timer1 comparator B, high */
   case CU_IO_OCR1BL:  /* Timer1 comparator B, low */
 
-   cycle_next_event = WRAP32(cpu_state.cycle + 1U); /* Request HW processing */
+   ctx->cycle_next_event = WRAP32(ctx->cpu_state.cycle + 1U); /* Request HW processing */
+   ctx->cycle_horizon    = 0U;
    break;
 
   case CU_IO_SPDR:    /* SPI data */
@@ -487,54 +1600,49 @@ static void  cu_avr_write_io(auint port, auint val)
   case CU_IO_SREG:    /* Status register */
 
    if ((((~pval) & cval) & SREG_IM) != 0U){
-    event_it = TRUE;  /* Interrupts become enabled, so check them */
+    ctx->event_it = TRUE;  /* Interrupts become enabled, so check them */
    }
    break;
 
   case 0xE0U:         /* Single character output */
-
-   print_message("%c", cval);
-   break;
-
   case 0xE1U:         /* Decimal number output */
+  case 0xE2U:         /* Hexadecimal number output */
+  case 0xE3U:         /* Binary number output */
 
-   print_message("%u", cval);
+   cu_avr_out_port(ctx, port, cval);
+   ctx->out_hash = cu_avr_hash_fold(ctx->out_hash, (port << 8) | cval);
    break;
 
-  case 0xE2U:         /* Hexadecimal number output */
+  case 0xE4U:         /* Binary result output */
 
-   print_message("%02X", cval);
+   ctx->out_hash = cu_avr_hash_fold(ctx->out_hash, (port << 8) | cval);
+   if (ctx->res_len == OUT_SIZE){ cu_avr_out_flush(ctx); }
+   ctx->res_buf[ctx->res_len] = (uint8)(cval);
+   ctx->res_len ++;
    break;
 
-  case 0xE3U:         /* Binary number output */
+  case 0xE5U:         /* Exit status (kept in the port) */
 
-   print_message("%u%u%u%u%u%u%u%u",
-                 (cval >> 7) & 1U,
-                 (cval >> 6) & 1U,
-                 (cval >> 5) & 1U,
-                 (cval >> 4) & 1U,
-                 (cval >> 3) & 1U,
-                 (cval >> 2) & 1U,
-                 (cval >> 1) & 1U,
-                 (cval     ) & 1U);
    break;
 
   case 0xE7U:         /* Terminate program */
 
-   cycle_count_max = cpu_state.cycle;
+   ctx->cycle_count_max = ctx->cpu_state.cycle;
+   ctx->cycle_horizon   = 0U;
    break;
 
   case 0xE8U:         /* Guard port */
 
-   if (guard_isacc){ cycle_count_max = cpu_state.cycle; } /* Terminate program */
-   guard_isacc = TRUE;
+   if (ctx->guard_isacc){ ctx->cycle_count_max = ctx->cpu_state.cycle; } /* Terminate program */
+   ctx->guard_isacc   = TRUE;
+   ctx->cycle_horizon = 0U;
    break;
 
   case 0xEAU:         /* Reset sequentally accessed ports */
 
-   if (cpu_state.iors[0xE9U] == 0xA5U){ /* Port lock inactive */
+   if (ctx->cpu_state.iors[0xE9U] == 0xA5U){ /* Port lock inactive */
     for (t0 = 0U; t0 < 0x20U; t0++){
-     port_states[t0] = 0U;
+     ctx->port_states[t0] = 0U;
     }
    }else{
     cval = pval;
@@ -543,17 +1651,18 @@ static void  cu_avr_write_io(auint port, auint val)
 
   case 0xEBU:         /* Count of cycles to emulate */
 
-   if (!alu_ismod){   /* Behaviour mods disabled */
-    switch (port_states[0x0BU]){
-     case 0U: port_data[0x0BU][0U] = cval; port_states[0x0BU]++; break;
-     case 1U: port_data[0x0BU][1U] = cval; port_states[0x0BU]++; break;
-     case 2U: port_data[0x0BU][2U] = cval; port_states[0x0BU]++; break;
+   if (!ctx->alu_ismod){   /* Behaviour mods disabled */
+    switch (ctx->port_states[0x0BU]){
+     case 0U: ctx->port_data[0x0BU][0U] = cval; ctx->port_states[0x0BU]++; break;
+     case 1U: ctx->port_data[0x0BU][1U] = cval; ctx->port_states[0x0BU]++; break;
+     case 2U: ctx->port_data[0x0BU][2U] = cval; ctx->port_states[0x0BU]++; break;
      default:
-      cycle_count_max = ((auint)(port_data[0x0BU][0U])      ) |
-                        ((auint)(port_data[0x0BU][1U]) <<  8) |
-                        ((auint)(port_data[0x0BU][2U]) << 16) |
-                        ((auint)(cval)                 << 24);
-      port_states[0x0BU] = 0U;
+      ctx->cycle_count_max = ((auint)(ctx->port_data[0x0BU][0U])      ) |
+                             ((auint)(ctx->port_data[0x0BU][1U]) <<  8) |
+                             ((auint)(ctx->port_data[0x0BU][2U]) << 16) |
+                             ((auint)(cval)                      << 24);
+      ctx->port_states[0x0BU] = 0U;
+      ctx->cycle_horizon      = 0U;
       break;
     }
    }else{
@@ -561,29 +1670,41 @@ static void  cu_avr_write_io(auint port, auint val)
    }
    break;
 
+  case 0xECU:         /* Checkpoint */
+
+   if ((!ctx->alu_ismod) && ctx->ckpt_req){
+    cu_avr_ckpt_stop(ctx);
+   }
+   break;
+
   case 0xF0U:         /* Behaviour mod. enable */
 
-   if (cval != 0x5AU){ alu_ismod = FALSE; } /* An "ijmp" will enable it */
+   if (cval != 0x5AU){ /* An "ijmp" will enable it */
+    ctx->alu_ismod = FALSE;
+    ctx->cond_jmp  = FALSE;  /* No condition disable with modifications disabled */
+   }
    break;
 
   case 0xF1U:         /* Register / Memory stuck bits */
 
-   if (!alu_ismod){   /* Behaviour mods disabled */
-    switch (port_states[0x11U]){
-     case 0U: port_data[0x11U][0U] = cval; port_states[0x11U]++; break;
-     case 1U: port_data[0x11U][1U] = cval; port_states[0x11U]++; break;
-     case 2U: port_data[0x11U][2U] = cval; port_states[0x11U]++; break;
+   if (!ctx->alu_ismod){   /* Behaviour mods disabled */
+    switch (ctx->port_states[0x11U]){
+     case 0U: ctx->port_data[0x11U][0U] = cval; ctx->port_states[0x11U]++; break;
+     case 1U: ctx->port_data[0x11U][1U] = cval; ctx->port_states[0x11U]++; break;
+     case 2U: ctx->port_data[0x11U][2U] = cval; ctx->port_states[0x11U]++; break;
      default:
-      t0 = ((auint)(port_data[0x11U][2U])     ) |
-           ((auint)(cval)                 << 8);
+      t0 = ((auint)(ctx->port_data[0x11U][2U])     ) |
+           ((auint)(cval)                      << 8);
       if (t0 < 256U){
-       stuck_1_io[t0] = port_data[0x11U][0U];
-       stuck_0_io[t0] = port_data[0x11U][1U];
+       t0 = STUCK_IO + t0;
       }else{
-       stuck_1_mem[t0 & 0x0FFFU] = port_data[0x11U][0U];
-       stuck_0_mem[t0 & 0x0FFFU] = port_data[0x11U][1U];
+       t0 = STUCK_MEM + (t0 & 0x0FFFU);
       }
-      port_states[0x11U] = 0U;
+      if (!cu_avr_stuck_set(ctx, t0, ctx->port_data[0x11U][1U],
+                                     ctx->port_data[0x11U][0U])){
+       ctx->stuck_lost = TRUE;
+      }
+      ctx->port_states[0x11U] = 0U;
       break;
     }
    }else{
@@ -593,18 +1714,20 @@ static void  cu_avr_write_io(auint port, auint val)
 
   case 0xF2U:         /* ROM stuck bits */
 
-   if (!alu_ismod){   /* Behaviour mods disabled */
-    switch (port_states[0x12U]){
-     case 0U: port_data[0x12U][0U] = cval; port_states[0x12U]++; break;
-     case 1U: port_data[0x12U][1U] = cval; port_states[0x12U]++; break;
-     case 2U: port_data[0x12U][2U] = cval; port_states[0x12U]++; break;
-     case 3U: port_data[0x12U][3U] = cval; port_states[0x12U]++; break;
+   if (!ctx->alu_ismod){   /* Behaviour mods disabled */
+    switch (ctx->port_states[0x12U]){
+     case 0U: ctx->port_data[0x12U][0U] = cval; ctx->port_states[0x12U]++; break;
+     case 1U: ctx->port_data[0x12U][1U] = cval; ctx->port_states[0x12U]++; break;
+     case 2U: ctx->port_data[0x12U][2U] = cval; ctx->port_states[0x12U]++; break;
+     case 3U: ctx->port_data[0x12U][3U] = cval; ctx->port_states[0x12U]++; break;
      default:
-      t0 = ((auint)(port_data[0x12U][2U])     ) |
-           ((auint)(port_data[0x12U][3U]) << 8);
-      stuck_1_rom[t0] = port_data[0x12U][0U];
-      stuck_0_rom[t0] = port_data[0x12U][1U];
-      port_states[0x12U] = 0U;
+      t0 = ((auint)(ctx->port_data[0x12U][2U])     ) |
+           ((auint)(ctx->port_data[0x12U][3U]) << 8);
+      if (!cu_avr_stuck_set(ctx, STUCK_ROM + t0, ctx->port_data[0x12U][1U],
+                                                 ctx->port_data[0x12U][0U])){
+       ctx->stuck_lost = TRUE;
+      }
+      ctx->port_states[0x12U] = 0U;
       break;
     }
    }else{
@@ -614,21 +1737,22 @@ static void  cu_avr_write_io(auint port, auint val)
 
   case 0xF3U:         /* Flag anomalies */
 
-   if (!alu_ismod){   /* Behaviour mods disabled */
-    switch (port_states[0x13U]){
-     case 0U: port_data[0x13U][0U] = cval; port_states[0x13U]++; break;
-     case 1U: port_data[0x13U][1U] = cval; port_states[0x13U]++; break;
-     case 2U: port_data[0x13U][2U] = cval; port_states[0x13U]++; break;
-     case 3U: port_data[0x13U][3U] = cval; port_states[0x13U]++; break;
-     case 4U: port_data[0x13U][4U] = cval; port_states[0x13U]++; break;
+   if (!ctx->alu_ismod){   /* Behaviour mods disabled */
+    switch (ctx->port_states[0x13U]){
+     case 0U: ctx->port_data[0x13U][0U] = cval; ctx->port_states[0x13U]++; break;
+     case 1U: ctx->port_data[0x13U][1U] = cval; ctx->port_states[0x13U]++; break;
+     case 2U: ctx->port_data[0x13U][2U] = cval; ctx->port_states[0x13U]++; break;
+     case 3U: ctx->port_data[0x13U][3U] = cval; ctx->port_states[0x13U]++; break;
+     case 4U: ctx->port_data[0x13U][4U] = cval; ctx->port_states[0x13U]++; break;
      default:
-      flag_mask = ((auint)(port_data[0x13U][0U])     ) |
-                  ((auint)(port_data[0x13U][1U]) << 8);
-      flag_comp = ((auint)(port_data[0x13U][2U])     ) |
-                  ((auint)(port_data[0x13U][3U]) << 8);
-      flag_or   = port_data[0x13U][4U];
-      flag_and  = cval;
-      port_states[0x13U] = 0U;
+      ctx->flag_mask = ((auint)(ctx->port_data[0x13U][0U])     ) |
+                       ((auint)(ctx->port_data[0x13U][1U]) << 8);
+      ctx->flag_comp = ((auint)(ctx->port_data[0x13U][2U])     ) |
+                       ((auint)(ctx->port_data[0x13U][3U]) << 8);
+      ctx->flag_or   = ctx->port_data[0x13U][4U];
+      ctx->flag_and  = cval;
+      ctx->port_states[0x13U] = 0U;
+      cu_avr_fdsc_update(ctx, 0U, 0x8000U);
       break;
     }
    }else{
@@ -638,15 +1762,15 @@ static void  cu_avr_write_io(auint port, auint val)
 
   case 0xF5U:         /* Increment / Decrement anomalies */
 
-   if (!alu_ismod){   /* Behaviour mods disabled */
-    switch (port_states[0x15U]){
-     case 0U: port_data[0x15U][0U] = cval; port_states[0x15U]++; break;
-     case 1U: port_data[0x15U][1U] = cval; port_states[0x15U]++; break;
+   if (!ctx->alu_ismod){   /* Behaviour mods disabled */
+    switch (ctx->port_states[0x15U]){
+     case 0U: ctx->port_data[0x15U][0U] = cval; ctx->port_states[0x15U]++; break;
+     case 1U: ctx->port_data[0x15U][1U] = cval; ctx->port_states[0x15U]++; break;
      default:
-      idc_val = ((auint)(port_data[0x15U][0U])     ) |
-                ((auint)(port_data[0x15U][1U]) << 8);
-      idc_opc  = cval;
-      port_states[0x15U] = 0U;
+      ctx->idc_val = ((auint)(ctx->port_data[0x15U][0U])     ) |
+                     ((auint)(ctx->port_data[0x15U][1U]) << 8);
+      ctx->idc_opc  = cval;
+      ctx->port_states[0x15U] = 0U;
       break;
     }
    }else{
@@ -656,17 +1780,18 @@ static void  cu_avr_write_io(auint port, auint val)
 
   case 0xF6U:         /* Instruction skipping */
 
-   if (!alu_ismod){   /* Behaviour mods disabled */
-    switch (port_states[0x16U]){
-     case 0U: port_data[0x16U][0U] = cval; port_states[0x16U]++; break;
-     case 1U: port_data[0x16U][1U] = cval; port_states[0x16U]++; break;
-     case 2U: port_data[0x16U][2U] = cval; port_states[0x16U]++; break;
+   if (!ctx->alu_ismod){   /* Behaviour mods disabled */
+    switch (ctx->port_states[0x16U]){
+     case 0U: ctx->port_data[0x16U][0U] = cval; ctx->port_states[0x16U]++; break;
+     case 1U: ctx->port_data[0x16U][1U] = cval; ctx->port_states[0x16U]++; break;
+     case 2U: ctx->port_data[0x16U][2U] = cval; ctx->port_states[0x16U]++; break;
      default:
-      skip_mask = ((auint)(port_data[0x16U][0U])     ) |
-                  ((auint)(port_data[0x16U][1U]) << 8);
-      skip_comp = ((auint)(port_data[0x16U][2U])     ) |
-                  ((auint)(cval)                 << 8);
-      port_states[0x16U] = 0U;
+      ctx->skip_mask = ((auint)(ctx->port_data[0x16U][0U])     ) |
+                       ((auint)(ctx->port_data[0x16U][1U]) << 8);
+      ctx->skip_comp = ((auint)(ctx->port_data[0x16U][2U])     ) |
+                       ((auint)(cval)                      << 8);
+      ctx->port_states[0x16U] = 0U;
+      cu_avr_fdsc_update(ctx, 0U, 0x8000U);
       break;
     }
    }else{
@@ -676,17 +1801,18 @@ static void  cu_avr_write_io(auint port, auint val)
 
   case 0xF7U:         /* Condition disable */
 
-   if (!alu_ismod){   /* Behaviour mods disabled */
-    switch (port_states[0x17U]){
-     case 0U: port_data[0x17U][0U] = cval; port_states[0x17U]++; break;
-     case 1U: port_data[0x17U][1U] = cval; port_states[0x17U]++; break;
-     case 2U: port_data[0x17U][2U] = cval; port_states[0x17U]++; break;
+   if (!ctx->alu_ismod){   /* Behaviour mods disabled */
+    switch (ctx->port_states[0x17U]){
+     case 0U: ctx->port_data[0x17U][0U] = cval; ctx->port_states[0x17U]++; break;
+     case 1U: ctx->port_data[0x17U][1U] = cval; ctx->port_states[0x17U]++; break;
+     case 2U: ctx->port_data[0x17U][2U] = cval; ctx->port_states[0x17U]++; break;
      default:
-      cond_mask = ((auint)(port_data[0x17U][0U])     ) |
-                  ((auint)(port_data[0x17U][1U]) << 8);
-      cond_comp = ((auint)(port_data[0x17U][2U])     ) |
-                  ((auint)(cval)                 << 8);
-      port_states[0x17U] = 0U;
+      ctx->cond_mask = ((auint)(ctx->port_data[0x17U][0U])     ) |
+                       ((auint)(ctx->port_data[0x17U][1U]) << 8);
+      ctx->cond_comp = ((auint)(ctx->port_data[0x17U][2U])     ) |
+                       ((auint)(cval)                      << 8);
+      ctx->port_states[0x17U] = 0U;
+      cu_avr_fdsc_update(ctx, 0U, 0x8000U);
       break;
     }
    }else{
@@ -700,7 +1826,7 @@ static void  cu_avr_write_io(auint port, auint val)
 
  }
 
- cpu_state.iors[port] = cval;
+ ctx->cpu_state.iors[port] = cval;
 }
 
 
@@ -708,41 +1834,44 @@ static void  cu_avr_write_io(auint port, auint val)
 /*
 ** Reads from an I/O port
 */
-static auint cu_avr_read_io(auint port)
+static auint cu_avr_read_io(cu_avr_ctx_t* ctx, auint port)
 {
  auint t0;
  auint ret;
 
- access_io[port] |= CU_MEM_R;
+ cu_avr_sreg_sync(ctx);
+ ctx->access_io[port] |= CU_MEM_R;
 
  switch (port){
 
   case CU_IO_TCNT1L:
-   t0  = WRAP32(cpu_state.cycle - timer1_base); /* Current TCNT1 value */
-   cpu_state.latch = (t0 >> 8) & 0xFFU;
+   t0  = WRAP32(ctx->cpu_state.cycle - ctx->timer1_base); /* Current TCNT1 value */
+   ctx->cpu_state.latch = (t0 >> 8) & 0xFFU;
    ret = t0 & 0xFFU;
+   ctx->hang_tread = TRUE;
    break;
 
   case CU_IO_TCNT1H:
-   ret = cpu_state.latch;
+   ret = ctx->cpu_state.latch;
    break;
 
   case 0xE7U:         /* Terminate program */
 
-   cycle_count_max = cpu_state.cycle;
+   ctx->cycle_count_max = ctx->cpu_state.cycle;
+   ctx->cycle_horizon   = 0U;
    break;
 
   case 0xE8U:         /* Guard port */
 
-   if (guard_isacc){ cycle_count_max = cpu_state.cycle; } /* Terminate program */
-   guard_isacc = TRUE;
+   if (ctx->guard_isacc){ ctx->cycle_count_max = ctx->cpu_state.cycle; } /* Terminate program */
+   ctx->guard_isacc   = TRUE;
+   ctx->cycle_horizon = 0U;
    break;
 
   default:
-   ret = cpu_state.iors[port];
-   if (alu_ismod){
-    ret &= stuck_0_io[port];
-    ret |= stuck_1_io[port];
+   ret = ctx->cpu_state.iors[port];
+   if (ctx->alu_ismod && STUCK_HAS(ctx->stuck_map_io, port)){
+    ret = cu_avr_stuck_get(ctx, STUCK_IO + port, ret);
    }
    break;
  }
@@ -753,10 +1882,60 @@ static auint cu_avr_read_io(auint port)
 
 
 /*
-** Emulates a single (compiled) AVR instruction and any associated hardware
-** tasks.
+** Opcode handlers (without and with the ALU behaviour modifications), and
+** the instruction decoder emulating (compiled) AVR instructions with any
+** associated hardware tasks. The direct threaded decoder is faster for
+** native builds, the jump table decoder is meant for Emscripten. The
+** dynamic translator is an alternative for x86-64 hosts.
 */
+#include "cu_avr_o.h"
+#define CU_AVR_O_MOD
+#include "cu_avr_o.h"
+#undef  CU_AVR_O_MOD
+#include "cu_avr_m.h"
+#if   defined(CU_AVR_JIT)
+#include "cu_avr_j.h"
+#elif defined(CU_AVR_THREADED)
+#include "cu_avr_t.h"
+#else
 #include "cu_avr_e.h"
+#endif
+
+
+
+/*
+** Creates an emulator instance. Returns NULL if it can not be allocated.
+** The instance has to be reset (by cu_avr_reset()) before running it.
+*/
+cu_avr_ctx_t* cu_avr_new(void)
+{
+ cu_avr_ctx_t* ctx = calloc(1U, sizeof(cu_avr_ctx_t));
+
+ if (ctx == NULL){ return NULL; }
+
+ ctx->stuck_set = calloc(1U << STUCK_SET_SH, sizeof(cu_avr_stuck_t));
+ if (ctx->stuck_set == NULL){ free(ctx); return NULL; }
+ ctx->stuck_sh  = STUCK_SET_SH;
+ ctx->prof_next = ~0U; /* No cycle profile */
+
+ cu_avr_crom_update(ctx, 0U, 65536U); /* Empty Code ROM */
+
+ return ctx;
+}
+
+
+
+/*
+** Destroys an emulator instance.
+*/
+void  cu_avr_free(cu_avr_ctx_t* ctx)
+{
+ if (ctx == NULL){ return; }
+
+ cu_avr_exec_free(ctx);
+ free(ctx->stuck_set);
+ free(ctx);
+}
 
 
 
@@ -765,73 +1944,123 @@ static auint cu_avr_read_io(auint port)
 ** everything from the state as if cu_avr_crom_update() and cu_avr_io_update()
 ** was called.
 */
-void  cu_avr_reset(void)
+void  cu_avr_reset(cu_avr_ctx_t* ctx)
 {
  auint i;
 
- for (i = 0U; i < 4096U; i++){
-  access_mem[i] = 0U;
-  stuck_0_mem[i] = 0xFFU;
-  stuck_1_mem[i] = 0x00U;
+ for (i = 0U; i < (4096U >> MEM_PAGE_SH); i++){ /* Only pages accessed */
+  if (ctx->mem_dirty[i] || ctx->mem_ckpt[i]){
+   memset(&ctx->access_mem[i << MEM_PAGE_SH], 0, 1U << MEM_PAGE_SH);
+  }
  }
+ memset(&ctx->mem_dirty[0], FALSE, sizeof(ctx->mem_dirty));
+ memset(&ctx->mem_ckpt[0],  FALSE, sizeof(ctx->mem_ckpt));
+ ctx->ckpt_fpv   = FALSE;
+ ctx->reset_init = NULL;
 
  for (i = 0U; i < 256U; i++){
-  access_io[i] = 0U;
-  stuck_0_io[i] = 0xFFU;
-  stuck_1_io[i] = 0x00U;
+  ctx->access_io[i] = 0U;
  }
 
- for (i = 0U; i < 65536U; i++){
-  stuck_0_rom[i] = 0xFFU;
-  stuck_1_rom[i] = 0x00U;
- }
+ cu_avr_stuck_clear(ctx);
 
  for (i = 0U; i < 256U; i++){ /* Most I/O regs are reset to zero */
-  cpu_state.iors[i] = 0U;
+  ctx->cpu_state.iors[i] = 0U;
  }
- cpu_state.iors[CU_IO_SPL] = 0xFFU;
- cpu_state.iors[CU_IO_SPH] = 0x10U;
+ ctx->cpu_state.iors[CU_IO_SPL] = 0xFFU;
+ ctx->cpu_state.iors[CU_IO_SPH] = 0x10U;
 
- cpu_state.latch = 0U;
+ ctx->cpu_state.latch = 0U;
 
  /* Check whether something is loaded. Normally the AVR is fused to use the
  ** boot loader, so if anything is present there, use that. If there is no
  ** boot loader (only an application is loaded), boot that instead. */
 
- if ( (cpu_state.crom[(VBASE_BOOT * 2U) + 0U] != 0U) ||
-      (cpu_state.crom[(VBASE_BOOT * 2U) + 1U] != 0U) ){ cpu_state.iors[CU_IO_MCUCR] |= 2U; }
-
- cpu_state.pc = (((cpu_state.iors[CU_IO_MCUCR] >> 1) & 1U) * VBASE_BOOT) + VECT_RESET;
-
- cpu_state.cycle    = 0U;
- cycle_next_event   = WRAP32(cpu_state.cycle + 1U);
- timer1_base        = cpu_state.cycle;
- event_it           = TRUE;
- event_it_enter     = FALSE;
- alu_ismod          = FALSE;
- cycle_count_max    = CYCLE_COUNT_MAX_INI;
- guard_isacc        = FALSE;
- skip_mask          = 0U;
- skip_comp          = 0U;
- cond_mask          = 0U;
- cond_comp          = 0U;
- idc_opc            = 0xFFU;
- flag_mask          = 0U;
- flag_comp          = 0U;
+ if ( (ctx->cpu_state.crom[(VBASE_BOOT * 2U) + 0U] != 0U) ||
+      (ctx->cpu_state.crom[(VBASE_BOOT * 2U) + 1U] != 0U) ){ ctx->cpu_state.iors[CU_IO_MCUCR] |= 2U; }
+
+ ctx->cpu_state.pc = (((ctx->cpu_state.iors[CU_IO_MCUCR] >> 1) & 1U) * VBASE_BOOT) + VECT_RESET;
+
+ ctx->cpu_state.cycle    = 0U;
+ ctx->cycle_next_event   = WRAP32(ctx->cpu_state.cycle + 1U);
+ ctx->timer1_base        = ctx->cpu_state.cycle;
+ ctx->event_it           = TRUE;
+ ctx->event_it_enter     = FALSE;
+ ctx->event_it_vect      = 0U;
+ ctx->alu_ismod          = FALSE;
+ ctx->cond_jmp           = FALSE;
+ ctx->cycle_count_max    = CYCLE_COUNT_MAX_INI;
+ ctx->cycle_horizon      = 0U;
+ ctx->sreg_keep          = 0U;
+ ctx->guard_isacc        = FALSE;
+ ctx->skip_mask          = 0U;
+ ctx->skip_comp          = 0U;
+ ctx->cond_mask          = 0U;
+ ctx->cond_comp          = 0U;
+ ctx->idc_opc            = 0xFFU;
+ ctx->flag_mask          = 0U;
+ ctx->flag_comp          = 0U;
+ ctx->ckpt_req           = FALSE;
+ ctx->ckpt_hit           = FALSE;
+ ctx->gold_pos           = 0U;
+ ctx->gold_st            = CU_AVR_GOLD_NONE;
+ ctx->gold_cyc           = 0U;
+ ctx->out_hash           = 0U;
+ ctx->alu_modcyc         = 0U;
+ ctx->conv_next          = 0U;
+ ctx->conv_st            = CU_AVR_CONV_NONE;
+ ctx->conv_dcyc          = 0U;
+ ctx->conv_cyc           = 0U;
+ cu_avr_hang_init(ctx);
+ cu_avr_prof_init(ctx);
 
  for (i = 0U; i < 0x20U; i++){
-  port_states[i] = 0U;
+  ctx->port_states[i] = 0U;
  }
 
- if (!pflags_done){
-  cu_avrfg_fill(&cpu_pflags[0]);
-  pflags_done = TRUE;
+ /* The compiled code is kept if the Code ROM is unchanged since it was last
+ ** compiled, only the fault descriptors need updating (cleared masks) */
+
+ if (!cu_avr_crom_check(ctx)){
+  cu_avr_fdsc_update(ctx, 0U, 0x8000U);
  }
+ cu_avr_io_update(ctx);
+
+ ctx->cpu_state.crom_mod = FALSE; /* Initial code ROM state: not modified. */
+}
+
+
+
+/*
+** Resets the CPU to the memories of init (the SRAM, EEPROM and Code ROM,
+** such as of the state a binary was loaded into) as if they were written
+** into the state returned by cu_avr_get_state() before cu_avr_reset(). If
+** the instance was last reset to the same init, only the SRAM pages accessed
+** since are copied (emulation doesn't alter the rest of these), so init must
+** not change while it is used.
+*/
+void  cu_avr_reset_to(cu_avr_ctx_t* ctx, cu_state_cpu_t const* init)
+{
+ auint i;
+ auint pg = 1U << MEM_PAGE_SH;
 
- cu_avr_crom_update(0U, 65536U);
- cu_avr_io_update();
+ if (ctx->reset_init == init){
+  for (i = 0U; i < (4096U >> MEM_PAGE_SH); i++){
+   if (ctx->mem_dirty[i] || ctx->mem_ckpt[i]){
+    memcpy(&ctx->cpu_state.sram[i * pg], &init->sram[i * pg], pg);
+    ctx->hash_dirty[i] = TRUE;
+   }
+  }
+  memcpy(&ctx->cpu_state.sbuf[0], &init->sbuf[0],
+         sizeof(cu_state_cpu_t) - offsetof(cu_state_cpu_t, sbuf));
+ }else{
+  memcpy(&ctx->cpu_state, init, sizeof(cu_state_cpu_t));
+  ctx->state_valid = FALSE;
+  ctx->crom_chk    = TRUE;
+ }
 
- cpu_state.crom_mod = FALSE; /* Initial code ROM state: not modified. */
+ cu_avr_reset(ctx);
+ ctx->reset_init = init;
 }
 
 
@@ -839,11 +2068,15 @@ void  cu_avr_reset(void)
 /*
 ** Run emulation.
 */
-auint cu_avr_run(void)
+auint cu_avr_run(cu_avr_ctx_t* ctx)
 {
- do{
-  cu_avr_exec();       /* Note: This inlines as only this single call exists */
- }while (cpu_state.cycle < cycle_count_max);
+ ctx->cycle_horizon = 0U; /* The state might have been altered externally */
+ cu_avr_exec_run(ctx);
+ cu_avr_sreg_sync(ctx);  /* Externally SREG is always complete */
+ if ((ctx->conv != NULL) && ctx->conv_rec){
+  ctx->conv->mcyc = ctx->alu_modcyc;
+ }
+ cu_avr_out_flush(ctx);
 
  return 0U;
 }
@@ -855,9 +2088,9 @@ auint cu_avr_run(void)
 ** doesn't generate proper video signal. This is the cycle member of the CPU
 ** state (32 bits wrapping).
 */
-auint cu_avr_getcycle(void)
+auint cu_avr_getcycle(cu_avr_ctx_t* ctx)
 {
- return cpu_state.cycle;
+ return ctx->cpu_state.cycle;
 }
 
 
@@ -868,9 +2101,10 @@ auint cu_avr_getcycle(void)
 ** of the RAM come first here! (so address 0x0100 corresponds to AVR address
 ** 0x0100)
 */
-uint8* cu_avr_get_meminfo(void)
+uint8* cu_avr_get_meminfo(cu_avr_ctx_t* ctx)
 {
- return &access_mem[0];
+ memset(&ctx->mem_dirty[0], TRUE, sizeof(ctx->mem_dirty)); /* May be written */
+ return &ctx->access_mem[0];
 }
 
 
@@ -878,9 +2112,9 @@ uint8* cu_avr_get_meminfo(void)
 ** Returns I/O register access info block. It can be written (with zeros) to
 ** clear flags which are only set by the emulator.
 */
-uint8* cu_avr_get_ioinfo(void)
+uint8* cu_avr_get_ioinfo(cu_avr_ctx_t* ctx)
 {
- return &access_io[0];
+ return &ctx->access_io[0];
 }
 
 
@@ -889,9 +2123,9 @@ uint8* cu_avr_get_ioinfo(void)
 ** determine if it is necessary to include the Code ROM in a save state.
 ** Internal Code ROM writes and the cu_avr_crom_update() function can set it.
 */
-boole cu_avr_crom_ismod(void)
+boole cu_avr_crom_ismod(cu_avr_ctx_t* ctx)
 {
- return cpu_state.crom_mod;
+ return ctx->cpu_state.crom_mod;
 }
 
 
@@ -901,14 +2135,19 @@ boole cu_avr_crom_ismod(void)
 ** recompiled (by cu_avr_crom_update()) if anything in that area was updated
 ** or freshly written.
 */
-cu_state_cpu_t* cu_avr_get_state(void)
+cu_state_cpu_t* cu_avr_get_state(cu_avr_ctx_t* ctx)
 {
- auint t0 = WRAP32(cpu_state.cycle - timer1_base); /* Current TCNT1 value */
+ auint t0 = WRAP32(ctx->cpu_state.cycle - ctx->timer1_base); /* Current TCNT1 value */
 
- cpu_state.iors[CU_IO_TCNT1H] = (t0 >> 8) & 0xFFU;
- cpu_state.iors[CU_IO_TCNT1L] = (t0     ) & 0xFFU;
+ cu_avr_sreg_sync(ctx);
+ ctx->cpu_state.iors[CU_IO_TCNT1H] = (t0 >> 8) & 0xFFU;
+ ctx->cpu_state.iors[CU_IO_TCNT1L] = (t0     ) & 0xFFU;
+ memset(&ctx->mem_dirty[0], TRUE, sizeof(ctx->mem_dirty)); /* May be written */
+ ctx->reset_init  = NULL;
+ ctx->state_valid = FALSE;
+ ctx->crom_chk    = TRUE;
 
- return &cpu_state;
+ return &ctx->cpu_state;
 }
 
 
@@ -916,9 +2155,10 @@ cu_state_cpu_t* cu_avr_get_state(void)
 /*
 ** Updates a section of the Code ROM. This must be called after writing into
 ** the Code ROM so the emulator recompiles the affected instructions. The
-** "base" and "len" parameters specify the range to update in bytes.
+** "base" and "len" parameters specify the range to update in bytes. The
+** instructions are compiled when they are first executed.
 */
-void  cu_avr_crom_update(auint base, auint len)
+void  cu_avr_crom_update(cu_avr_ctx_t* ctx, auint base, auint len)
 {
  auint wbase = base >> 1;
  auint wlen  = (len + (base & 1U) + 1U) >> 1;
@@ -927,15 +2167,75 @@ void  cu_avr_crom_update(auint base, auint len)
  if (wbase > 0x7FFFU){ wbase = 0x7FFFU; }
  if ((wbase + wlen) > 0x8000U){ wlen = 0x8000U - wbase; }
 
+ /* Superinstructions may span up to 3 words, so the two words before the
+ ** range also have to be recompiled. The range may wrap around, like the
+ ** program counter does. */
+
+ if (wlen > (0x8000U - 2U)){
+  wbase = 0U;
+  wlen  = 0x8000U;
+ }else{
+  wbase = (wbase - 2U) & 0x7FFFU;
+  wlen  = wlen + 2U;
+ }
+
  for (i = wbase; i < (wbase + wlen); i++){
-  cpu_code[i] = cu_avrc_compile(
-      ((auint)(cpu_state.crom[((i << 1) + 0U) & 0xFFFFU])     ) |
-      ((auint)(cpu_state.crom[((i << 1) + 1U) & 0xFFFFU]) << 8),
-      ((auint)(cpu_state.crom[((i << 1) + 2U) & 0xFFFFU])     ) |
-      ((auint)(cpu_state.crom[((i << 1) + 3U) & 0xFFFFU]) << 8) );
+  ctx->cpu_code[i & 0x7FFFU] = OP_LAZY;
+ }
+
+ if ((wbase + wlen) > 0x8000U){
+  cu_avr_exec_update(ctx, wbase, 0x8000U - wbase);
+  cu_avr_exec_update(ctx, 0U, (wbase + wlen) - 0x8000U);
+  cu_avr_fdsc_update(ctx, wbase, 0x8000U - wbase);
+  cu_avr_fdsc_update(ctx, 0U, (wbase + wlen) - 0x8000U);
+ }else{
+  cu_avr_exec_update(ctx, wbase, wlen);
+  cu_avr_fdsc_update(ctx, wbase, wlen);
+ }
+
+ ctx->crom_hv = FALSE; /* Hashed when it is needed */
+ ctx->cpu_state.crom_mod = TRUE;
+ ctx->reset_init = NULL;
+}
+
+
+
+/*
+** Exports the compiled code of the whole Code ROM (32K opcodes) into code,
+** compiling what wasn't compiled yet. The Code ROM is recompiled first if it
+** was written without cu_avr_crom_update().
+*/
+void  cu_avr_code_export(cu_avr_ctx_t* ctx, uint32* code)
+{
+ auint i;
+
+ (void)(cu_avr_crom_check(ctx));
+
+ for (i = 0U; i < 0x8000U; i++){
+  (void)(cu_avr_code_get(ctx, i));
  }
 
- cpu_state.crom_mod = TRUE;
+ memcpy(code, &ctx->cpu_code[0], sizeof(ctx->cpu_code));
+}
+
+
+
+/*
+** Imports compiled code exported by cu_avr_code_export() from an identical
+** Code ROM (with an identical CU_AVRC_VER). Use this in place of
+** cu_avr_crom_update() after writing the Code ROM to spare the compilation.
+*/
+void  cu_avr_code_import(cu_avr_ctx_t* ctx, uint32 const* code)
+{
+ memcpy(&ctx->cpu_code[0], code, sizeof(ctx->cpu_code));
+
+ cu_avr_exec_update(ctx, 0U, 0x8000U);
+ cu_avr_fdsc_update(ctx, 0U, 0x8000U);
+
+ ctx->crom_hv  = FALSE; /* Hashed when it is needed */
+ ctx->crom_chk = FALSE; /* The code matches the Code ROM */
+ ctx->cpu_state.crom_mod = TRUE;
+ ctx->reset_init = NULL;
 }
 
 
@@ -946,14 +2246,498 @@ void  cu_avr_crom_update(auint base, auint len)
 ** emulator state over it. It also updates state related to additional
 ** variables in the structure (such as the watchdog timer).
 */
-void  cu_avr_io_update(void)
+void  cu_avr_io_update(cu_avr_ctx_t* ctx)
 {
  auint t0;
 
- t0    = (cpu_state.iors[CU_IO_TCNT1H] << 8) |
-         (cpu_state.iors[CU_IO_TCNT1L]     );
- timer1_base = WRAP32(cpu_state.cycle - t0);
+ t0    = (ctx->cpu_state.iors[CU_IO_TCNT1H] << 8) |
+         (ctx->cpu_state.iors[CU_IO_TCNT1L]     );
+ ctx->timer1_base = WRAP32(ctx->cpu_state.cycle - t0);
+
+ ctx->cycle_next_event = WRAP32(ctx->cpu_state.cycle + 1U); /* Request HW processing */
+ ctx->cycle_horizon    = 0U;
+ ctx->event_it         = TRUE; /* Request interrupt processing */
+}
+
+
+
+/*
+** Sets the output function receiving the text produced by the program on
+** the output ports (0xE0 - 0xE3). With NULL, the text goes to the standard
+** output.
+*/
+void  cu_avr_set_output(cu_avr_ctx_t* ctx, cu_avr_out_t* func, void* user)
+{
+ cu_avr_out_flush(ctx);  /* Pending output goes to the former output */
+ ctx->out_func = func;
+ ctx->out_user = user;
+}
+
+
+
+/*
+** Sets the result function receiving the bytes written by the program on
+** the binary result port (0xE4). With NULL, they are discarded.
+*/
+void  cu_avr_set_result(cu_avr_ctx_t* ctx, cu_avr_res_t* func, void* user)
+{
+ cu_avr_out_flush(ctx);  /* Pending results go to the former function */
+ ctx->res_func = func;
+ ctx->res_user = user;
+}
+
+
+
+/*
+** Returns the exit status set by the program on the exit status port
+** (0xE5), zero if it wasn't written since reset.
+*/
+auint cu_avr_get_status(cu_avr_ctx_t* ctx)
+{
+ return ctx->cpu_state.iors[0xE5U];
+}
+
+
+
+/*
+** Sets the golden output (of len bytes, NULL to turn off) the text output
+** of the program is compared with as it is produced. Emulation stops when
+** it diverges, or if prefix is nonzero, when that many bytes matched. The
+** buffer is not copied, it has to remain valid while used. The comparison
+** starts at reset.
+*/
+void  cu_avr_set_golden(cu_avr_ctx_t* ctx, char const* gold, auint len, auint prefix)
+{
+ ctx->gold_buf = gold;
+ ctx->gold_len = len;
+ ctx->gold_pfx = prefix;
+}
+
+
+
+/*
+** Returns the outcome of the golden output comparison (CU_AVR_GOLD_), the
+** count of matching bytes into pos, and the cycle emulation stopped at into
+** cycle (for CU_AVR_GOLD_DIFF and CU_AVR_GOLD_PREFIX). If the output ended
+** early, the outcome is CU_AVR_GOLD_NONE with pos below the golden length.
+*/
+auint cu_avr_get_golden(cu_avr_ctx_t* ctx, auint* pos, auint* cycle)
+{
+ *pos   = ctx->gold_pos;
+ *cycle = ctx->gold_cyc;
+ return ctx->gold_st;
+}
+
+
+
+/*
+** Creates an empty state hash trace, sampling the state every ival cycles
+** (at least 64). Returns NULL if it can not be allocated.
+*/
+cu_avr_conv_t* cu_avr_conv_new(auint ival)
+{
+ cu_avr_conv_t* conv = calloc(1U, sizeof(cu_avr_conv_t));
+
+ if (conv == NULL){ return NULL; }
+
+ conv->ival = (ival < 64U) ? 64U : ival;
+
+ return conv;
+}
+
+
+
+/*
+** Frees a state hash trace (NULL is accepted).
+*/
+void  cu_avr_conv_free(cu_avr_conv_t* conv)
+{
+ if (conv == NULL){ return; }
+
+ free(conv->ent);
+ free(conv);
+}
+
+
+
+/*
+** Sets up the state convergence check (NULL to turn off), recording into
+** the trace if rec is TRUE, otherwise comparing with it.
+*/
+void  cu_avr_set_conv(cu_avr_ctx_t* ctx, cu_avr_conv_t* conv, boole rec)
+{
+ ctx->conv          = conv;
+ ctx->conv_rec      = rec;
+ ctx->conv_next     = 0U;
+ ctx->conv_st       = CU_AVR_CONV_NONE;
+ ctx->conv_dcyc     = 0U;
+ ctx->conv_cyc      = 0U;
+ ctx->cycle_horizon = 0U;
+}
+
+
+
+/*
+** Returns the outcome of the state convergence check (CU_AVR_CONV_), the
+** cycle of the first diverging sample into dcyc (zero if none), and the
+** cycle emulation stopped at into cycle (for CU_AVR_CONV_MASKED).
+*/
+auint cu_avr_get_conv(cu_avr_ctx_t* ctx, auint* dcyc, auint* cycle)
+{
+ *dcyc  = ctx->conv_dcyc;
+ *cycle = ctx->conv_cyc;
+ return ctx->conv_st;
+}
+
+
+
+/*
+** Sets up hang detection: probing every ival cycles (at least 1024, zero
+** turns it off) from the cycle start, and the cycle budget (zero: none).
+*/
+void  cu_avr_set_hang(cu_avr_ctx_t* ctx, auint ival, auint start, auint budget)
+{
+ if ((ival != 0U) && (ival < 1024U)){ ival = 1024U; }
+
+ ctx->hang_on       = (ival != 0U) || (budget != 0U);
+ ctx->hang_ival     = ival;
+ ctx->hang_start    = start;
+ ctx->hang_budget   = (budget != 0U) ? budget : ~0U;
+ ctx->cycle_horizon = 0U;
+ cu_avr_hang_init(ctx);
+}
+
+
+
+/*
+** Returns the outcome of hang detection (CU_AVR_HANG_), the cycle emulation
+** stopped at into cycle, and the period of the loop into period (for
+** CU_AVR_HANG_LOOP).
+*/
+auint cu_avr_get_hang(cu_avr_ctx_t* ctx, auint* cycle, auint* period)
+{
+ *cycle  = ctx->hang_cyc;
+ *period = ctx->hang_per;
+ return ctx->hang_st;
+}
+
+
+
+/*
+** Sets up the cycle profile: every ival cycles (zero: disabled) a sample is
+** added to the counter of the instruction the cycles were spent on in prof
+** (32K counters for the words of the Code ROM, NULL: disabled). The counters
+** are only added to, the first sample is an interval from the current cycle
+** (or reset).
+*/
+void  cu_avr_set_profile(cu_avr_ctx_t* ctx, auint* prof, auint ival)
+{
+ ctx->prof          = (ival != 0U) ? prof : NULL;
+ ctx->prof_ival     = ival;
+ ctx->cycle_horizon = 0U;
+ cu_avr_prof_init(ctx);
+}
+
+
+
+/*
+** Writes an I/O port as if the program wrote it. This can be used to
+** configure behaviour modifications (ports 0xF1 - 0xF7) before running the
+** program.
+*/
+void  cu_avr_write_port(cu_avr_ctx_t* ctx, auint port, auint val)
+{
+ cu_avr_write_io(ctx, port & 0xFFU, val);
+}
+
+
+
+/*
+** Requests stopping at the next checkpoint: the first "ijmp" enabling
+** behaviour modifications (stopping before it would be executed) or a write
+** to the checkpoint port (0xEC). The request is cleared by cu_avr_reset().
+*/
+void  cu_avr_ckpt_request(cu_avr_ctx_t* ctx)
+{
+ ctx->ckpt_req = TRUE;
+ ctx->ckpt_hit = FALSE;
+}
+
+
+
+/*
+** Returns whether the last cu_avr_run() returned by reaching the requested
+** checkpoint.
+*/
+boole cu_avr_ckpt_reached(cu_avr_ctx_t* ctx)
+{
+ return ctx->ckpt_hit;
+}
+
+
+
+/*
+** Returns whether a stuck bit fault written since the last reset could not
+** be added for the lack of memory, so the emulation did not behave as
+** configured. A checkpoint restore carries it over from the checkpoint.
+*/
+boole cu_avr_stuck_lost(cu_avr_ctx_t* ctx)
+{
+ return ctx->stuck_lost;
+}
+
+
+
+/*
+** Calculates the fingerprint of the SRAM, its access info and the fault
+** descriptors (the latter only if any of them may be nonzero), to tell
+** whether an instance is still in sync with a checkpoint.
+*/
+static uint64 cu_avr_ckpt_fp(cu_avr_ctx_t* ctx)
+{
+ uint64 h = 0xCBF29CE484222325U;
+ auint  i;
+
+ for (i = 0U; i < 4096U; i++){
+  h = cu_avr_hash_fold(h, ((auint)(ctx->cpu_state.sram[i]) << 8) |
+                          ((auint)(ctx->access_mem[i])        ));
+ }
+ h = cu_avr_hash_fold(h, ctx->fdsc_set);
+ if (ctx->fdsc_set){
+  for (i = 0U; i < 0x8000U; i++){
+   h = cu_avr_hash_fold(h, ctx->cpu_fdsc[i]);
+  }
+ }
+ h ^= h >> 29;
+
+ return h;
+}
+
+
+
+/*
+** Saves the state of the instance into a new checkpoint. Returns NULL if it
+** can not be allocated. Emulation continued from a reached checkpoint runs
+** as if it wasn't stopped there.
+*/
+cu_avr_ckpt_t* cu_avr_ckpt_save(cu_avr_ctx_t* ctx)
+{
+ cu_avr_ckpt_t* ckpt = malloc(sizeof(cu_avr_ckpt_t));
+ auint          i;
+
+ if (ckpt == NULL){ return NULL; }
+
+ cu_avr_sreg_sync(ctx);
+
+ memcpy(&ckpt->cpu_state,   &ctx->cpu_state,   sizeof(ckpt->cpu_state));
+ memcpy(&ckpt->cpu_fdsc,    &ctx->cpu_fdsc,    sizeof(ckpt->cpu_fdsc));
+ memcpy(&ckpt->access_mem,  &ctx->access_mem,  sizeof(ckpt->access_mem));
+ memcpy(&ckpt->access_io,   &ctx->access_io,   sizeof(ckpt->access_io));
+ memcpy(&ckpt->port_states, &ctx->port_states, sizeof(ckpt->port_states));
+ memcpy(&ckpt->port_data,   &ctx->port_data,   sizeof(ckpt->port_data));
+
+ ckpt->stuck_set = malloc((ctx->stuck_cnt + 1U) * sizeof(cu_avr_stuck_t));
+ if (ckpt->stuck_set == NULL){ free(ckpt); return NULL; }
+ ckpt->stuck_cnt = 0U;
+ for (i = 0U; i < (1U << ctx->stuck_sh); i++){
+  if (ctx->stuck_set[i].key != 0U){
+   ckpt->stuck_set[ckpt->stuck_cnt] = ctx->stuck_set[i];
+   ckpt->stuck_cnt ++;
+  }
+ }
+ ckpt->stuck_lost = ctx->stuck_lost;
+
+ /* The instance is in sync with the checkpoint from here */
+
+ for (i = 0U; i < (4096U >> MEM_PAGE_SH); i++){
+  ckpt->mem_used[i] = ctx->mem_ckpt[i] || ctx->mem_dirty[i];
+  ctx->mem_ckpt[i]  = ckpt->mem_used[i];
+  ctx->mem_dirty[i] = FALSE;
+ }
+ ckpt->mem_fp  = cu_avr_ckpt_fp(ctx);
+ ctx->ckpt_fp  = ckpt->mem_fp;
+ ctx->ckpt_fpv = TRUE;
+ ctx->fdsc_lo  = 0x8000U;
+ ctx->fdsc_hi  = 0U;
+
+ /* Code ROM hash (the compiled code's if it is known to match the Code ROM,
+ ** taking it if it was not yet since the last cu_avr_crom_update()) */
+
+ if (ctx->crom_chk){
+  ckpt->crom_hash = cu_avr_crom_hash(&ctx->cpu_state.crom[0]);
+ }else{
+  if (!ctx->crom_hv){
+   ctx->crom_hash = cu_avr_crom_hash(&ctx->cpu_state.crom[0]);
+   ctx->crom_hv   = TRUE;
+  }
+  ckpt->crom_hash = ctx->crom_hash;
+ }
+
+ ckpt->fdsc_set         = ctx->fdsc_set;
+ ckpt->cycle_next_event = ctx->cycle_next_event;
+ ckpt->timer1_base      = ctx->timer1_base;
+ ckpt->event_it         = ctx->event_it;
+ ckpt->event_it_enter   = ctx->event_it_enter;
+ ckpt->event_it_vect    = ctx->event_it_vect;
+ ckpt->alu_ismod        = ctx->alu_ismod;
+ ckpt->cycle_count_max  = ctx->ckpt_hit ? ctx->ckpt_cmax : ctx->cycle_count_max;
+ ckpt->guard_isacc      = ctx->guard_isacc;
+ ckpt->gold_pos         = ctx->gold_pos;
+ ckpt->gold_st          = ctx->gold_st;
+ ckpt->gold_cyc         = ctx->gold_cyc;
+ ckpt->out_hash         = ctx->out_hash;
+ ckpt->alu_modcyc       = ctx->alu_modcyc;
+ ckpt->skip_mask        = ctx->skip_mask;
+ ckpt->skip_comp        = ctx->skip_comp;
+ ckpt->cond_mask        = ctx->cond_mask;
+ ckpt->cond_comp        = ctx->cond_comp;
+ ckpt->cond_jmp         = ctx->cond_jmp;
+ ckpt->idc_val          = ctx->idc_val;
+ ckpt->idc_opc          = ctx->idc_opc;
+ ckpt->flag_mask        = ctx->flag_mask;
+ ckpt->flag_comp        = ctx->flag_comp;
+ ckpt->flag_or          = ctx->flag_or;
+ ckpt->flag_and         = ctx->flag_and;
+
+ return ckpt;
+}
+
+
+
+/*
+** Restores the state of the instance from a checkpoint. A checkpoint may be
+** restored any number of times into any instance, also concurrently. Only
+** the parts which may differ are copied: if the instance is in sync with a
+** checkpoint of the same fingerprint (it was last saved into or restored
+** from one), the SRAM pages accessed and the fault descriptors rebuilt since,
+** otherwise the whole SRAM and fault descriptors (the latter only if any of
+** them may be nonzero). The Code ROM is only copied (and recompiled) if its
+** hash differs from the checkpoint's.
+*/
+void  cu_avr_ckpt_restore(cu_avr_ctx_t* ctx, cu_avr_ckpt_t const* ckpt)
+{
+ auint i;
+ auint pg = 1U << MEM_PAGE_SH;
+ boole sync;
+
+ /* CPU state except the Code ROM and the SRAM */
+
+ memcpy(&ctx->cpu_state.eepr[0], &ckpt->cpu_state.eepr[0],
+        sizeof(cu_state_cpu_t) - offsetof(cu_state_cpu_t, eepr));
+
+ /* SRAM and its access info */
+
+ sync = ctx->ckpt_fpv && (ctx->ckpt_fp == ckpt->mem_fp);
+
+ if (sync){
+  for (i = 0U; i < (4096U >> MEM_PAGE_SH); i++){
+   if (ctx->mem_dirty[i]){
+    memcpy(&ctx->cpu_state.sram[i * pg], &ckpt->cpu_state.sram[i * pg], pg);
+    memcpy(&ctx->access_mem[i * pg],     &ckpt->access_mem[i * pg],     pg);
+    ctx->hash_dirty[i] = TRUE;
+   }
+  }
+ }else{
+  memcpy(&ctx->cpu_state.sram, &ckpt->cpu_state.sram,
+         sizeof(ckpt->cpu_state.sram));
+  memcpy(&ctx->access_mem,     &ckpt->access_mem,
+         sizeof(ckpt->access_mem));
+  ctx->state_valid = FALSE;
+ }
+ memset(&ctx->mem_dirty[0], FALSE, sizeof(ctx->mem_dirty));
+ memcpy(&ctx->mem_ckpt,     &ckpt->mem_used,  sizeof(ckpt->mem_used));
+
+ memcpy(&ctx->access_io,   &ckpt->access_io,   sizeof(ckpt->access_io));
+ memcpy(&ctx->port_states, &ckpt->port_states, sizeof(ckpt->port_states));
+ memcpy(&ctx->port_data,   &ckpt->port_data,   sizeof(ckpt->port_data));
+
+ /* Stuck bits: clear the instance's own, then add the checkpoint's */
+
+ cu_avr_stuck_clear(ctx);
+ ctx->stuck_lost = ckpt->stuck_lost;
+ for (i = 0U; i < ckpt->stuck_cnt; i++){
+  if (!cu_avr_stuck_set(ctx, ckpt->stuck_set[i].key, ckpt->stuck_set[i].and_m,
+                                                     ckpt->stuck_set[i].or_m)){
+   ctx->stuck_lost = TRUE;
+  }
+ }
+
+ ctx->cycle_next_event = ckpt->cycle_next_event;
+ ctx->timer1_base      = ckpt->timer1_base;
+ ctx->event_it         = ckpt->event_it;
+ ctx->event_it_enter   = ckpt->event_it_enter;
+ ctx->event_it_vect    = ckpt->event_it_vect;
+ ctx->alu_ismod        = ckpt->alu_ismod;
+ ctx->cycle_count_max  = ckpt->cycle_count_max;
+ ctx->guard_isacc      = ckpt->guard_isacc;
+ ctx->gold_pos         = ckpt->gold_pos;
+ ctx->gold_st          = ckpt->gold_st;
+ ctx->gold_cyc         = ckpt->gold_cyc;
+ ctx->out_hash         = ckpt->out_hash;
+ ctx->alu_modcyc       = ckpt->alu_modcyc;
+ ctx->conv_next        = 0U;
+ ctx->conv_st          = CU_AVR_CONV_NONE;
+ ctx->conv_dcyc        = 0U;
+ ctx->conv_cyc         = 0U;
+ cu_avr_hang_init(ctx);
+ cu_avr_prof_init(ctx);
+ ctx->skip_mask        = ckpt->skip_mask;
+ ctx->skip_comp        = ckpt->skip_comp;
+ ctx->cond_mask        = ckpt->cond_mask;
+ ctx->cond_comp        = ckpt->cond_comp;
+ ctx->cond_jmp         = ckpt->cond_jmp;
+ ctx->idc_val          = ckpt->idc_val;
+ ctx->idc_opc          = ckpt->idc_opc;
+ ctx->flag_mask        = ckpt->flag_mask;
+ ctx->flag_comp        = ckpt->flag_comp;
+ ctx->flag_or          = ckpt->flag_or;
+ ctx->flag_and         = ckpt->flag_and;
+ ctx->cycle_horizon    = 0U;
+ ctx->sreg_keep        = 0U;
+ ctx->ckpt_req         = FALSE;
+ ctx->ckpt_hit         = FALSE;
+
+ /* Code ROM and fault descriptors (the latter only if any of them may be
+ ** nonzero) */
+
+ if ( ctx->crom_chk || (!ctx->crom_hv) ||
+      (ctx->crom_hash != ckpt->crom_hash) ){
+  memcpy(&ctx->cpu_state.crom, &ckpt->cpu_state.crom,
+         sizeof(ckpt->cpu_state.crom));
+  cu_avr_crom_update(ctx, 0U, 65536U);
+  ctx->crom_hash = ckpt->crom_hash;
+  ctx->crom_hv   = TRUE;
+  ctx->crom_chk  = FALSE;
+  ctx->cpu_state.crom_mod = ckpt->cpu_state.crom_mod;
+ }else if (sync){
+  if (ctx->fdsc_lo < ctx->fdsc_hi){
+   memcpy(&ctx->cpu_fdsc[ctx->fdsc_lo], &ckpt->cpu_fdsc[ctx->fdsc_lo],
+          ctx->fdsc_hi - ctx->fdsc_lo);
+  }
+  ctx->fdsc_set = ckpt->fdsc_set;
+ }else if (ctx->fdsc_set || ckpt->fdsc_set){
+  memcpy(&ctx->cpu_fdsc, &ckpt->cpu_fdsc, sizeof(ckpt->cpu_fdsc));
+  ctx->fdsc_set = ckpt->fdsc_set;
+ }
+
+ /* The instance is in sync with the checkpoint from here */
+
+ ctx->ckpt_fp    = ckpt->mem_fp;
+ ctx->ckpt_fpv   = TRUE;
+ ctx->fdsc_lo    = 0x8000U;
+ ctx->fdsc_hi    = 0U;
+ ctx->reset_init = NULL;
+}
+
+
+
+/*
+** Destroys a checkpoint.
+*/
+void  cu_avr_ckpt_free(cu_avr_ckpt_t* ckpt)
+{
+ if (ckpt == NULL){ return; }
 
- cycle_next_event = WRAP32(cpu_state.cycle + 1U); /* Request HW processing */
- event_it         = TRUE; /* Request interrupt processing */
+ free(ckpt->stuck_set);
+ free(ckpt);
 }
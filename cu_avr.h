@@ -35,19 +35,106 @@
 #include "cu_types.h"
 
 
+/*
+** Emulator instance. Any number of instances may exist, each used by one
+** thread at a time. All the functions below operate on the passed instance.
+*/
+typedef struct cu_avr_ctx_s cu_avr_ctx_t;
+
+
+/*
+** Output function receiving the text produced by the program on the output
+** ports. The text (of len bytes) is not terminated.
+*/
+typedef void (cu_avr_out_t)(void* user, char const* str, auint len);
+
+
+/*
+** Outcomes of the golden output comparison (see cu_avr_set_golden()): none
+** yet (still matching), diverged, and prefix matched.
+*/
+#define CU_AVR_GOLD_NONE    0U
+#define CU_AVR_GOLD_DIFF    1U
+#define CU_AVR_GOLD_PREFIX  2U
+
+
+/*
+** Result function receiving the bytes written by the program on the binary
+** result port.
+*/
+typedef void (cu_avr_res_t)(void* user, uint8 const* data, auint len);
+
+
+/*
+** State hash trace of a reference run for detecting when a run converges to
+** the state of the reference (see cu_avr_set_conv()).
+*/
+typedef struct cu_avr_conv_s cu_avr_conv_t;
+
+
+/*
+** Outcomes of the state convergence check (see cu_avr_set_conv()): none
+** (no divergence seen), diverged, and masked (converged back).
+*/
+#define CU_AVR_CONV_NONE    0U
+#define CU_AVR_CONV_DIFF    1U
+#define CU_AVR_CONV_MASKED  2U
+
+
+/*
+** Outcomes of hang detection (see cu_avr_set_hang()): none, the program
+** entered an endless loop, and the cycle budget is exhausted.
+*/
+#define CU_AVR_HANG_NONE    0U
+#define CU_AVR_HANG_LOOP    1U
+#define CU_AVR_HANG_BUDGET  2U
+
+
+/*
+** Checkpoint: the state of an instance to continue emulation from, such as
+** to run several behaviour modification variants from the point the program
+** enables them, instead of from reset.
+*/
+typedef struct cu_avr_ckpt_s cu_avr_ckpt_t;
+
+
+/*
+** Creates an emulator instance. Returns NULL if it can not be allocated.
+** The instance has to be reset (by cu_avr_reset()) before running it.
+*/
+cu_avr_ctx_t* cu_avr_new(void);
+
+
+/*
+** Destroys an emulator instance.
+*/
+void  cu_avr_free(cu_avr_ctx_t* ctx);
+
+
 /*
 ** Resets the CPU as if it was power-cycled. It properly initializes
 ** everything from the state as if cu_avr_crom_update() and cu_avr_io_update()
 ** was called.
 */
-void  cu_avr_reset(void);
+void  cu_avr_reset(cu_avr_ctx_t* ctx);
+
+
+/*
+** Resets the CPU to the memories of init (the SRAM, EEPROM and Code ROM,
+** such as of the state a binary was loaded into) as if they were written
+** into the state returned by cu_avr_get_state() before cu_avr_reset(). If
+** the instance was last reset to the same init, only the SRAM pages accessed
+** since are copied (emulation doesn't alter the rest of these), so init must
+** not change while it is used.
+*/
+void  cu_avr_reset_to(cu_avr_ctx_t* ctx, cu_state_cpu_t const* init);
 
 
 /*
 ** Run emulation. Returns according to the return values defined in cu_types
 ** (emulating up to about 2050 cycles).
 */
-auint cu_avr_run(void);
+auint cu_avr_run(cu_avr_ctx_t* ctx);
 
 
 /*
@@ -55,7 +142,7 @@ auint cu_avr_run(void);
 ** doesn't generate proper video signal. This is the cycle member of the CPU
 ** state (32 bits wrapping).
 */
-auint cu_avr_getcycle(void);
+auint cu_avr_getcycle(cu_avr_ctx_t* ctx);
 
 
 /*
@@ -64,7 +151,7 @@ auint cu_avr_getcycle(void);
 ** of the RAM come first here! (so address 0x0100 corresponds to AVR address
 ** 0x0100)
 */
-uint8* cu_avr_get_meminfo(void);
+uint8* cu_avr_get_meminfo(cu_avr_ctx_t* ctx);
 
 
 /*
@@ -72,7 +159,7 @@ uint8* cu_avr_get_meminfo(void);
 ** clear flags which are only set by the emulator. It doesn't reflect implicit
 ** accesses, only those explicitly performed by read or write operations.
 */
-uint8* cu_avr_get_ioinfo(void);
+uint8* cu_avr_get_ioinfo(cu_avr_ctx_t* ctx);
 
 
 /*
@@ -80,7 +167,7 @@ uint8* cu_avr_get_ioinfo(void);
 ** determine if it is necessary to include the Code ROM in a save state.
 ** Internal Code ROM writes and the cu_avr_crom_update() function can set it.
 */
-boole cu_avr_crom_ismod(void);
+boole cu_avr_crom_ismod(cu_avr_ctx_t* ctx);
 
 
 /*
@@ -89,7 +176,7 @@ boole cu_avr_crom_ismod(void);
 ** or freshly written, and the IO space needs to be updated (by
 ** cu_avr_io_update()) if anything in that area was modified.
 */
-cu_state_cpu_t* cu_avr_get_state(void);
+cu_state_cpu_t* cu_avr_get_state(cu_avr_ctx_t* ctx);
 
 
 /*
@@ -97,7 +184,23 @@ cu_state_cpu_t* cu_avr_get_state(void);
 ** the Code ROM so the emulator recompiles the affected instructions. The
 ** "base" and "len" parameters specify the range to update in bytes.
 */
-void  cu_avr_crom_update(auint base, auint len);
+void  cu_avr_crom_update(cu_avr_ctx_t* ctx, auint base, auint len);
+
+
+/*
+** Exports the compiled code of the whole Code ROM (32K opcodes) into code,
+** compiling what wasn't compiled yet. The Code ROM is recompiled first if it
+** was written without cu_avr_crom_update().
+*/
+void  cu_avr_code_export(cu_avr_ctx_t* ctx, uint32* code);
+
+
+/*
+** Imports compiled code exported by cu_avr_code_export() from an identical
+** Code ROM (with an identical CU_AVRC_VER). Use this in place of
+** cu_avr_crom_update() after writing the Code ROM to spare the compilation.
+*/
+void  cu_avr_code_import(cu_avr_ctx_t* ctx, uint32 const* code);
 
 
 /*
@@ -106,7 +209,170 @@ void  cu_avr_crom_update(auint base, auint len);
 ** emulator state over it. It also updates state related to additional
 ** variables in the structure (such as the watchdog timer).
 */
-void  cu_avr_io_update(void);
+void  cu_avr_io_update(cu_avr_ctx_t* ctx);
+
+
+
+/*
+** Sets the output function receiving the text produced by the program on
+** the output ports (0xE0 - 0xE3). With NULL, the text goes to the standard
+** output.
+*/
+void  cu_avr_set_output(cu_avr_ctx_t* ctx, cu_avr_out_t* func, void* user);
+
+
+/*
+** Sets the result function receiving the bytes written by the program on
+** the binary result port (0xE4). With NULL, they are discarded.
+*/
+void  cu_avr_set_result(cu_avr_ctx_t* ctx, cu_avr_res_t* func, void* user);
+
+
+/*
+** Returns the exit status set by the program on the exit status port
+** (0xE5), zero if it wasn't written since reset.
+*/
+auint cu_avr_get_status(cu_avr_ctx_t* ctx);
+
+
+/*
+** Sets the golden output (of len bytes, NULL to turn off) the text output
+** of the program is compared with as it is produced. Emulation stops when
+** it diverges, or if prefix is nonzero, when that many bytes matched. The
+** buffer is not copied, it has to remain valid while used. The comparison
+** starts at reset.
+*/
+void  cu_avr_set_golden(cu_avr_ctx_t* ctx, char const* gold, auint len, auint prefix);
+
+
+/*
+** Returns the outcome of the golden output comparison (CU_AVR_GOLD_), the
+** count of matching bytes into pos, and the cycle emulation stopped at into
+** cycle (for CU_AVR_GOLD_DIFF and CU_AVR_GOLD_PREFIX). If the output ended
+** early, the outcome is CU_AVR_GOLD_NONE with pos below the golden length.
+*/
+auint cu_avr_get_golden(cu_avr_ctx_t* ctx, auint* pos, auint* cycle);
+
+
+/*
+** Creates an empty state hash trace, sampling the state every ival cycles
+** (at least 64). Returns NULL if it can not be allocated.
+*/
+cu_avr_conv_t* cu_avr_conv_new(auint ival);
+
+
+/*
+** Frees a state hash trace (NULL is accepted).
+*/
+void  cu_avr_conv_free(cu_avr_conv_t* conv);
+
+
+/*
+** Sets up the state convergence check (NULL to turn off). The state of the
+** program (memory, I/O, pending hardware events and the output so far) is
+** hashed every ival cycles while the behaviour modifications are disabled.
+** If rec is TRUE, the hashes are recorded into the trace (the reference
+** run), otherwise compared with it: emulation stops when the state matches
+** the reference's at the same cycle, and the reference doesn't enable the
+** behaviour modifications later, so the rest of the run would be identical
+** (the faults are masked). A trace recorded by an instance may be compared
+** with by any number of others at once.
+*/
+void  cu_avr_set_conv(cu_avr_ctx_t* ctx, cu_avr_conv_t* conv, boole rec);
+
+
+/*
+** Returns the outcome of the state convergence check (CU_AVR_CONV_), the
+** cycle of the first sample diverging from the reference into dcyc (zero if
+** none did), and the cycle emulation stopped at into cycle (for
+** CU_AVR_CONV_MASKED).
+*/
+auint cu_avr_get_conv(cu_avr_ctx_t* ctx, auint* dcyc, auint* cycle);
+
+
+/*
+** Sets up hang detection. From the cycle start, every ival cycles (at least
+** 1024, zero turns it off) the program is probed for an eighth of it,
+** stepping instructions: if the state at the target of a backward jump
+** repeats exactly, the program is in an endless loop, so emulation stops.
+** Loops repeating within about half of the probe are found, though if the
+** timer is started or read, the state only repeats with it in the same
+** phase (normally after 65536 cycles). If budget is nonzero, emulation also
+** stops when the cycle counter reaches it.
+*/
+void  cu_avr_set_hang(cu_avr_ctx_t* ctx, auint ival, auint start, auint budget);
+
+
+/*
+** Returns the outcome of hang detection (CU_AVR_HANG_), the cycle emulation
+** stopped at into cycle, and the period of the loop into period (for
+** CU_AVR_HANG_LOOP).
+*/
+auint cu_avr_get_hang(cu_avr_ctx_t* ctx, auint* cycle, auint* period);
+
+
+/*
+** Sets up the cycle profile: every ival cycles (zero: disabled) a sample is
+** added to the counter of the instruction the cycles were spent on in prof
+** (32K counters for the words of the Code ROM, NULL: disabled). The counters
+** are only added to, the first sample is an interval from the current cycle
+** (or reset).
+*/
+void  cu_avr_set_profile(cu_avr_ctx_t* ctx, auint* prof, auint ival);
+
+
+/*
+** Writes an I/O port as if the program wrote it. This can be used to
+** configure behaviour modifications (ports 0xF1 - 0xF7) before running the
+** program.
+*/
+void  cu_avr_write_port(cu_avr_ctx_t* ctx, auint port, auint val);
+
+
+
+/*
+** Requests stopping at the next checkpoint: the first "ijmp" enabling
+** behaviour modifications (stopping before it would be executed) or a write
+** to the checkpoint port (0xEC). The request is cleared by cu_avr_reset().
+*/
+void  cu_avr_ckpt_request(cu_avr_ctx_t* ctx);
+
+
+/*
+** Returns whether the last cu_avr_run() returned by reaching the requested
+** checkpoint.
+*/
+boole cu_avr_ckpt_reached(cu_avr_ctx_t* ctx);
+
+
+/*
+** Returns whether a stuck bit fault written since the last reset could not
+** be added for the lack of memory, so the emulation did not behave as
+** configured. A checkpoint restore carries it over from the checkpoint.
+*/
+boole cu_avr_stuck_lost(cu_avr_ctx_t* ctx);
+
+
+/*
+** Saves the state of the instance into a new checkpoint. Returns NULL if it
+** can not be allocated. Emulation continued from a reached checkpoint runs
+** as if it wasn't stopped there.
+*/
+cu_avr_ckpt_t* cu_avr_ckpt_save(cu_avr_ctx_t* ctx);
+
+
+/*
+** Restores the state of the instance from a checkpoint. A checkpoint may be
+** restored any number of times into any instance, also concurrently. The
+** Code ROM is only recompiled if it differs from the checkpoint's.
+*/
+void  cu_avr_ckpt_restore(cu_avr_ctx_t* ctx, cu_avr_ckpt_t const* ckpt);
+
+
+/*
+** Destroys a checkpoint.
+*/
+void  cu_avr_ckpt_free(cu_avr_ckpt_t* ckpt);
 
 
 #endif
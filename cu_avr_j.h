@@ -0,0 +1,728 @@
+/*
+ *  AVR microcontroller emulation, x86-64 dynamic translator
+ *
+ *  Copyright (C) 2016 - 2017
+ *    Sandor Zsuga (Jubatian)
+ *  Uzem (the base of CUzeBox) is copyright (C)
+ *    David Etherton,
+ *    Eric Anderton,
+ *    Alec Bourque (Uze),
+ *    Filipe Rinaldi,
+ *    Sandor Zsuga (Jubatian),
+ *    Matt Pandina (Artcfox)
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef CU_AVR_C
+#error "This file is part of cu_avr.c!"
+#endif
+
+
+
+/*
+** This is a variant of the instruction decoder translating runs of compiled
+** instructions (blocks) into x86-64 machine code. The frequent ALU
+** operations, data moves, relative jumps and branches are emitted as native
+** code, the rest become calls into the plain opcode handlers.
+**
+** The native ALU operations compute the host flags, which are converted into
+** the AVR flags through a table (jit_fmap). Flag updates are only emitted if
+** any of the produced flags may be used before being overwritten within the
+** block, SREG is always up to date at block exits and handler calls. Lazily
+** evaluated flags (SREG=lazy) are materialized on entering the translated
+** code and after handler calls, so it only works with SREG.
+**
+** Translated code only runs below the event horizon, with the ALU behaviour
+** modifications disabled and with no interrupt check pending (event_it
+** clear). A block only starts if all its instructions fit below the horizon,
+** so the PC and the cycle counter are only written back before handler calls
+** and at the exits. Blocks are chained through a table indexed by the word
+** address, branches back to the start of the block jump there directly.
+**
+** On other hosts (or if no executable memory is available) it falls back to
+** interpreting with the plain opcode handlers.
+*/
+
+
+
+#if (defined(__x86_64__) && !defined(TARGET_WINDOWS_MINGW))
+#include <stddef.h>
+#include <sys/mman.h>
+#define JIT_NATIVE
+#endif
+
+
+
+/* Plain opcode handlers. Superinstructions are only run by these when
+** interpreting, the translator processes words one by one */
+static avr_opcode* const avr_opcode_table_jit[128U] = {
+ &op_00, &op_01, &op_02, &op_03, &op_04, &op_05, &op_06, &op_07,
+ &op_08, &op_09, &op_0A, &op_0B, &op_0C, &op_0D, &op_0E, &op_0F,
+ &op_10, &op_11, &op_12, &op_13, &op_14, &op_15, &op_16, &op_17,
+ &op_18, &op_19, &op_1A, &op_1B, &op_1C, &op_1D, &op_1E, &op_1F,
+ &op_20, &op_21, &op_22, &op_23, &op_24, &op_25, &op_26, &op_27,
+ &op_28, &op_29, &op_2A, &op_2B, &op_2C, &op_2D, &op_2E, &op_2F,
+ &op_30, &op_31, &op_32, &op_33, &op_34, &op_35, &op_36, &op_37,
+ &op_38, &op_39, &op_3A, &op_3B, &op_3C, &op_3D, &op_3E, &op_3F,
+ &op_40, &op_41, &op_42, &op_43, &op_44, &op_45, &op_46, &op_47,
+ &op_48, &op_49, &op_4A, &op_4B, &op_4C, &op_4D, &op_4E, &op_4F,
+ &op_50, &op_51, &op_52, &op_53, &op_54, &op_55, &op_56, &op_57,
+ &op_60, &op_4A, &op_4A, &op_4A, &op_4A, &op_4A, &op_4A, &op_4A,
+ &op_4A, &op_4A, &op_4A, &op_4A, &op_4A, &op_4A, &op_4A, &op_4A,
+ &op_4A, &op_4A, &op_4A, &op_4A, &op_4A, &op_4A, &op_4A, &op_4A,
+ &op_4A, &op_4A, &op_4A, &op_4A, &op_4A, &op_4A, &op_4A, &op_4A,
+ &op_4A, &op_4A, &op_4A, &op_4A, &op_4A, &op_4A, &op_4A, &op_4A
+};
+
+/* Operation of each compiled opcode with the superinstructions replaced by
+** their first instruction */
+static const uint8 jit_base_op[128U] = {
+ 0x00U, 0x01U, 0x02U, 0x03U, 0x04U, 0x05U, 0x06U, 0x07U,
+ 0x08U, 0x09U, 0x0AU, 0x0BU, 0x0CU, 0x0DU, 0x0EU, 0x0FU,
+ 0x10U, 0x11U, 0x12U, 0x13U, 0x14U, 0x15U, 0x16U, 0x17U,
+ 0x18U, 0x19U, 0x1AU, 0x1BU, 0x1CU, 0x1DU, 0x1EU, 0x1FU,
+ 0x20U, 0x21U, 0x22U, 0x23U, 0x24U, 0x25U, 0x26U, 0x27U,
+ 0x28U, 0x29U, 0x2AU, 0x2BU, 0x2CU, 0x2DU, 0x2EU, 0x2FU,
+ 0x30U, 0x31U, 0x32U, 0x33U, 0x34U, 0x35U, 0x36U, 0x37U,
+ 0x38U, 0x39U, 0x3AU, 0x3BU, 0x3CU, 0x3DU, 0x3EU, 0x3FU,
+ 0x40U, 0x41U, 0x42U, 0x43U, 0x44U, 0x45U, 0x46U, 0x47U,
+ 0x48U, 0x49U, 0x4AU, 0x0BU, 0x12U, 0x07U, 0x0BU, 0x0BU,
+ 0x12U, 0x12U, 0x2BU, 0x48U, 0x01U, 0x14U, 0x09U, 0x0CU,
+ 0x60U, 0x4AU, 0x4AU, 0x4AU, 0x4AU, 0x4AU, 0x4AU, 0x4AU,
+ 0x4AU, 0x4AU, 0x4AU, 0x4AU, 0x4AU, 0x4AU, 0x4AU, 0x4AU,
+ 0x4AU, 0x4AU, 0x4AU, 0x4AU, 0x4AU, 0x4AU, 0x4AU, 0x4AU,
+ 0x4AU, 0x4AU, 0x4AU, 0x4AU, 0x4AU, 0x4AU, 0x4AU, 0x4AU,
+ 0x4AU, 0x4AU, 0x4AU, 0x4AU, 0x4AU, 0x4AU, 0x4AU, 0x4AU
+};
+
+
+
+/*
+** Executes a single instruction with the plain opcode handlers. Used when
+** the translated code can not run.
+*/
+static void cu_avr_jit_step(cu_avr_ctx_t* ctx)
+{
+ auint opcode = cu_avr_code_get(ctx, ctx->cpu_state.pc);
+ auint arg1   = (opcode >>  8) & 0xFFU;
+ auint arg2   = (opcode >> 16) & 0xFFFFU;
+
+ ctx->cpu_state.pc ++;
+ avr_opcode_table_jit[opcode & 0x7FU](ctx, arg1, arg2);
+}
+
+
+
+#ifdef JIT_NATIVE
+
+/* Size of the code cache */
+#define JIT_CACHE_SIZE  0x400000U
+
+/* Maximal number of instructions translated into a block */
+#define JIT_BLOCK_MAX   64U
+
+/* Maximal size of a translated instruction and of the block prologue */
+#define JIT_INSTR_SIZE  128U
+
+/* Offsets within the instance (addressed by rbx in translated code) */
+#define JIT_OFF_PC      ((auint)(offsetof(cu_avr_ctx_t, cpu_state.pc)))
+#define JIT_OFF_CYCLE   ((auint)(offsetof(cu_avr_ctx_t, cpu_state.cycle)))
+#define JIT_OFF_IORS    ((auint)(offsetof(cu_avr_ctx_t, cpu_state.iors)))
+#define JIT_OFF_SKEEP   ((auint)(offsetof(cu_avr_ctx_t, sreg_keep)))
+#define JIT_OFF_SREG    (JIT_OFF_IORS + CU_IO_SREG)
+
+/* Flags written and read by the natively translated operations */
+#define JIT_FL_ALL      0x3FU
+#define JIT_FL_LOG      0x1EU
+#define JIT_FL_WORD     0x1FU
+#define JIT_FL_CZ       0x03U
+
+
+
+/* Code emitting helpers */
+
+static void jit_b(uint8** pos, auint val)
+{
+ **pos = (uint8)(val);
+ (*pos) ++;
+}
+
+static void jit_d(uint8** pos, auint val)
+{
+ jit_b(pos, val      );
+ jit_b(pos, val >>  8);
+ jit_b(pos, val >> 16);
+ jit_b(pos, val >> 24);
+}
+
+static void jit_q(uint8** pos, uintptr_t val)
+{
+ jit_d(pos, (auint)(val));
+ jit_d(pos, (auint)(val >> 32));
+}
+
+/* Emits an instruction operating on [rbx + off] (opcode and ModRM reg) */
+static void jit_rm(uint8** pos, auint op, auint reg, auint off)
+{
+ jit_b(pos, op);
+ jit_b(pos, 0x83U | (reg << 3));
+ jit_d(pos, off);
+}
+
+/* Emits a 32 bit relative jump (opcode bytes given) to a cache offset */
+static void jit_jmp(uint8** pos, auint op0, auint op1, uint8 const* tgt)
+{
+ if (op0 != 0U){ jit_b(pos, op0); }
+ jit_b(pos, op1);
+ jit_d(pos, (auint)(tgt - ((*pos) + 4)));
+}
+
+/* Emits writing back the PC advanced by the given number of words:
+** add r14d, imm32; mov [rbx + pc], r14d */
+static void jit_pcset(uint8** pos, auint adv)
+{
+ if (adv != 0U){
+  jit_b(pos, 0x41U); jit_b(pos, 0x81U); jit_b(pos, 0xC6U); jit_d(pos, adv);
+ }
+ jit_b(pos, 0x44U); jit_rm(pos, 0x89U, 6U, JIT_OFF_PC);
+}
+
+/* Emits adding to the cycle counter: add dword [rbx + cycle], imm */
+static void jit_cycle(uint8** pos, auint cyc)
+{
+ if (cyc == 0U){ return; }
+ if (cyc < 0x80U){
+  jit_rm(pos, 0x83U, 0U, JIT_OFF_CYCLE); jit_b(pos, cyc);
+ }else{
+  jit_rm(pos, 0x81U, 0U, JIT_OFF_CYCLE); jit_d(pos, cyc);
+ }
+}
+
+/* Emits loading the AVR carry into the host carry: mov cl, [SREG]; shr cl, 1 */
+static void jit_carry(uint8** pos)
+{
+ jit_rm(pos, 0x8AU, 1U, JIT_OFF_SREG);
+ jit_b(pos, 0xD0U); jit_b(pos, 0xE9U);
+}
+
+/* Emits materializing lazily evaluated flags a handler might have left:
+** cmp dword [rbx + sreg_keep], 0; je skip; call cu_avr_sreg_sync(ctx) */
+static void jit_sync(uint8** pos)
+{
+ jit_rm(pos, 0x83U, 7U, JIT_OFF_SKEEP); jit_b(pos, 0x00U); /* cmp dword [rbx + sreg_keep], 0 */
+ jit_b(pos, 0x74U); jit_b(pos, 0x0FU);                    /* je +15 */
+ jit_b(pos, 0x48U); jit_b(pos, 0x89U); jit_b(pos, 0xDFU); /* mov rdi, rbx */
+ jit_b(pos, 0x48U); jit_b(pos, 0xB8U); jit_q(pos, (uintptr_t)(&cu_avr_sreg_sync)); /* mov rax, imm64 */
+ jit_b(pos, 0xFFU); jit_b(pos, 0xD0U);                    /* call rax */
+}
+
+/* Emits merging the host flags of the last operation into SREG. The flags in
+** "fmask" are replaced, with "zkeep" the Z flag may only be cleared (CPC,
+** SBC and SBCI), the others (at least I and T) are kept. */
+static void jit_flags(uint8** pos, auint fmask, boole zkeep)
+{
+ jit_b(pos, 0x9FU);                                    /* lahf */
+ jit_b(pos, 0x0FU); jit_b(pos, 0x90U); jit_b(pos, 0xC0U);  /* seto al */
+ jit_b(pos, 0x66U); jit_b(pos, 0xC1U); jit_b(pos, 0xC8U); jit_b(pos, 0x08U); /* ror ax, 8 */
+ jit_b(pos, 0x0FU); jit_b(pos, 0xB7U); jit_b(pos, 0xC0U);  /* movzx eax, ax */
+ jit_b(pos, 0x0FU); jit_b(pos, 0xB6U); jit_b(pos, 0x44U);
+ jit_b(pos, 0x05U); jit_b(pos, 0x00U);                 /* movzx eax, byte [rbp + rax] */
+ jit_rm(pos, 0x8AU, 1U, JIT_OFF_SREG);                 /* mov cl, [SREG] */
+ if (zkeep){
+  jit_b(pos, 0x0CU); jit_b(pos, 0xC0U);                /* or al, 0xC0 */
+  jit_b(pos, 0x80U); jit_b(pos, 0xC9U); jit_b(pos, 0x3DU); /* or cl, 0x3D */
+  jit_b(pos, 0x20U); jit_b(pos, 0xC8U);                /* and al, cl */
+ }else{
+  if (fmask != JIT_FL_ALL){
+   jit_b(pos, 0x24U); jit_b(pos, fmask);               /* and al, fmask */
+  }
+  jit_b(pos, 0x80U); jit_b(pos, 0xE1U); jit_b(pos, (~fmask) & 0xFFU); /* and cl, ~fmask */
+  jit_b(pos, 0x08U); jit_b(pos, 0xC8U);                /* or al, cl */
+ }
+ jit_rm(pos, 0x88U, 0U, JIT_OFF_SREG);                 /* mov [SREG], al */
+}
+
+
+
+/*
+** Allocates the code cache and emits the entry, exit and dispatch code into
+** its beginning. The translated code uses these registers:
+**
+** rbx: ctx (also passed to the opcode handlers)
+** rbp: ctx->jit_fmap
+** r12: &ctx->cycle_horizon
+** r13: ctx->jit_blocks
+** r14: PC at the start of the block (as in cpu_state.pc)
+** r15: &ctx->event_it
+*/
+static void cu_avr_jit_init(cu_avr_ctx_t* ctx)
+{
+ void*  mem;
+ uint8* pos;
+ auint  i;
+ auint  fl;
+
+ ctx->jit_inited = TRUE;
+ mem = mmap(NULL, JIT_CACHE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+ if (mem == MAP_FAILED){ return; }
+ ctx->jit_cache = mem;
+ pos = mem;
+
+ /* Flag map: AH holds SF, ZF, AF and CF in bits 7, 6, 4 and 0 */
+ for (i = 0U; i < 512U; i++){
+  fl = ((i & 0x01U) << SREG_C) |
+       (((i >> 6) & 1U) << SREG_Z) |
+       (((i >> 7) & 1U) << SREG_N) |
+       (((i >> 8) & 1U) << SREG_V) |
+       ((((i >> 7) ^ (i >> 8)) & 1U) << SREG_S) |
+       (((i >> 4) & 1U) << SREG_H);
+  ctx->jit_fmap[i] = (uint8)(fl);
+ }
+
+ /* Entry: save callee-saved registers (also aligning the stack for the
+ ** handler calls), load the base registers, jump to the block in rdi */
+ ctx->jit_enter = (auint(*)(void*))((uintptr_t)(mem));
+ jit_b(&pos, 0x53U);                                   /* push rbx */
+ jit_b(&pos, 0x55U);                                   /* push rbp */
+ jit_b(&pos, 0x41U); jit_b(&pos, 0x54U);               /* push r12 */
+ jit_b(&pos, 0x41U); jit_b(&pos, 0x55U);               /* push r13 */
+ jit_b(&pos, 0x41U); jit_b(&pos, 0x56U);               /* push r14 */
+ jit_b(&pos, 0x41U); jit_b(&pos, 0x57U);               /* push r15 */
+ jit_b(&pos, 0x48U); jit_b(&pos, 0x83U); jit_b(&pos, 0xECU); jit_b(&pos, 0x08U); /* sub rsp, 8 */
+ jit_b(&pos, 0x48U); jit_b(&pos, 0xBBU); jit_q(&pos, (uintptr_t)(ctx));                 /* mov rbx, imm64 */
+ jit_b(&pos, 0x48U); jit_b(&pos, 0xBDU); jit_q(&pos, (uintptr_t)(&ctx->jit_fmap[0]));   /* mov rbp, imm64 */
+ jit_b(&pos, 0x49U); jit_b(&pos, 0xBCU); jit_q(&pos, (uintptr_t)(&ctx->cycle_horizon)); /* mov r12, imm64 */
+ jit_b(&pos, 0x49U); jit_b(&pos, 0xBDU); jit_q(&pos, (uintptr_t)(&ctx->jit_blocks[0])); /* mov r13, imm64 */
+ jit_b(&pos, 0x49U); jit_b(&pos, 0xBFU); jit_q(&pos, (uintptr_t)(&ctx->event_it));      /* mov r15, imm64 */
+ jit_b(&pos, 0xFFU); jit_b(&pos, 0xE7U);               /* jmp rdi */
+
+ /* Exits: return 0 (block could not start) or 1, restoring registers */
+ ctx->jit_exit0 = pos;
+ jit_b(&pos, 0x31U); jit_b(&pos, 0xC0U);               /* xor eax, eax */
+ jit_b(&pos, 0xEBU); jit_b(&pos, 0x05U);               /* jmp +5 */
+ ctx->jit_exit1 = pos;
+ jit_b(&pos, 0xB8U); jit_d(&pos, 1U);                  /* mov eax, 1 */
+ jit_b(&pos, 0x48U); jit_b(&pos, 0x83U); jit_b(&pos, 0xC4U); jit_b(&pos, 0x08U); /* add rsp, 8 */
+ jit_b(&pos, 0x41U); jit_b(&pos, 0x5FU);               /* pop r15 */
+ jit_b(&pos, 0x41U); jit_b(&pos, 0x5EU);               /* pop r14 */
+ jit_b(&pos, 0x41U); jit_b(&pos, 0x5DU);               /* pop r13 */
+ jit_b(&pos, 0x41U); jit_b(&pos, 0x5CU);               /* pop r12 */
+ jit_b(&pos, 0x5DU);                                   /* pop rbp */
+ jit_b(&pos, 0x5BU);                                   /* pop rbx */
+ jit_b(&pos, 0xC3U);                                   /* ret */
+
+ /* Dispatch: continue with the block at the PC if it is translated (the
+ ** block checks the event horizon) */
+ ctx->jit_dispatch = pos;
+ jit_rm(&pos, 0x8BU, 0U, JIT_OFF_PC);                  /* mov eax, [rbx + pc] */
+ jit_b(&pos, 0x25U); jit_d(&pos, 0x7FFFU);             /* and eax, 0x7FFF */
+ jit_b(&pos, 0x49U); jit_b(&pos, 0x8BU); jit_b(&pos, 0x44U);
+ jit_b(&pos, 0xC5U); jit_b(&pos, 0x00U);               /* mov rax, [r13 + rax * 8] */
+ jit_b(&pos, 0x48U); jit_b(&pos, 0x85U); jit_b(&pos, 0xC0U); /* test rax, rax */
+ jit_jmp(&pos, 0x0FU, 0x84U, ctx->jit_exit1);          /* jz exit1 */
+ jit_b(&pos, 0xFFU); jit_b(&pos, 0xE0U);               /* jmp rax */
+
+ ctx->jit_base = ((auint)(pos - ctx->jit_cache) + 15U) & (~15U);
+ ctx->jit_fill = ctx->jit_base;
+}
+
+
+
+/*
+** Discards all translated blocks.
+*/
+static void cu_avr_jit_flush(cu_avr_ctx_t* ctx)
+{
+ memset(&ctx->jit_blocks[0], 0, sizeof(ctx->jit_blocks));
+ ctx->jit_fill = ctx->jit_base;
+}
+
+
+
+/*
+** Translates the block starting at the given word address. Instructions are
+** collected until one unconditionally transferring control or until the
+** block reaches its maximal length, then the flags needed by each are
+** determined backwards, and the block is emitted. Skips and handler calls
+** changing the PC continue through the dispatch.
+*/
+static void* cu_avr_jit_translate(cu_avr_ctx_t* ctx, auint wadr)
+{
+ uint8  bops[JIT_BLOCK_MAX];
+ uint8  blive[JIT_BLOCK_MAX];
+ auint  bopc[JIT_BLOCK_MAX];
+ auint  bcnt;
+ auint  bmax = 0U;
+ auint  live;
+ auint  fr;
+ auint  fw;
+ uint8* pos;
+ uint8* start;
+ uint8* skip;
+ uint8* jexit0;
+ uint8* jexit1;
+ uint8* jdisp;
+ auint  i;
+ auint  opcode;
+ auint  oper;
+ auint  arg1;
+ auint  arg2;
+ auint  adv  = 0U; /* Words since the PC in r14 */
+ auint  rel  = 0U; /* Words from the start of the block to the PC in r14 */
+ auint  cyc  = 0U; /* Cycles not yet added to the cycle counter */
+ auint  ncyc;
+ auint  tgt;
+ boole  bend = FALSE;
+
+ if ((ctx->jit_fill + ((JIT_BLOCK_MAX + 2U) * JIT_INSTR_SIZE)) > JIT_CACHE_SIZE){
+  cu_avr_jit_flush(ctx);
+ }
+ jexit0 = ctx->jit_exit0;
+ jexit1 = ctx->jit_exit1;
+ jdisp  = ctx->jit_dispatch;
+
+ /* Collect the instructions with the cycles they may take */
+
+ for (bcnt = 0U; (bcnt < JIT_BLOCK_MAX) && (!bend); bcnt ++){
+  opcode = cu_avr_code_get(ctx, wadr + adv);
+  oper   = jit_base_op[opcode & 0x7FU];
+  bopc[bcnt] = opcode;
+  bops[bcnt] = (uint8)(oper);
+  adv   += 1U + ((opcode >> 7) & 1U);
+  switch (oper){
+   case 0x00U: case 0x01U: case 0x07U: case 0x08U: case 0x09U: case 0x0BU:
+   case 0x0CU: case 0x0DU: case 0x0EU: case 0x0FU: case 0x10U: case 0x11U:
+   case 0x12U: case 0x13U: case 0x14U: case 0x15U: case 0x16U: case 0x27U:
+   case 0x2BU: case 0x48U:
+    bmax += 1U;
+    break;
+   case 0x3AU: case 0x3BU: case 0x42U: case 0x43U:
+    bmax += 2U;
+    break;
+   case 0x40U:
+    bmax += 2U;
+    bend  = TRUE;
+    break;
+   default:
+    bmax += CYCLE_INSTR_MAX;
+    bend  = ( (oper == 0x2CU) || (oper == 0x2DU) || (oper == 0x30U) ||
+              (oper == 0x31U) || (oper == 0x32U) || (oper == 0x33U) ||
+              (oper == 0x41U) || (oper == 0x4AU) );
+    break;
+  }
+ }
+
+ /* Flags live after each instruction (all are live at the exits) */
+
+ live = JIT_FL_ALL;
+ i    = bcnt;
+ while (i != 0U){
+  i --;
+  blive[i] = (uint8)(live);
+  switch (bops[i]){
+   case 0x09U: case 0x0BU: case 0x0CU: case 0x12U: case 0x14U:
+    fw = JIT_FL_ALL;  fr = 0U;        break;
+   case 0x0DU:
+    fw = JIT_FL_ALL;  fr = SREG_CM;   break;
+   case 0x07U: case 0x08U: case 0x13U:
+    fw = JIT_FL_ALL;  fr = JIT_FL_CZ; break;
+   case 0x0EU: case 0x0FU: case 0x10U: case 0x15U: case 0x16U:
+   case 0x27U: case 0x2BU:
+    fw = JIT_FL_LOG;  fr = 0U;        break;
+   case 0x3AU: case 0x3BU:
+    fw = JIT_FL_WORD; fr = 0U;        break;
+   case 0x00U: case 0x01U: case 0x11U: case 0x40U: case 0x48U:
+    fw = 0U;          fr = 0U;        break;
+   default: /* Handler calls and branches */
+    fw = 0U;          fr = JIT_FL_ALL; break;
+  }
+  live = (live & (~fw)) | fr;
+ }
+
+ /* Prologue: only run if all the instructions fit below the event horizon,
+ ** then load the PC into r14d */
+
+ pos   = &ctx->jit_cache[ctx->jit_fill];
+ start = pos;
+ jit_b(&pos, 0x41U); jit_b(&pos, 0x8BU); jit_b(&pos, 0x04U); jit_b(&pos, 0x24U); /* mov eax, [r12] */
+ jit_rm(&pos, 0x2BU, 0U, JIT_OFF_CYCLE);                 /* sub eax, [rbx + cycle] */
+ jit_jmp(&pos, 0x0FU, 0x86U, jexit0);                    /* jbe exit0 */
+ jit_b(&pos, 0x3DU); jit_d(&pos, bmax);                  /* cmp eax, bmax */
+ jit_jmp(&pos, 0x0FU, 0x86U, jexit0);                    /* jbe exit0 */
+ jit_b(&pos, 0x44U); jit_rm(&pos, 0x8BU, 6U, JIT_OFF_PC); /* mov r14d, [rbx + pc] */
+
+ adv = 0U;
+ for (i = 0U; i < bcnt; i++){
+
+  opcode = bopc[i];
+  oper   = bops[i];
+  arg1   = JIT_OFF_IORS + ((opcode >>  8) & 0xFFU);
+  arg2   = (opcode >> 16) & 0xFFFFU;
+  live   = blive[i];
+  ncyc   = 1U;
+
+  switch (oper){
+
+   case 0x00U: /* NOP */
+    break;
+
+   case 0x01U: /* MOVW: movzx eax, word [src]; mov [dst], ax */
+    jit_b(&pos, 0x0FU); jit_rm(&pos, 0xB7U, 0U, JIT_OFF_IORS + arg2);
+    jit_b(&pos, 0x66U); jit_rm(&pos, 0x89U, 0U, arg1);
+    break;
+
+   case 0x11U: /* MOV: mov al, [src]; mov [dst], al */
+    jit_rm(&pos, 0x8AU, 0U, JIT_OFF_IORS + arg2);
+    jit_rm(&pos, 0x88U, 0U, arg1);
+    break;
+
+   case 0x48U: /* LDI: mov byte [dst], imm8 */
+    jit_rm(&pos, 0xC6U, 0U, arg1); jit_b(&pos, arg2);
+    break;
+
+   case 0x09U: /* ADD: mov al, [src]; add [dst], al */
+   case 0x0CU: /* SUB: mov al, [src]; sub [dst], al */
+   case 0x0BU: /* CP:  mov al, [src]; cmp [dst], al */
+   case 0x0EU: /* AND: mov al, [src]; and [dst], al */
+   case 0x0FU: /* EOR: mov al, [src]; xor [dst], al */
+   case 0x10U: /* OR:  mov al, [src]; or  [dst], al */
+    jit_rm(&pos, 0x8AU, 0U, JIT_OFF_IORS + arg2);
+    jit_rm(&pos, ( (oper == 0x09U) ? 0x00U : ((oper == 0x0CU) ? 0x28U :
+                 ( (oper == 0x0BU) ? 0x38U : ((oper == 0x0EU) ? 0x20U :
+                 ( (oper == 0x0FU) ? 0x30U : 0x08U))))), 0U, arg1);
+    if ((live & JIT_FL_ALL) != 0U){
+     jit_flags(&pos, ((oper == 0x09U) || (oper == 0x0CU) || (oper == 0x0BU)) ?
+                     JIT_FL_ALL : JIT_FL_LOG, FALSE);
+    }
+    break;
+
+   case 0x0DU: /* ADC: mov al, [src]; (C); adc [dst], al */
+   case 0x08U: /* SBC: mov al, [src]; (C); sbb [dst], al */
+    jit_rm(&pos, 0x8AU, 0U, JIT_OFF_IORS + arg2);
+    jit_carry(&pos);
+    jit_rm(&pos, (oper == 0x0DU) ? 0x10U : 0x18U, 0U, arg1);
+    if ((live & JIT_FL_ALL) != 0U){
+     jit_flags(&pos, JIT_FL_ALL, (oper == 0x08U));
+    }
+    break;
+
+   case 0x07U: /* CPC: mov al, [src]; mov dl, [dst]; (C); sbb dl, al */
+    if ((live & JIT_FL_ALL) != 0U){
+     jit_rm(&pos, 0x8AU, 0U, JIT_OFF_IORS + arg2);
+     jit_rm(&pos, 0x8AU, 2U, arg1);
+     jit_carry(&pos);
+     jit_b(&pos, 0x18U); jit_b(&pos, 0xC2U);
+     jit_flags(&pos, JIT_FL_ALL, TRUE);
+    }
+    break;
+
+   case 0x12U: /* CPI:  cmp byte [dst], imm8 */
+   case 0x14U: /* SUBI: sub byte [dst], imm8 */
+   case 0x15U: /* ORI:  or  byte [dst], imm8 */
+   case 0x16U: /* ANDI: and byte [dst], imm8 */
+    if ((oper != 0x12U) || ((live & JIT_FL_ALL) != 0U)){
+     jit_rm(&pos, 0x80U, ( (oper == 0x12U) ? 7U : ((oper == 0x14U) ? 5U :
+                         ( (oper == 0x15U) ? 1U : 4U))), arg1);
+     jit_b(&pos, arg2);
+    }
+    if ((live & JIT_FL_ALL) != 0U){
+     jit_flags(&pos, (oper <= 0x14U) ? JIT_FL_ALL : JIT_FL_LOG, FALSE);
+    }
+    break;
+
+   case 0x13U: /* SBCI: (C); sbb byte [dst], imm8 */
+    jit_carry(&pos);
+    jit_rm(&pos, 0x80U, 3U, arg1); jit_b(&pos, arg2);
+    if ((live & JIT_FL_ALL) != 0U){
+     jit_flags(&pos, JIT_FL_ALL, TRUE);
+    }
+    break;
+
+   case 0x27U: /* INC: inc byte [dst] */
+   case 0x2BU: /* DEC: dec byte [dst] */
+    jit_rm(&pos, 0xFEU, (oper == 0x27U) ? 0U : 1U, arg1);
+    if ((live & JIT_FL_ALL) != 0U){
+     jit_flags(&pos, JIT_FL_LOG, FALSE);
+    }
+    break;
+
+   case 0x3AU: /* ADIW: add word [dst], imm16 */
+   case 0x3BU: /* SBIW: sub word [dst], imm16 */
+    jit_b(&pos, 0x66U); jit_rm(&pos, 0x81U, (oper == 0x3AU) ? 0U : 5U, arg1);
+    jit_b(&pos, arg2); jit_b(&pos, arg2 >> 8);
+    if ((live & JIT_FL_ALL) != 0U){
+     jit_flags(&pos, JIT_FL_WORD, FALSE);
+    }
+    ncyc = 2U;
+    break;
+
+   case 0x40U: /* RJMP */
+    tgt = (wadr + rel + adv + 1U + arg2) & 0x7FFFU;
+    jit_pcset(&pos, adv + 1U + arg2);
+    jit_cycle(&pos, cyc + 2U);
+    jit_jmp(&pos, 0x00U, 0xE9U, (tgt == (wadr & 0x7FFFU)) ? start : jdisp);
+    break;
+
+   case 0x42U: /* BRBS: test byte [SREG], mask; jz (not taken) */
+   case 0x43U: /* BRBC: test byte [SREG], mask; jnz (not taken) */
+    tgt = (wadr + rel + adv + 1U + arg2) & 0x7FFFU;
+    jit_rm(&pos, 0xF6U, 0U, JIT_OFF_SREG); jit_b(&pos, (opcode >> 8) & 0xFFU);
+    jit_b(&pos, 0x0FU); jit_b(&pos, (oper == 0x42U) ? 0x84U : 0x85U);
+    skip = pos;
+    jit_d(&pos, 0U);
+    jit_pcset(&pos, adv + 1U + arg2);
+    jit_cycle(&pos, cyc + 2U);
+    jit_jmp(&pos, 0x00U, 0xE9U, (tgt == (wadr & 0x7FFFU)) ? start : jdisp);
+    jit_d(&skip, (auint)(pos - (skip + 4))); /* Not taken: continue here */
+    break;
+
+   default:    /* Call into the plain handler */
+    jit_pcset(&pos, adv + 1U);
+    jit_cycle(&pos, cyc);
+    rel += adv + 1U + ((opcode >> 7) & 1U);
+    adv  = 0U;
+    cyc = 0U;
+    jit_b(&pos, 0x48U); jit_b(&pos, 0x89U); jit_b(&pos, 0xDFU); /* mov rdi, rbx */
+    jit_b(&pos, 0xBEU); jit_d(&pos, (opcode >> 8) & 0xFFU); /* mov esi, arg1 */
+    jit_b(&pos, 0xBAU); jit_d(&pos, arg2);                /* mov edx, arg2 */
+    jit_b(&pos, 0x48U); jit_b(&pos, 0xB8U);
+    jit_q(&pos, (uintptr_t)(avr_opcode_table_jit[oper])); /* mov rax, imm64 */
+    jit_b(&pos, 0xFFU); jit_b(&pos, 0xD0U);               /* call rax */
+    if (SREG_LAZY){ jit_sync(&pos); }
+    if ((opcode & 0x80U) != 0U){                         /* 2 word instruction */
+     jit_b(&pos, 0x41U); jit_b(&pos, 0xFFU); jit_b(&pos, 0xC6U); /* inc r14d */
+    }
+    jit_b(&pos, 0x41U); jit_b(&pos, 0x80U);
+    jit_b(&pos, 0x3FU); jit_b(&pos, 0x00U);               /* cmp byte [r15], 0 */
+    jit_jmp(&pos, 0x0FU, 0x85U, jexit1);                  /* jne exit1 */
+    jit_rm(&pos, 0x8BU, 0U, JIT_OFF_CYCLE);               /* mov eax, [rbx + cycle] */
+    jit_b(&pos, 0x41U); jit_b(&pos, 0x3BU); jit_b(&pos, 0x04U); jit_b(&pos, 0x24U); /* cmp eax, [r12] */
+    jit_jmp(&pos, 0x0FU, 0x83U, jexit1);                  /* jae exit1 */
+    jit_b(&pos, 0x44U); jit_rm(&pos, 0x39U, 6U, JIT_OFF_PC); /* cmp [rbx + pc], r14d */
+    jit_jmp(&pos, 0x0FU, 0x85U, jdisp);                   /* jne dispatch */
+    ncyc = 0U;
+    break;
+  }
+
+  if (ncyc != 0U){ /* Natively translated single word instruction */
+   adv ++;
+   cyc += ncyc;
+  }
+ }
+
+ /* Continue with the next block */
+ if (bops[bcnt - 1U] != 0x40U){
+  jit_pcset(&pos, adv);
+  jit_cycle(&pos, cyc);
+  jit_jmp(&pos, 0x00U, 0xE9U, jdisp);                     /* jmp dispatch */
+ }
+
+ ctx->jit_fill = ((auint)(pos - ctx->jit_cache) + 15U) & (~15U);
+ return start;
+}
+
+#endif
+
+
+
+/*
+** Runs emulation until the cycle counter reaches cycle_count_max (at least
+** one instruction is always emulated). While the ALU behaviour modifications
+** are disabled, instructions below the event horizon are emulated by the
+** translated code, or the plain opcode handlers when it can not run.
+*/
+static void cu_avr_exec_run(cu_avr_ctx_t* ctx)
+{
+#ifdef JIT_NATIVE
+ void* blk;
+
+ if (!ctx->jit_inited){ cu_avr_jit_init(ctx); }
+#endif
+
+ do{
+
+  if (ctx->alu_ismod){
+   cu_avr_exec_mod(ctx);
+  }else{
+   cu_avr_exec_step(ctx);
+   cu_avr_horizon(ctx);
+   while (ctx->cpu_state.cycle < ctx->cycle_horizon){
+#ifdef JIT_NATIVE
+    if ( (ctx->jit_cache != NULL) && (!ctx->event_it) && (!ctx->event_it_enter) ){
+     blk = ctx->jit_blocks[ctx->cpu_state.pc & 0x7FFFU];
+     if (blk == NULL){
+      blk = cu_avr_jit_translate(ctx, ctx->cpu_state.pc);
+      ctx->jit_blocks[ctx->cpu_state.pc & 0x7FFFU] = blk;
+     }
+     cu_avr_sreg_sync(ctx); /* Translated code only uses SREG */
+     if (ctx->jit_enter(blk) != 0U){ continue; }
+    }
+#endif
+    cu_avr_jit_step(ctx);
+   }
+   cu_avr_exec_flag(ctx); /* If an instruction enabled modifications */
+  }
+
+ }while (ctx->cpu_state.cycle < ctx->cycle_count_max);
+}
+
+
+
+/*
+** Updates decoder specific data after compiling a range of the Code ROM (by
+** cu_avr_code_fill()). Blocks are only translated from compiled
+** instructions, so there is nothing to do here.
+*/
+static void cu_avr_exec_fill(cu_avr_ctx_t* ctx, auint wbase, auint wlen)
+{
+ (void)(ctx);
+ (void)(wbase);
+ (void)(wlen);
+}
+
+
+
+/*
+** Updates decoder specific data after the recompilation of a range of the
+** Code ROM (by cu_avr_crom_update()). Blocks may span anywhere, so all
+** translations are discarded.
+*/
+static void cu_avr_exec_update(cu_avr_ctx_t* ctx, auint wbase, auint wlen)
+{
+ (void)(wbase);
+ (void)(wlen);
+#ifdef JIT_NATIVE
+ if (ctx->jit_cache != NULL){ cu_avr_jit_flush(ctx); }
+#else
+ (void)(ctx);
+#endif
+}
+
+
+
+/*
+** Releases decoder specific resources of an instance (by cu_avr_free()).
+*/
+static void cu_avr_exec_free(cu_avr_ctx_t* ctx)
+{
+#ifdef JIT_NATIVE
+ if (ctx->jit_cache != NULL){ munmap(ctx->jit_cache, JIT_CACHE_SIZE); }
+#else
+ (void)(ctx);
+#endif
+}
@@ -0,0 +1,169 @@
+/*
+ *  AVR microcontroller emulation, modified opcode decoder
+ *
+ *  Copyright (C) 2016 - 2017
+ *    Sandor Zsuga (Jubatian)
+ *  Uzem (the base of CUzeBox) is copyright (C)
+ *    David Etherton,
+ *    Eric Anderton,
+ *    Alec Bourque (Uze),
+ *    Filipe Rinaldi,
+ *    Sandor Zsuga (Jubatian),
+ *    Matt Pandina (Artcfox)
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef CU_AVR_C
+#error "This file is part of cu_avr.c!"
+#endif
+
+
+
+
+
+
+/*
+** Instruction decoder used while the ALU behaviour modifications are
+** enabled. It processes instructions one by one with the modifying opcode
+** handlers (opm_XX), performing the instruction related modifications
+** around them. It is shared by both the jump table and the direct threaded
+** decoders, which use it between the "ijmp" enabling the modifications and
+** the write into 0xF0 disabling them. Without the modifications it is also
+** used to step instructions when a hardware event or the end of emulation
+** is near (above the event horizon).
+**
+** Superinstructions are executed by their first instruction only, so the
+** modifications apply on every word.
+*/
+
+
+
+typedef void(avr_opcode)(cu_avr_ctx_t* ctx, auint arg1, auint arg2);
+
+
+
+static avr_opcode* const avr_opcode_table_mod[128U] = {
+ &opm_00, &opm_01, &opm_02, &opm_03, &opm_04, &opm_05, &opm_06, &opm_07,
+ &opm_08, &opm_09, &opm_0A, &opm_0B, &opm_0C, &opm_0D, &opm_0E, &opm_0F,
+ &opm_10, &opm_11, &opm_12, &opm_13, &opm_14, &opm_15, &opm_16, &opm_17,
+ &opm_18, &opm_19, &opm_1A, &opm_1B, &opm_1C, &opm_1D, &opm_1E, &opm_1F,
+ &opm_20, &opm_21, &opm_22, &opm_23, &opm_24, &opm_25, &opm_26, &opm_27,
+ &opm_28, &opm_29, &opm_2A, &opm_2B, &opm_2C, &opm_2D, &opm_2E, &opm_2F,
+ &opm_30, &opm_31, &opm_32, &opm_33, &opm_34, &opm_35, &opm_36, &opm_37,
+ &opm_38, &opm_39, &opm_3A, &opm_3B, &opm_3C, &opm_3D, &opm_3E, &opm_3F,
+ &opm_40, &opm_41, &opm_42, &opm_43, &opm_44, &opm_45, &opm_46, &opm_47,
+ &opm_48, &opm_49, &opm_4A, &opm_0B, &opm_12, &opm_07, &opm_0B, &opm_0B,
+ &opm_12, &opm_12, &opm_2B, &opm_48, &opm_01, &opm_14, &opm_09, &opm_0C,
+ &opm_4A, &opm_4A, &opm_4A, &opm_4A, &opm_4A, &opm_4A, &opm_4A, &opm_4A,
+ &opm_60, &opm_4A, &opm_4A, &opm_4A, &opm_4A, &opm_4A, &opm_4A, &opm_4A,
+ &opm_4A, &opm_4A, &opm_4A, &opm_4A, &opm_4A, &opm_4A, &opm_4A, &opm_4A,
+ &opm_4A, &opm_4A, &opm_4A, &opm_4A, &opm_4A, &opm_4A, &opm_4A, &opm_4A,
+ &opm_4A, &opm_4A, &opm_4A, &opm_4A, &opm_4A, &opm_4A, &opm_4A, &opm_4A
+};
+
+
+
+/*
+** Performs the flag behaviour anomalies feature for the instruction which
+** was just executed. This is also necessary after the instruction enabling
+** the modifications.
+*/
+static void cu_avr_exec_flag(cu_avr_ctx_t* ctx)
+{
+ if (ctx->alu_ismod){
+  if ((ctx->cpu_fdsc[(ctx->cpu_state.pc - 1U) & 0x7FFFU] & FDSC_FLAG) != 0U){
+   cu_avr_sreg_sync(ctx); /* The enabling instruction may have left some */
+   ctx->cpu_state.iors[CU_IO_SREG] |= ctx->flag_or;
+   ctx->cpu_state.iors[CU_IO_SREG] &= ctx->flag_and;
+  }
+ }
+}
+
+
+
+/*
+** Emulates a single (compiled) AVR instruction and any associated hardware
+** tasks with the ALU behaviour modifications enabled.
+*/
+static void cu_avr_exec_mod(cu_avr_ctx_t* ctx)
+{
+ auint pc     = ctx->cpu_state.pc;
+ auint opcode = cu_avr_code_get(ctx, ctx->cpu_state.pc);
+ auint arg1   = (opcode >>  8) & 0xFFU;
+ auint arg2   = (opcode >> 16) & 0xFFFFU;
+ auint fdsc   = ctx->cpu_fdsc[ctx->cpu_state.pc & 0x7FFFU];
+
+ /* Instruction skip feature */
+
+ if ((fdsc & FDSC_SKIP) != 0U){
+  ctx->cpu_state.pc ++;
+  opm_00(ctx, arg1, arg2); /* NOP */
+  if (ctx->cpu_state.cycle >= ctx->prof_next){ cu_avr_prof_sample(ctx, pc); }
+  if (ctx->hang_on){ cu_avr_hang_step(ctx, pc); }
+  return;
+ }
+
+ /* Condition disable feature */
+
+ ctx->cond_jmp = ((fdsc & FDSC_COND) != 0U);
+
+ /* GDB stuff should be added here later */
+
+ ctx->cpu_state.pc ++;
+
+ /*
+ ** Instruction decoder notes:
+ **
+ ** The instruction's timing is determined by how many UPDATE_HARDWARE (macro)
+ ** calls are executed during its decoding.
+ **
+ ** Stack accesses are only performed on the SRAM (probably on real AVR it is
+ ** undefined to place the stack onto the I/O area, such is not emulated).
+ */
+
+ avr_opcode_table_mod[opcode & 0x7FU](ctx, arg1, arg2);
+
+ /* Flag behaviour anomalies feature (the instruction may have disabled the
+ ** modifications) */
+
+ cu_avr_exec_flag(ctx);
+
+ if (ctx->cpu_state.cycle >= ctx->prof_next){ cu_avr_prof_sample(ctx, pc); }
+ if (ctx->hang_on){ cu_avr_hang_step(ctx, pc); }
+}
+
+
+
+/*
+** Emulates a single (compiled) AVR instruction and any associated hardware
+** tasks with the ALU behaviour modifications disabled, processing hardware
+** events cycle by cycle.
+*/
+static void cu_avr_exec_step(cu_avr_ctx_t* ctx)
+{
+ auint pc     = ctx->cpu_state.pc;
+ auint opcode = cu_avr_code_get(ctx, ctx->cpu_state.pc);
+ auint arg1   = (opcode >>  8) & 0xFFU;
+ auint arg2   = (opcode >> 16) & 0xFFFFU;
+
+ ctx->cpu_state.pc ++;
+
+ avr_opcode_table_mod[opcode & 0x7FU](ctx, arg1, arg2);
+
+ if (ctx->cpu_state.cycle >= ctx->prof_next){ cu_avr_prof_sample(ctx, pc); }
+ if (ctx->hang_on){ cu_avr_hang_step(ctx, pc); }
+}
@@ -0,0 +1,1329 @@
+/*
+ *  AVR microcontroller emulation, opcode handlers
+ *
+ *  Copyright (C) 2016 - 2017
+ *    Sandor Zsuga (Jubatian)
+ *  Uzem (the base of CUzeBox) is copyright (C)
+ *    David Etherton,
+ *    Eric Anderton,
+ *    Alec Bourque (Uze),
+ *    Filipe Rinaldi,
+ *    Sandor Zsuga (Jubatian),
+ *    Matt Pandina (Artcfox)
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef CU_AVR_C
+#error "This file is part of cu_avr.c!"
+#endif
+
+
+
+/*
+** The opcode handlers, one for each operation of the compiled instruction
+** set (see cu_avrc.h). These are shared by the instruction decoders, which
+** are responsible for fetching the compiled opcode, incrementing the PC and
+** performing the instruction related ALU behaviour modifications.
+**
+** This file is included twice to produce two sets of handlers from the same
+** source. Without CU_AVR_O_MOD the handlers (op_XX) have the ALU behaviour
+** modifications and hardware event checks compiled out, these are used
+** while the modifications are disabled, below the event horizon. These may
+** also evaluate the flags of the add and subtract operations lazily (see
+** cu_avr_sreg_sync()). With CU_AVR_O_MOD defined, the handlers
+** (opm_XX) perform the modifications, processing hardware events cycle by
+** cycle, and always produce SREG immediately (for the flag anomalies).
+*/
+
+
+
+#ifdef CU_AVR_O_MOD
+#define OP_FN(name)  opm_##name
+#define OP_ISMOD     ctx->alu_ismod
+#define OP_CONDJMP   ctx->cond_jmp
+#define OP_UPDATE    UPDATE_HARDWARE
+#define OP_UPDATE_IT UPDATE_HARDWARE_IT
+#define OP_LAZYFLG   FALSE
+#else
+#define OP_FN(name)  op_##name
+#define OP_ISMOD     FALSE
+#define OP_CONDJMP   FALSE
+#define OP_UPDATE    UPDATE_CYCLE
+#define OP_UPDATE_IT UPDATE_CYCLE_IT
+#define OP_LAZYFLG   SREG_LAZY
+#endif
+
+/* The direct threaded decoder needs the plain handlers inlined into its
+** labels (superinstructions reuse some, which would prevent it otherwise) */
+#if (defined(CU_AVR_THREADED) && !defined(CU_AVR_O_MOD))
+#define OP_INL       __inline__ __attribute__((always_inline))
+#else
+#define OP_INL
+#endif
+
+
+
+/* Reading IO registers modified with stuck bits */
+static auint OP_FN(io_read_mod)(cu_avr_ctx_t* ctx, auint reg)
+{
+ auint ret = ctx->cpu_state.iors[reg];
+ if (OP_ISMOD){
+  if (STUCK_HAS(ctx->stuck_map_io, reg)){
+   ret = cu_avr_stuck_get(ctx, STUCK_IO + reg, ret);
+  }
+ }
+ return ret;
+}
+
+
+/* Reading SREG modified with stuck bits, materializing any lazily
+** evaluated flags (use before writing SREG) */
+static auint OP_FN(sreg_read)(cu_avr_ctx_t* ctx)
+{
+ cu_avr_sreg_sync(ctx);
+ return OP_FN(io_read_mod)(ctx, CU_IO_SREG);
+}
+
+
+/* Reading SREG modified with stuck bits, only evaluating any lazily
+** evaluated flags for the returned value */
+static auint OP_FN(sreg_peek)(cu_avr_ctx_t* ctx)
+{
+ auint ret = ctx->cpu_state.iors[CU_IO_SREG];
+ if (SREG_LAZY && (ctx->sreg_keep != 0U)){
+  ret = (ret & ctx->sreg_keep) | CU_AVRFG_FVAL(ctx->sreg_fidx);
+ }
+ if (OP_ISMOD){
+  if (STUCK_HAS(ctx->stuck_map_io, CU_IO_SREG)){
+   ret = cu_avr_stuck_get(ctx, STUCK_IO + CU_IO_SREG, ret);
+  }
+ }
+ return ret;
+}
+
+
+/* Reading memory modified with stuck bits */
+static auint OP_FN(mem_read_mod)(cu_avr_ctx_t* ctx, auint off)
+{
+ auint ret = ctx->cpu_state.sram[off];
+ if (OP_ISMOD){
+  if (STUCK_HAS(ctx->stuck_map_mem, off)){
+   ret = cu_avr_stuck_get(ctx, STUCK_MEM + off, ret);
+  }
+ }
+ return ret;
+}
+
+
+/* Reading ROM modified with stuck bits */
+static auint OP_FN(rom_read_mod)(cu_avr_ctx_t* ctx, auint off)
+{
+ auint ret = ctx->cpu_state.crom[off];
+ if (OP_ISMOD){
+  if (STUCK_HAS(ctx->stuck_map_rom, off)){
+   ret = cu_avr_stuck_get(ctx, STUCK_ROM + off, ret);
+  }
+ }
+ return ret;
+}
+
+
+/* Prepare Source and Destination for an inc/dec anomaly */
+static void OP_FN(idc_prep)(cu_avr_ctx_t* ctx, auint *dst, auint *src)
+{
+ if ( ((*dst) == ctx->idc_val) &&
+      ((*src) == 1U) ){ *src = 0U; }
+}
+
+
+
+/* The cycle and common tails are only defined on the first inclusion */
+
+#ifndef CU_AVR_O_TAILS
+#define CU_AVR_O_TAILS
+
+
+
+/* Trailing cycles */
+
+#define cy0_tail() \
+ do{ \
+  if (ctx->event_it_enter){ cu_avr_interrupt(ctx); } \
+ }while(0)
+
+#define cy1_tail() \
+ do{ \
+  OP_UPDATE_IT; \
+  cy0_tail(); \
+ }while(0)
+
+#define cy2_tail() \
+ do{ \
+  OP_UPDATE; \
+  cy1_tail(); \
+ }while(0)
+
+#define cy3_tail() \
+ do{ \
+  OP_UPDATE; \
+  cy2_tail(); \
+ }while(0)
+
+#define cy4_tail() \
+ do{ \
+  OP_UPDATE; \
+  cy3_tail(); \
+ }while(0)
+
+
+
+/* Setting flags from a flag code (of the flag engine, see cu_avrfg.h)
+** keeping the given bits of SREG. The plain handlers only record the code if
+** it replaces all the arithmetic flags, so no earlier lazily evaluated flags
+** are lost. */
+
+#define flg_tail(keep, fidx) \
+ do{ \
+  if (OP_LAZYFLG && ((keep) == (SREG_IM | SREG_TM))){ \
+   ctx->sreg_keep = (keep); \
+   ctx->sreg_fidx = (fidx); \
+  }else{ \
+   ctx->cpu_state.iors[CU_IO_SREG] = (OP_FN(sreg_read)(ctx) & (keep)) | CU_AVRFG_FVAL(fidx); \
+  } \
+ }while(0)
+
+
+
+/* Opcode common tails */
+
+#define mul_tail_fmul() \
+ do{ \
+  ctx->cpu_state.iors[0x00U] = (res     ) & 0xFFU; \
+  ctx->cpu_state.iors[0x01U] = (res >> 8) & 0xFFU; \
+  ctx->cpu_state.iors[CU_IO_SREG] = flags; \
+  cy2_tail(); \
+ }while(0)
+
+#define mul_tail() \
+ do{ \
+  auint res   = dst * src; \
+  auint flags = OP_FN(sreg_read)(ctx); \
+  PROCFLAGS_MUL(flags, res); \
+  mul_tail_fmul(); \
+ }while(0)
+
+#define fmul_tail() \
+ do{ \
+  auint res   = (dst * src) << 1; \
+  auint flags = OP_FN(sreg_read)(ctx); \
+  PROCFLAGS_FMUL(flags, res); \
+  mul_tail_fmul(); \
+ }while(0)
+
+#define add_tail() \
+ do{ \
+  ctx->cpu_state.iors[arg1] = res; \
+  flg_tail(SREG_IM | SREG_TM, \
+           CU_AVRFG_FADD(dst, src, res)); \
+  cy1_tail(); \
+ }while(0)
+
+#define sub_tail_flg() \
+ do{ \
+  flg_tail(SREG_IM | SREG_TM, \
+           CU_AVRFG_FSUB(dst, src, res)); \
+  cy1_tail(); \
+ }while(0)
+
+#define sub_tail() \
+ do{ \
+  auint res   = dst - src; \
+  ctx->cpu_state.iors[arg1] = res; \
+  sub_tail_flg(); \
+ }while(0)
+
+#define sbc_tail_flg() \
+ do{ \
+  ctx->cpu_state.iors[CU_IO_SREG] = (OP_FN(sreg_read)(ctx) | (SREG_HM | SREG_SM | SREG_VM | SREG_NM | SREG_CM)) & \
+                                    ( CU_AVRFG_FVAL(CU_AVRFG_FSUB(dst, src, res)) | \
+                                      (SREG_IM | SREG_TM) ); \
+  cy1_tail(); \
+ }while(0)
+
+#define sbc_tail() \
+ do{ \
+  auint res   = dst - (src + SREG_GET_C(OP_FN(sreg_read)(ctx))); \
+  ctx->cpu_state.iors[arg1] = res; \
+  sbc_tail_flg(); \
+ }while(0)
+
+#define log_tail() \
+ do{ \
+  ctx->cpu_state.iors[arg1] = res; \
+  flg_tail(SREG_IM | SREG_TM | SREG_HM | SREG_CM, CU_AVRFG_FLOG(res)); \
+  cy1_tail(); \
+ }while(0)
+
+#define stk_tail() \
+ do{ \
+  ctx->cpu_state.iors[CU_IO_SPL] = (tmp     ) & 0xFFU; \
+  ctx->cpu_state.iors[CU_IO_SPH] = (tmp >> 8) & 0xFFU; \
+  cy2_tail(); \
+ }while(0)
+
+#define st_tail() \
+ do{ \
+  OP_UPDATE; \
+  OP_UPDATE_IT; \
+  if (tmp >= 0x0100U){ \
+   ctx->cpu_state.sram[tmp & 0x0FFFU] = OP_FN(io_read_mod)(ctx, arg1); \
+   MEM_WRITE(tmp & 0x0FFFU); \
+  }else{ \
+   cu_avr_write_io(ctx, tmp, OP_FN(io_read_mod)(ctx, arg1)); \
+  } \
+  cy0_tail(); \
+ }while(0)
+
+#define ld_tail() \
+ do{ \
+  OP_UPDATE; \
+  if (tmp >= 0x0100U){ \
+   ctx->cpu_state.iors[arg1] = OP_FN(mem_read_mod)(ctx, tmp & 0x0FFFU); \
+   MEM_ACCESS(tmp & 0x0FFFU, CU_MEM_R); \
+  }else{ \
+   ctx->cpu_state.iors[arg1] = cu_avr_read_io(ctx, tmp); \
+  } \
+  cy1_tail(); \
+ }while(0)
+
+#define shr_tail() \
+ do{ \
+  res  |= (src >> 1); \
+  ctx->cpu_state.iors[arg1] = res; \
+  flg_tail(SREG_IM | SREG_TM | SREG_HM, CU_AVRFG_FSHR(src, res)); \
+  cy1_tail(); \
+ }while(0)
+
+#define ret_tail() \
+ do{ \
+  auint tmp   = ((auint)(OP_FN(io_read_mod)(ctx, CU_IO_SPL))     ) + \
+                ((auint)(OP_FN(io_read_mod)(ctx, CU_IO_SPH)) << 8); \
+  tmp ++; \
+  ctx->cpu_state.pc  = (auint)(OP_FN(mem_read_mod)(ctx, tmp & 0x0FFFU)) << 8; \
+  MEM_ACCESS(tmp & 0x0FFFU, CU_MEM_R); \
+  tmp ++; \
+  ctx->cpu_state.pc |= (auint)(OP_FN(mem_read_mod)(ctx, tmp & 0x0FFFU)); \
+  MEM_ACCESS(tmp & 0x0FFFU, CU_MEM_R); \
+  ctx->cpu_state.iors[CU_IO_SPL] = (tmp     ) & 0xFFU; \
+  ctx->cpu_state.iors[CU_IO_SPH] = (tmp >> 8) & 0xFFU; \
+  cy4_tail(); \
+ }while(0)
+
+#define adiw_tail() \
+ do{ \
+  ctx->cpu_state.iors[arg1 + 0U] = (res     ) & 0xFFU; \
+  ctx->cpu_state.iors[arg1 + 1U] = (res >> 8) & 0xFFU; \
+  SREG_SET(flags, SREG_NM & ((          res ) >> (15U - SREG_N))); \
+  SREG_SET_C_BIT16(flags, res); \
+  SREG_SET_Z(flags, res & 0xFFFFU); \
+  SREG_COM_NV(flags); \
+  ctx->cpu_state.iors[CU_IO_SREG] = flags; \
+  cy2_tail(); \
+ }while(0)
+
+#define out_tail() \
+ do{ \
+  OP_UPDATE_IT; \
+  cu_avr_write_io(ctx, arg1, tmp); \
+  cy0_tail(); \
+ }while(0)
+
+#define oub_tail() \
+ do{ \
+  OP_UPDATE; \
+  out_tail(); \
+ }while(0)
+
+#define call_tail() \
+ do{ \
+  auint tmp   = ((auint)(OP_FN(io_read_mod)(ctx, CU_IO_SPL))     ) + \
+                ((auint)(OP_FN(io_read_mod)(ctx, CU_IO_SPH)) << 8); \
+  ctx->cpu_state.sram[tmp & 0x0FFFU] = (ctx->cpu_state.pc     ) & 0xFFU; \
+  MEM_WRITE(tmp & 0x0FFFU); \
+  tmp --; \
+  ctx->cpu_state.sram[tmp & 0x0FFFU] = (ctx->cpu_state.pc >> 8) & 0xFFU; \
+  MEM_WRITE(tmp & 0x0FFFU); \
+  tmp --; \
+  ctx->cpu_state.iors[CU_IO_SPL] = (tmp     ) & 0xFFU; \
+  ctx->cpu_state.iors[CU_IO_SPH] = (tmp >> 8) & 0xFFU; \
+  ctx->cpu_state.pc = res; \
+  cy3_tail(); \
+ }while(0)
+
+#define skip_tail() \
+ do{ \
+  if (((cu_avr_code_get(ctx, ctx->cpu_state.pc) >> 7) & 1U) != 0U){ \
+   ctx->cpu_state.pc += 2U; \
+   cy3_tail(); \
+  }else{ \
+   ctx->cpu_state.pc ++; \
+   cy2_tail(); \
+  } \
+ }while(0)
+
+
+
+/* Opcodes */
+
+
+
+#endif
+
+
+
+static OP_INL void OP_FN(00)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* NOP */
+{
+ cy1_tail();
+}
+
+static OP_INL void OP_FN(01)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* MOVW */
+{
+ ctx->cpu_state.iors[arg1 + 0U] = OP_FN(io_read_mod)(ctx, arg2 + 0U);
+ ctx->cpu_state.iors[arg1 + 1U] = OP_FN(io_read_mod)(ctx, arg2 + 1U);
+ cy1_tail();
+}
+
+static OP_INL void OP_FN(02)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* MULS */
+{
+ auint dst   = OP_FN(io_read_mod)(ctx, arg1);
+ auint src   = OP_FN(io_read_mod)(ctx, arg2);
+ dst  -= (dst & 0x80U) << 1; /* Sign extend from 8 bits */
+ src  -= (src & 0x80U) << 1; /* Sign extend from 8 bits */
+ mul_tail();
+}
+
+static OP_INL void OP_FN(03)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* MULSU */
+{
+ auint dst   = OP_FN(io_read_mod)(ctx, arg1);
+ auint src   = OP_FN(io_read_mod)(ctx, arg2);
+ dst  -= (dst & 0x80U) << 1; /* Sign extend from 8 bits */
+ mul_tail();
+}
+
+static OP_INL void OP_FN(04)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* FMUL */
+{
+ auint dst   = OP_FN(io_read_mod)(ctx, arg1);
+ auint src   = OP_FN(io_read_mod)(ctx, arg2);
+ fmul_tail();
+}
+
+static OP_INL void OP_FN(05)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* FMULS */
+{
+ auint dst   = OP_FN(io_read_mod)(ctx, arg1);
+ auint src   = OP_FN(io_read_mod)(ctx, arg2);
+ dst  -= (dst & 0x80U) << 1; /* Sign extend from 8 bits */
+ src  -= (src & 0x80U) << 1; /* Sign extend from 8 bits */
+ fmul_tail();
+}
+
+static OP_INL void OP_FN(06)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* FMULSU */
+{
+ auint dst   = OP_FN(io_read_mod)(ctx, arg1);
+ auint src   = OP_FN(io_read_mod)(ctx, arg2);
+ dst  -= (dst & 0x80U) << 1; /* Sign extend from 8 bits */
+ fmul_tail();
+}
+
+static OP_INL void OP_FN(07)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* CPC */
+{
+ auint src   = OP_FN(io_read_mod)(ctx, arg2);
+ auint dst   = OP_FN(io_read_mod)(ctx, arg1);
+ auint res;
+ if (OP_ISMOD && (ctx->idc_opc == 0x07U)){ OP_FN(idc_prep)(ctx, &dst, &src); }
+ res   = dst - (src + SREG_GET_C(OP_FN(sreg_peek)(ctx)));
+ sbc_tail_flg();
+}
+
+static OP_INL void OP_FN(08)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* SBC */
+{
+ auint src   = OP_FN(io_read_mod)(ctx, arg2);
+ auint dst   = OP_FN(io_read_mod)(ctx, arg1);
+ if (OP_ISMOD && (ctx->idc_opc == 0x08U)){ OP_FN(idc_prep)(ctx, &dst, &src); }
+ sbc_tail();
+}
+
+static OP_INL void OP_FN(09)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* ADD */
+{
+ auint src   = OP_FN(io_read_mod)(ctx, arg2);
+ auint dst   = OP_FN(io_read_mod)(ctx, arg1);
+ auint res;
+ if (OP_ISMOD && (ctx->idc_opc == 0x09U)){ OP_FN(idc_prep)(ctx, &dst, &src); }
+ res   = dst + src;
+ add_tail();
+}
+
+static OP_INL void OP_FN(0A)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* CPSE */
+{
+ if ((OP_FN(io_read_mod)(ctx, arg1) != OP_FN(io_read_mod)(ctx, arg2)) && (!OP_CONDJMP)){
+  cy1_tail();
+ }else{
+  skip_tail();
+ }
+}
+
+static OP_INL void OP_FN(0B)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* CP */
+{
+ auint src   = OP_FN(io_read_mod)(ctx, arg2);
+ auint dst   = OP_FN(io_read_mod)(ctx, arg1);
+ auint res;
+ if (OP_ISMOD && (ctx->idc_opc == 0x0BU)){ OP_FN(idc_prep)(ctx, &dst, &src); }
+ res   = dst - src;
+ sub_tail_flg();
+}
+
+static OP_INL void OP_FN(0C)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* SUB */
+{
+ auint dst   = OP_FN(io_read_mod)(ctx, arg1);
+ auint src   = OP_FN(io_read_mod)(ctx, arg2);
+ if (OP_ISMOD && (ctx->idc_opc == 0x0CU)){ OP_FN(idc_prep)(ctx, &dst, &src); }
+ sub_tail();
+}
+
+static OP_INL void OP_FN(0D)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* ADC */
+{
+ auint src   = OP_FN(io_read_mod)(ctx, arg2);
+ auint dst   = OP_FN(io_read_mod)(ctx, arg1);
+ auint res;
+ if (OP_ISMOD && (ctx->idc_opc == 0x0DU)){ OP_FN(idc_prep)(ctx, &dst, &src); }
+ res   = dst + (src + SREG_GET_C(OP_FN(sreg_peek)(ctx)));
+ add_tail();
+}
+
+static OP_INL void OP_FN(0E)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* AND */
+{
+ auint res   = OP_FN(io_read_mod)(ctx, arg1) & OP_FN(io_read_mod)(ctx, arg2);
+ log_tail();
+}
+
+static OP_INL void OP_FN(0F)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* EOR */
+{
+ auint res   = OP_FN(io_read_mod)(ctx, arg1) ^ OP_FN(io_read_mod)(ctx, arg2);
+ log_tail();
+}
+
+static OP_INL void OP_FN(10)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* OR */
+{
+ auint res   = OP_FN(io_read_mod)(ctx, arg1) | OP_FN(io_read_mod)(ctx, arg2);
+ log_tail();
+}
+
+static OP_INL void OP_FN(11)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* MOV */
+{
+ ctx->cpu_state.iors[arg1] = OP_FN(io_read_mod)(ctx, arg2);
+ cy1_tail();
+}
+
+static OP_INL void OP_FN(12)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* CPI */
+{
+ auint src   = arg2;
+ auint dst   = ctx->cpu_state.iors[arg1];
+ auint res;
+ if (OP_ISMOD && (ctx->idc_opc == 0x12U)){ OP_FN(idc_prep)(ctx, &dst, &src); }
+ res   = dst - src;
+ sub_tail_flg();
+}
+
+static OP_INL void OP_FN(13)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* SBCI */
+{
+ auint src   = arg2;
+ auint dst   = OP_FN(io_read_mod)(ctx, arg1);
+ if (OP_ISMOD && (ctx->idc_opc == 0x13U)){ OP_FN(idc_prep)(ctx, &dst, &src); }
+ sbc_tail();
+}
+
+static OP_INL void OP_FN(14)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* SUBI */
+{
+ auint src   = arg2;
+ auint dst   = OP_FN(io_read_mod)(ctx, arg1);
+ if (OP_ISMOD && (ctx->idc_opc == 0x14U)){ OP_FN(idc_prep)(ctx, &dst, &src); }
+ sub_tail();
+}
+
+static OP_INL void OP_FN(15)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* ORI */
+{
+ auint res   = OP_FN(io_read_mod)(ctx, arg1) | arg2;
+ log_tail();
+}
+
+static OP_INL void OP_FN(16)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* ANDI */
+{
+ auint res   = OP_FN(io_read_mod)(ctx, arg1) & arg2;
+ log_tail();
+}
+
+static OP_INL void OP_FN(17)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* SPM */
+{
+ cy4_tail();
+}
+
+static OP_INL void OP_FN(18)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* LPM */
+{
+ auint tmp = ((auint)(OP_FN(io_read_mod)(ctx, 30))     ) +
+             ((auint)(OP_FN(io_read_mod)(ctx, 31)) << 8);
+ auint res = OP_FN(rom_read_mod)(ctx, tmp);
+ ctx->cpu_state.iors[arg1] = res;
+ cy3_tail();
+}
+
+static OP_INL void OP_FN(19)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* LPM (+) */
+{
+ auint tmp = ((auint)(OP_FN(io_read_mod)(ctx, 30))     ) +
+             ((auint)(OP_FN(io_read_mod)(ctx, 31)) << 8);
+ auint res = OP_FN(rom_read_mod)(ctx, tmp);
+ auint one = 1U;
+ if (OP_ISMOD && (ctx->idc_opc == 0x19U)){ OP_FN(idc_prep)(ctx, &tmp, &one); }
+ tmp += one;
+ ctx->cpu_state.iors[30] = (tmp     ) & 0xFFU;
+ ctx->cpu_state.iors[31] = (tmp >> 8) & 0xFFU;
+ ctx->cpu_state.iors[arg1] = res;
+ cy3_tail();
+}
+
+static OP_INL void OP_FN(1A)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* PUSH */
+{
+ auint tmp = ((auint)(OP_FN(io_read_mod)(ctx, CU_IO_SPL))     ) +
+             ((auint)(OP_FN(io_read_mod)(ctx, CU_IO_SPH)) << 8);
+ auint one = 1U;
+ ctx->cpu_state.sram[tmp & 0x0FFFU] = ctx->cpu_state.iors[arg1];
+ MEM_WRITE(tmp & 0x0FFFU);
+ if (OP_ISMOD && (ctx->idc_opc == 0x1AU)){ OP_FN(idc_prep)(ctx, &tmp, &one); }
+ tmp -= one;
+ stk_tail();
+}
+
+static OP_INL void OP_FN(1B)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* POP */
+{
+ auint tmp = ((auint)(OP_FN(io_read_mod)(ctx, CU_IO_SPL))     ) +
+             ((auint)(OP_FN(io_read_mod)(ctx, CU_IO_SPH)) << 8);
+ auint one = 1U;
+ if (OP_ISMOD && (ctx->idc_opc == 0x1BU)){ OP_FN(idc_prep)(ctx, &tmp, &one); }
+ tmp += one;
+ ctx->cpu_state.iors[arg1] = OP_FN(mem_read_mod)(ctx, tmp & 0x0FFFU);
+ MEM_ACCESS(tmp & 0x0FFFU, CU_MEM_R);
+ stk_tail();
+}
+
+static OP_INL void OP_FN(1C)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* STS */
+{
+ auint tmp = arg2;
+ ctx->cpu_state.pc ++;
+ st_tail();
+}
+
+static OP_INL void OP_FN(1D)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* ST */
+{
+ auint tmp = ( ((auint)(OP_FN(io_read_mod)(ctx, (arg2 & 0xFFU) + 0U))     ) +
+               ((auint)(OP_FN(io_read_mod)(ctx, (arg2 & 0xFFU) + 1U)) << 8) +
+               (arg2 >> 8) ) & 0xFFFFU; /* Mask: Just in case someone is tricky accessing IO */
+ st_tail();
+}
+
+static OP_INL void OP_FN(1E)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* ST (-) */
+{
+ auint tmp = ((auint)(OP_FN(io_read_mod)(ctx, arg2 + 0U))     ) +
+             ((auint)(OP_FN(io_read_mod)(ctx, arg2 + 1U)) << 8);
+ auint one = 1U;
+ if (OP_ISMOD && (ctx->idc_opc == 0x1EU)){ OP_FN(idc_prep)(ctx, &tmp, &one); }
+ tmp -= one;
+ ctx->cpu_state.iors[arg2 + 0U] = (tmp     ) & 0xFFU;
+ ctx->cpu_state.iors[arg2 + 1U] = (tmp >> 8) & 0xFFU;
+ st_tail();
+}
+
+static OP_INL void OP_FN(1F)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* ST (+) */
+{
+ auint tmp = ((auint)(OP_FN(io_read_mod)(ctx, arg2 + 0U))     ) +
+             ((auint)(OP_FN(io_read_mod)(ctx, arg2 + 1U)) << 8);
+ auint one = 1U;
+ if (OP_ISMOD && (ctx->idc_opc == 0x1FU)){ OP_FN(idc_prep)(ctx, &tmp, &one); }
+ tmp += one;
+ ctx->cpu_state.iors[arg2 + 0U] = (tmp     ) & 0xFFU;
+ ctx->cpu_state.iors[arg2 + 1U] = (tmp >> 8) & 0xFFU;
+ tmp -= one;
+ st_tail();
+}
+
+static OP_INL void OP_FN(20)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* LDS */
+{
+ auint tmp = arg2;
+ ctx->cpu_state.pc ++;
+ ld_tail();
+}
+
+static OP_INL void OP_FN(21)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* LD */
+{
+ auint tmp = ( ((auint)(OP_FN(io_read_mod)(ctx, (arg2 & 0xFFU) + 0U))     ) +
+               ((auint)(OP_FN(io_read_mod)(ctx, (arg2 & 0xFFU) + 1U)) << 8) +
+               (arg2 >> 8) ) & 0xFFFFU; /* Mask: Just in case someone is tricky accessing IO */
+ ld_tail();
+}
+
+static OP_INL void OP_FN(22)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* LD (-) */
+{
+ auint tmp = ((auint)(OP_FN(io_read_mod)(ctx, arg2 + 0U))     ) +
+             ((auint)(OP_FN(io_read_mod)(ctx, arg2 + 1U)) << 8);
+ auint one = 1U;
+ if (OP_ISMOD && (ctx->idc_opc == 0x22U)){ OP_FN(idc_prep)(ctx, &tmp, &one); }
+ tmp -= one;
+ ctx->cpu_state.iors[arg2 + 0U] = (tmp     ) & 0xFFU;
+ ctx->cpu_state.iors[arg2 + 1U] = (tmp >> 8) & 0xFFU;
+ ld_tail();
+}
+
+static OP_INL void OP_FN(23)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* LD (+) */
+{
+ auint tmp = ((auint)(OP_FN(io_read_mod)(ctx, arg2 + 0U))     ) +
+             ((auint)(OP_FN(io_read_mod)(ctx, arg2 + 1U)) << 8);
+ auint one = 1U;
+ if (OP_ISMOD && (ctx->idc_opc == 0x23U)){ OP_FN(idc_prep)(ctx, &tmp, &one); }
+ tmp += one;
+ ctx->cpu_state.iors[arg2 + 0U] = (tmp     ) & 0xFFU;
+ ctx->cpu_state.iors[arg2 + 1U] = (tmp >> 8) & 0xFFU;
+ tmp -= one;
+ ld_tail();
+}
+
+static OP_INL void OP_FN(24)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* COM */
+{
+ auint res   = OP_FN(io_read_mod)(ctx, arg1) ^ 0xFFU;
+ ctx->cpu_state.iors[arg1] = res;
+ ctx->cpu_state.iors[CU_IO_SREG] = (OP_FN(sreg_read)(ctx) & (SREG_IM | SREG_TM | SREG_HM)) |
+                                   (CU_AVRFG_FVAL(CU_AVRFG_FLOG(res)) | SREG_CM);
+ cy1_tail();
+}
+
+static OP_INL void OP_FN(25)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* NEG */
+{
+ auint src   = OP_FN(io_read_mod)(ctx, arg1);
+ auint dst   = 0x00U;
+ if (OP_ISMOD && (ctx->idc_opc == 0x25U)){ OP_FN(idc_prep)(ctx, &dst, &src); }
+ sub_tail();
+}
+
+static OP_INL void OP_FN(26)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* SWAP */
+{
+ auint res   = OP_FN(io_read_mod)(ctx, arg1);
+ ctx->cpu_state.iors[arg1] = (res >> 4) | (res << 4);
+ cy1_tail();
+}
+
+static OP_INL void OP_FN(27)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* INC */
+{
+ auint res   = OP_FN(io_read_mod)(ctx, arg1);
+ auint one   = 1U;
+ if (OP_ISMOD && (ctx->idc_opc == 0x27U)){ OP_FN(idc_prep)(ctx, &res, &one); }
+ res += one;
+ ctx->cpu_state.iors[arg1] = res;
+ flg_tail(SREG_IM | SREG_TM | SREG_HM | SREG_CM, CU_AVRFG_FINC(res));
+ cy1_tail();
+}
+
+static OP_INL void OP_FN(28)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* ASR */
+{
+ auint src   = OP_FN(io_read_mod)(ctx, arg1);
+ auint res   = (src & 0x80U);
+ shr_tail();
+}
+
+static OP_INL void OP_FN(29)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* LSR */
+{
+ auint src   = OP_FN(io_read_mod)(ctx, arg1);
+ auint res   = 0U;
+ shr_tail();
+}
+
+static OP_INL void OP_FN(2A)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* ROR */
+{
+ auint flags = OP_FN(sreg_read)(ctx);
+ auint src   = OP_FN(io_read_mod)(ctx, arg1);
+ auint res   = (SREG_GET_C(flags) << 7);
+ shr_tail();
+}
+
+static OP_INL void OP_FN(2B)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* DEC */
+{
+ auint res   = OP_FN(io_read_mod)(ctx, arg1);
+ auint one   = 1U;
+ if (OP_ISMOD && (ctx->idc_opc == 0x2BU)){ OP_FN(idc_prep)(ctx, &res, &one); }
+ res -= one;
+ ctx->cpu_state.iors[arg1] = res;
+ flg_tail(SREG_IM | SREG_TM | SREG_HM | SREG_CM, CU_AVRFG_FDEC(res));
+ cy1_tail();
+}
+
+static OP_INL void OP_FN(2C)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* JMP */
+{
+ ctx->cpu_state.pc = arg2;
+ cy3_tail();
+}
+
+static OP_INL void OP_FN(2D)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* CALL */
+{
+ auint res   = arg2;
+ ctx->cpu_state.pc ++;
+ OP_UPDATE;
+ call_tail();
+}
+
+static OP_INL void OP_FN(2E)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* BSET */
+{
+ auint flags = OP_FN(sreg_read)(ctx);
+ ctx->cpu_state.iors[CU_IO_SREG] |=  arg1;
+ if ((((~flags) & arg1) & SREG_IM) != 0U){
+  ctx->event_it = TRUE; /* Interrupts become enabled, so check them */
+ }
+ cy1_tail();
+}
+
+static OP_INL void OP_FN(2F)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* BCLR */
+{
+ cu_avr_sreg_sync(ctx);
+ ctx->cpu_state.iors[CU_IO_SREG] &= ~arg1;
+ cy1_tail();
+}
+
+static OP_INL void OP_FN(30)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* IJMP */
+{
+ auint tmp;
+ if ( (!OP_ISMOD) && (ctx->ckpt_req) &&
+      (ctx->cpu_state.iors[0xF0U] == 0x5AU) ){ /* Checkpoint before enabling modifications */
+  ctx->cpu_state.pc --;
+  cu_avr_ckpt_stop(ctx);
+  return;
+ }
+ tmp   = ((auint)(OP_FN(io_read_mod)(ctx, 30))     ) +
+         ((auint)(OP_FN(io_read_mod)(ctx, 31)) << 8);
+ ctx->cpu_state.pc = tmp;
+ if (ctx->cpu_state.iors[0xF0U] == 0x5AU){ /* Enable behaviour modifications if allowed */
+  ctx->alu_ismod = TRUE;
+  ctx->alu_modcyc = ctx->cpu_state.cycle;
+  ctx->cycle_horizon = 0U; /* Leave emulation without modifications */
+ }
+ cy2_tail();
+}
+
+static OP_INL void OP_FN(31)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* RET */
+{
+ ret_tail();
+}
+
+static OP_INL void OP_FN(32)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* ICALL */
+{
+ auint res   = ((auint)(OP_FN(io_read_mod)(ctx, 30))     ) +
+               ((auint)(OP_FN(io_read_mod)(ctx, 31)) << 8);
+ call_tail();
+}
+
+static OP_INL void OP_FN(33)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* RETI */
+{
+ auint flags = OP_FN(sreg_read)(ctx);
+ SREG_SET(flags, SREG_IM);
+ ctx->event_it = TRUE; /* Interrupts (might) become enabled, so check them */
+ ctx->cpu_state.iors[CU_IO_SREG] = flags;
+ ret_tail();
+}
+
+static OP_INL void OP_FN(34)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* SLEEP */
+{
+ /* Will implement later */
+ cy1_tail();
+}
+
+static OP_INL void OP_FN(35)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* BREAK */
+{
+ /* No operation */
+ cy1_tail();
+}
+
+static OP_INL void OP_FN(36)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* WDR */
+{
+ cy1_tail();
+}
+
+static OP_INL void OP_FN(37)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* MUL */
+{
+ auint dst   = OP_FN(io_read_mod)(ctx, arg1);
+ auint src   = OP_FN(io_read_mod)(ctx, arg2);
+ mul_tail();
+}
+
+static OP_INL void OP_FN(38)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* IN */
+{
+ ctx->cpu_state.iors[arg1] = cu_avr_read_io(ctx, arg2);
+ cy1_tail();
+}
+
+static OP_INL void OP_FN(39)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* OUT */
+{
+ auint tmp = OP_FN(io_read_mod)(ctx, arg2);
+ out_tail();
+}
+
+static OP_INL void OP_FN(3A)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* ADIW */
+{
+ auint flags = OP_FN(sreg_read)(ctx);
+ auint dst   = ((auint)(OP_FN(io_read_mod)(ctx, arg1 + 0U))     ) +
+               ((auint)(OP_FN(io_read_mod)(ctx, arg1 + 1U)) << 8);
+ auint src   = arg2; /* Flags are simplified assuming this is less than 0x8000 (it is so on AVR) */
+ auint res;
+ if (OP_ISMOD && (ctx->idc_opc == 0x3AU)){ OP_FN(idc_prep)(ctx, &dst, &src); }
+ res = dst + src;
+ SREG_CLR(flags, SREG_CM | SREG_ZM | SREG_NM | SREG_VM | SREG_SM);
+ SREG_SET(flags, SREG_VM & (((~dst) & (res)) >> (15U - SREG_V)));
+ adiw_tail();
+}
+
+static OP_INL void OP_FN(3B)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* SBIW */
+{
+ auint flags = OP_FN(sreg_read)(ctx);
+ auint dst   = ((auint)(OP_FN(io_read_mod)(ctx, arg1 + 0U))     ) +
+               ((auint)(OP_FN(io_read_mod)(ctx, arg1 + 1U)) << 8);
+ auint src   = arg2; /* Flags are simplified assuming this is less than 0x8000 (it is so on AVR) */
+ auint res;
+ if (OP_ISMOD && (ctx->idc_opc == 0x3BU)){ OP_FN(idc_prep)(ctx, &dst, &src); }
+ res = dst - src;
+ SREG_CLR(flags, SREG_CM | SREG_ZM | SREG_NM | SREG_VM | SREG_SM);
+ SREG_SET(flags, SREG_VM & (((dst) & (~res)) >> (15U - SREG_V)));
+ adiw_tail();
+}
+
+static OP_INL void OP_FN(3C)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* CBI */
+{
+ auint tmp   = cu_avr_read_io(ctx, arg1) & (~arg2);
+ oub_tail();
+}
+
+static OP_INL void OP_FN(3D)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* SBIC */
+{
+ if (((cu_avr_read_io(ctx, arg1) & arg2) != 0U) && (!OP_CONDJMP)){
+  cy1_tail();
+ }else{
+  skip_tail();
+ }
+}
+
+static OP_INL void OP_FN(3E)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* SBI */
+{
+ auint tmp   = cu_avr_read_io(ctx, arg1) | ( arg2);
+ oub_tail();
+}
+
+static OP_INL void OP_FN(3F)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* SBIS */
+{
+ if (((cu_avr_read_io(ctx, arg1) & arg2) == 0U) && (!OP_CONDJMP)){
+  cy1_tail();
+ }else{
+  skip_tail();
+ }
+}
+
+static OP_INL void OP_FN(40)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* RJMP */
+{
+ ctx->cpu_state.pc += arg2;
+ cy2_tail();
+}
+
+static OP_INL void OP_FN(41)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* RCALL */
+{
+ auint res   = ctx->cpu_state.pc + arg2;
+ call_tail();
+}
+
+static OP_INL void OP_FN(42)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* BRBS */
+{
+ if (((OP_FN(sreg_peek)(ctx) & arg1) == 0U) && (!OP_CONDJMP)){
+  cy1_tail();
+ }else{
+  ctx->cpu_state.pc += arg2;
+  cy2_tail();
+ }
+}
+
+static OP_INL void OP_FN(43)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* BRBC */
+{
+ if (((OP_FN(sreg_peek)(ctx) & arg1) != 0U) && (!OP_CONDJMP)){
+  cy1_tail();
+ }else{
+  ctx->cpu_state.pc += arg2;
+  cy2_tail();
+ }
+}
+
+static OP_INL void OP_FN(44)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* BLD */
+{
+ auint src   = (OP_FN(sreg_peek)(ctx) >> SREG_T) & 1U;
+ auint tmp   = OP_FN(io_read_mod)(ctx, arg1);
+ tmp   = (tmp & (~(1U << arg2))) | (src << arg2);
+ ctx->cpu_state.iors[arg1] = tmp;
+ cy1_tail();
+}
+
+static OP_INL void OP_FN(45)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* BST */
+{
+ auint flags = OP_FN(sreg_read)(ctx) & (~(auint)(SREG_TM));
+ flags = flags | (((OP_FN(io_read_mod)(ctx, arg1) >> arg2) & 1U) << SREG_T);
+ ctx->cpu_state.iors[CU_IO_SREG] = flags;
+ cy1_tail();
+}
+
+static OP_INL void OP_FN(46)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* SBRC */
+{
+ if (((OP_FN(io_read_mod)(ctx, arg1) & arg2) != 0U) && (!OP_CONDJMP)){
+  cy1_tail();
+ }else{
+  skip_tail();
+ }
+}
+
+static OP_INL void OP_FN(47)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* SBRS */
+{
+ if (((OP_FN(io_read_mod)(ctx, arg1) & arg2) == 0U) && (!OP_CONDJMP)){
+  cy1_tail();
+ }else{
+  skip_tail();
+ }
+}
+
+static OP_INL void OP_FN(48)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* LDI */
+{
+ ctx->cpu_state.iors[arg1] = arg2;
+ cy1_tail();
+}
+
+static OP_INL void OP_FN(49)(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* PIXEL */
+{
+ /* Note: Normally should execute after OP_UPDATE, here it doesn't
+ ** matter (just shifts visual output one cycle left) */
+ ctx->cpu_state.iors[CU_IO_PORTC] = OP_FN(io_read_mod)(ctx, arg2) &
+                                    OP_FN(io_read_mod)(ctx, CU_IO_DDRC);
+ cy1_tail();
+}
+
+static OP_INL void OP_FN(4A)(cu_avr_ctx_t* ctx, auint arg1, auint arg2)
+{
+ /* Undefined op. error here, implement! */
+ cy1_tail();
+}
+
+static OP_INL void OP_FN(60)(cu_avr_ctx_t* ctx, auint arg1, auint arg2)
+{
+ /* Not compiled yet: compile, then return to execute it (no cycles) */
+ ctx->cpu_state.pc --;
+ cu_avr_code_fill(ctx, ctx->cpu_state.pc);
+}
+
+
+
+#ifndef CU_AVR_O_MOD
+
+
+
+/*
+** Superinstructions (see cu_avrc.h), only in the plain set. If the whole
+** sequence ends below the event horizon with no interrupt to check, these
+** run it at once: computing the flags only as the sequence leaves them and
+** adding the cycles once. Otherwise only the first instruction is run, the
+** subsequent words then being dispatched normally. No instruction of a
+** superinstruction can enable interrupts or the behaviour modifications.
+*/
+
+/* Runs only the first instruction if the sequence of at most "cyc" cycles
+** could cross the event horizon (the handler is entered below it) */
+#define fuse_head(cyc, first) \
+ do{ \
+  if ( ctx->event_it || \
+       ((ctx->cycle_horizon - ctx->cpu_state.cycle) < (cyc)) ){ \
+   op_##first(ctx, arg1, arg2); \
+   return; \
+  } \
+ }while(0)
+
+/* Fetches the arguments of the next word of the sequence */
+#define fuse_next() \
+ do{ \
+  opcode = ctx->cpu_code[ctx->cpu_state.pc & 0x7FFFU]; \
+  arg1   = (opcode >>  8) & 0xFFU; \
+  arg2   = (opcode >> 16) & 0xFFFFU; \
+  ctx->cpu_state.pc ++; \
+ }while(0)
+
+/* Adds the cycles of the sequence */
+#define fuse_cycles(cyc) \
+ do{ \
+  ctx->cpu_state.cycle = WRAP32(ctx->cpu_state.cycle + (cyc)); \
+ }while(0)
+
+/* Sets the flags of a 16 bit subtraction or comparison from its high byte
+** and the result of its low byte (Z is only set if both are zero) */
+#define fuse_sbc_flg(dst, src, res, lres) \
+ do{ \
+  auint flags = CU_AVRFG_FVAL(CU_AVRFG_FSUB(dst, src, res)); \
+  if (((lres) & 0xFFU) != 0U){ flags &= ~(auint)(SREG_ZM); } \
+  ctx->cpu_state.iors[CU_IO_SREG] = (ctx->cpu_state.iors[CU_IO_SREG] & (SREG_IM | SREG_TM)) | flags; \
+  if (SREG_LAZY){ ctx->sreg_keep = 0U; } \
+ }while(0)
+
+/* Closing BRBS or BRBC (by the low bit of its opcode) of "cyc" cycles if
+** not taken */
+#define fuse_br(cyc) \
+ do{ \
+  fuse_next(); \
+  if (((op_sreg_peek(ctx) & arg1) != 0U) != ((opcode & 1U) != 0U)){ \
+   ctx->cpu_state.pc += arg2; \
+   fuse_cycles((cyc) + 1U); \
+  }else{ \
+   fuse_cycles(cyc); \
+  } \
+ }while(0)
+
+
+
+static OP_INL void op_4B(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* CP + BRBS / BRBC */
+{
+ auint src;
+ auint dst;
+ auint opcode;
+ fuse_head(3U, 0B);
+ src   = ctx->cpu_state.iors[arg2];
+ dst   = ctx->cpu_state.iors[arg1];
+ flg_tail(SREG_IM | SREG_TM, CU_AVRFG_FSUB(dst, src, dst - src));
+ fuse_br(2U);
+}
+
+static OP_INL void op_4C(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* CPI + BRBS / BRBC */
+{
+ auint dst;
+ auint opcode;
+ fuse_head(3U, 12);
+ dst   = ctx->cpu_state.iors[arg1];
+ flg_tail(SREG_IM | SREG_TM, CU_AVRFG_FSUB(dst, arg2, dst - arg2));
+ fuse_br(2U);
+}
+
+static OP_INL void op_4D(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* CPC + BRBS / BRBC */
+{
+ auint src;
+ auint dst;
+ auint res;
+ auint opcode;
+ fuse_head(3U, 07);
+ src   = ctx->cpu_state.iors[arg2];
+ dst   = ctx->cpu_state.iors[arg1];
+ res   = dst - (src + SREG_GET_C(op_sreg_peek(ctx)));
+ ctx->cpu_state.iors[CU_IO_SREG] = (op_sreg_read(ctx) | (SREG_HM | SREG_SM | SREG_VM | SREG_NM | SREG_CM)) &
+                                   ( CU_AVRFG_FVAL(CU_AVRFG_FSUB(dst, src, res)) |
+                                     (SREG_IM | SREG_TM) );
+ fuse_br(2U);
+}
+
+static OP_INL void op_4E(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* CP + CPC */
+{
+ auint src;
+ auint dst;
+ auint lres;
+ auint res;
+ auint opcode;
+ fuse_head(2U, 0B);
+ src   = ctx->cpu_state.iors[arg2];
+ dst   = ctx->cpu_state.iors[arg1];
+ lres  = dst - src;
+ fuse_next();
+ src   = ctx->cpu_state.iors[arg2];
+ dst   = ctx->cpu_state.iors[arg1];
+ res   = dst - (src + ((lres >> 8) & 1U));
+ fuse_sbc_flg(dst, src, res, lres);
+ fuse_cycles(2U);
+}
+
+static OP_INL void op_4F(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* CP + CPC + BRBS / BRBC */
+{
+ auint src;
+ auint dst;
+ auint lres;
+ auint res;
+ auint opcode;
+ fuse_head(4U, 0B);
+ src   = ctx->cpu_state.iors[arg2];
+ dst   = ctx->cpu_state.iors[arg1];
+ lres  = dst - src;
+ fuse_next();
+ src   = ctx->cpu_state.iors[arg2];
+ dst   = ctx->cpu_state.iors[arg1];
+ res   = dst - (src + ((lres >> 8) & 1U));
+ fuse_sbc_flg(dst, src, res, lres);
+ fuse_br(3U);
+}
+
+static OP_INL void op_50(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* CPI + CPC */
+{
+ auint src;
+ auint dst;
+ auint lres;
+ auint res;
+ auint opcode;
+ fuse_head(2U, 12);
+ lres  = ctx->cpu_state.iors[arg1] - arg2;
+ fuse_next();
+ src   = ctx->cpu_state.iors[arg2];
+ dst   = ctx->cpu_state.iors[arg1];
+ res   = dst - (src + ((lres >> 8) & 1U));
+ fuse_sbc_flg(dst, src, res, lres);
+ fuse_cycles(2U);
+}
+
+static OP_INL void op_51(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* CPI + CPC + BRBS / BRBC */
+{
+ auint src;
+ auint dst;
+ auint lres;
+ auint res;
+ auint opcode;
+ fuse_head(4U, 12);
+ lres  = ctx->cpu_state.iors[arg1] - arg2;
+ fuse_next();
+ src   = ctx->cpu_state.iors[arg2];
+ dst   = ctx->cpu_state.iors[arg1];
+ res   = dst - (src + ((lres >> 8) & 1U));
+ fuse_sbc_flg(dst, src, res, lres);
+ fuse_br(3U);
+}
+
+static OP_INL void op_52(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* DEC + BRBS / BRBC */
+{
+ auint res;
+ auint opcode;
+ fuse_head(3U, 2B);
+ res   = ctx->cpu_state.iors[arg1] - 1U;
+ ctx->cpu_state.iors[arg1] = res;
+ flg_tail(SREG_IM | SREG_TM | SREG_HM | SREG_CM, CU_AVRFG_FDEC(res));
+ fuse_br(2U);
+}
+
+static OP_INL void op_53(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* LDI + LDI */
+{
+ auint opcode;
+ fuse_head(2U, 48);
+ ctx->cpu_state.iors[arg1] = arg2;
+ fuse_next();
+ ctx->cpu_state.iors[arg1] = arg2;
+ fuse_cycles(2U);
+}
+
+static OP_INL void op_54(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* MOVW + ADIW */
+{
+ auint flags;
+ auint dst;
+ auint res;
+ auint opcode;
+ fuse_head(3U, 01);
+ ctx->cpu_state.iors[arg1 + 0U] = ctx->cpu_state.iors[arg2 + 0U];
+ ctx->cpu_state.iors[arg1 + 1U] = ctx->cpu_state.iors[arg2 + 1U];
+ fuse_next();
+ flags = op_sreg_read(ctx);
+ dst   = ((auint)(ctx->cpu_state.iors[arg1 + 0U])     ) +
+         ((auint)(ctx->cpu_state.iors[arg1 + 1U]) << 8);
+ res   = dst + arg2;
+ SREG_CLR(flags, SREG_CM | SREG_ZM | SREG_NM | SREG_VM | SREG_SM);
+ SREG_SET(flags, SREG_VM & (((~dst) & (res)) >> (15U - SREG_V)));
+ ctx->cpu_state.iors[arg1 + 0U] = (res     ) & 0xFFU;
+ ctx->cpu_state.iors[arg1 + 1U] = (res >> 8) & 0xFFU;
+ SREG_SET(flags, SREG_NM & ((          res ) >> (15U - SREG_N)));
+ SREG_SET_C_BIT16(flags, res);
+ SREG_SET_Z(flags, res & 0xFFFFU);
+ SREG_COM_NV(flags);
+ ctx->cpu_state.iors[CU_IO_SREG] = flags;
+ fuse_cycles(3U);
+}
+
+static OP_INL void op_55(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* SUBI + SBCI */
+{
+ auint dst;
+ auint lres;
+ auint res;
+ auint opcode;
+ fuse_head(2U, 14);
+ lres  = ctx->cpu_state.iors[arg1] - arg2;
+ ctx->cpu_state.iors[arg1] = lres;
+ fuse_next();
+ dst   = ctx->cpu_state.iors[arg1];
+ res   = dst - (arg2 + ((lres >> 8) & 1U));
+ ctx->cpu_state.iors[arg1] = res;
+ fuse_sbc_flg(dst, arg2, res, lres);
+ fuse_cycles(2U);
+}
+
+static OP_INL void op_56(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* ADD + ADC */
+{
+ auint src;
+ auint dst;
+ auint lres;
+ auint res;
+ auint opcode;
+ fuse_head(2U, 09);
+ lres  = ctx->cpu_state.iors[arg1] + ctx->cpu_state.iors[arg2];
+ ctx->cpu_state.iors[arg1] = lres;
+ fuse_next();
+ src   = ctx->cpu_state.iors[arg2];
+ dst   = ctx->cpu_state.iors[arg1];
+ res   = dst + (src + ((lres >> 8) & 1U));
+ ctx->cpu_state.iors[arg1] = res;
+ flg_tail(SREG_IM | SREG_TM, CU_AVRFG_FADD(dst, src, res));
+ fuse_cycles(2U);
+}
+
+static OP_INL void op_57(cu_avr_ctx_t* ctx, auint arg1, auint arg2) /* SUB + SBC */
+{
+ auint src;
+ auint dst;
+ auint lres;
+ auint res;
+ auint opcode;
+ fuse_head(2U, 0C);
+ lres  = ctx->cpu_state.iors[arg1] - ctx->cpu_state.iors[arg2];
+ ctx->cpu_state.iors[arg1] = lres;
+ fuse_next();
+ src   = ctx->cpu_state.iors[arg2];
+ dst   = ctx->cpu_state.iors[arg1];
+ res   = dst - (src + ((lres >> 8) & 1U));
+ ctx->cpu_state.iors[arg1] = res;
+ fuse_sbc_flg(dst, src, res, lres);
+ fuse_cycles(2U);
+}
+
+
+
+#endif
+
+
+
+#undef OP_FN
+#undef OP_INL
+#undef OP_ISMOD
+#undef OP_CONDJMP
+#undef OP_UPDATE
+#undef OP_UPDATE_IT
+#undef OP_LAZYFLG
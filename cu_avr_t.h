@@ -0,0 +1,309 @@
+/*
+ *  AVR microcontroller emulation, direct threaded opcode decoder for native builds
+ *
+ *  Copyright (C) 2016 - 2017
+ *    Sandor Zsuga (Jubatian)
+ *  Uzem (the base of CUzeBox) is copyright (C)
+ *    David Etherton,
+ *    Eric Anderton,
+ *    Alec Bourque (Uze),
+ *    Filipe Rinaldi,
+ *    Sandor Zsuga (Jubatian),
+ *    Matt Pandina (Artcfox)
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef CU_AVR_C
+#error "This file is part of cu_avr.c!"
+#endif
+
+
+
+/*
+** This is a variant of the instruction decoder for native builds using
+** direct threading: the address of the handler of each compiled instruction
+** is resolved into cpu_thrd when the Code ROM is compiled, and every handler
+** transfers control to the next one by a computed goto of its own. This
+** needs GCC's labels as values extension (Clang also supports it).
+**
+** The handlers are the plain ones (op_XX) with the ALU behaviour
+** modifications and hardware event checks compiled out, so they only run
+** below the event horizon. Above it instructions are stepped by
+** cu_avr_exec_step(). Only the "ijmp" can enable the modifications (it also
+** clears the horizon), from then on instructions are emulated by
+** cu_avr_exec_mod() until they are disabled again.
+*/
+
+
+
+/* Runs an opcode handler then dispatches the next instruction */
+#define THRD_OP(op) \
+ thrd_##op: \
+  op_##op(ctx, arg1, arg2); \
+  if (ctx->cpu_state.cycle >= ctx->cycle_horizon){ goto thrd_slow; } \
+  hndl   = ctx->cpu_thrd[ctx->cpu_state.pc & 0x7FFFU]; \
+  opcode = ctx->cpu_code[ctx->cpu_state.pc & 0x7FFFU]; \
+  arg1   = (opcode >>  8) & 0xFFU; \
+  arg2   = (opcode >> 16) & 0xFFFFU; \
+  ctx->cpu_state.pc ++; \
+  goto *hndl
+
+
+
+/* The labels as values extension is non-standard */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+
+
+
+/*
+** Emulates (compiled) AVR instructions along with any associated hardware
+** tasks until the cycle counter reaches cycle_count_max (at least one
+** instruction is always emulated). If "table" is non-NULL, it only returns
+** the handler address table by opcode.
+*/
+static void cu_avr_thrd_exec(cu_avr_ctx_t* ctx, void* const** table)
+{
+ static void* const thrd_labels[128U] = {
+ &&thrd_00, &&thrd_01, &&thrd_02, &&thrd_03, &&thrd_04, &&thrd_05,
+ &&thrd_06, &&thrd_07, &&thrd_08, &&thrd_09, &&thrd_0A, &&thrd_0B,
+ &&thrd_0C, &&thrd_0D, &&thrd_0E, &&thrd_0F, &&thrd_10, &&thrd_11,
+ &&thrd_12, &&thrd_13, &&thrd_14, &&thrd_15, &&thrd_16, &&thrd_17,
+ &&thrd_18, &&thrd_19, &&thrd_1A, &&thrd_1B, &&thrd_1C, &&thrd_1D,
+ &&thrd_1E, &&thrd_1F, &&thrd_20, &&thrd_21, &&thrd_22, &&thrd_23,
+ &&thrd_24, &&thrd_25, &&thrd_26, &&thrd_27, &&thrd_28, &&thrd_29,
+ &&thrd_2A, &&thrd_2B, &&thrd_2C, &&thrd_2D, &&thrd_2E, &&thrd_2F,
+ &&thrd_30, &&thrd_31, &&thrd_32, &&thrd_33, &&thrd_34, &&thrd_35,
+ &&thrd_36, &&thrd_37, &&thrd_38, &&thrd_39, &&thrd_3A, &&thrd_3B,
+ &&thrd_3C, &&thrd_3D, &&thrd_3E, &&thrd_3F, &&thrd_40, &&thrd_41,
+ &&thrd_42, &&thrd_43, &&thrd_44, &&thrd_45, &&thrd_46, &&thrd_47,
+ &&thrd_48, &&thrd_49, &&thrd_4A, &&thrd_4B, &&thrd_4C, &&thrd_4D,
+ &&thrd_4E, &&thrd_4F, &&thrd_50, &&thrd_51, &&thrd_52, &&thrd_53,
+ &&thrd_54, &&thrd_55, &&thrd_56, &&thrd_57, &&thrd_4A, &&thrd_4A,
+ &&thrd_4A, &&thrd_4A, &&thrd_4A, &&thrd_4A, &&thrd_4A, &&thrd_4A,
+ &&thrd_60, &&thrd_4A, &&thrd_4A, &&thrd_4A, &&thrd_4A, &&thrd_4A,
+ &&thrd_4A, &&thrd_4A, &&thrd_4A, &&thrd_4A, &&thrd_4A, &&thrd_4A,
+ &&thrd_4A, &&thrd_4A, &&thrd_4A, &&thrd_4A, &&thrd_4A, &&thrd_4A,
+ &&thrd_4A, &&thrd_4A, &&thrd_4A, &&thrd_4A, &&thrd_4A, &&thrd_4A,
+ &&thrd_4A, &&thrd_4A, &&thrd_4A, &&thrd_4A, &&thrd_4A, &&thrd_4A,
+ &&thrd_4A, &&thrd_4A
+ };
+ auint  opcode;
+ auint  arg1;
+ auint  arg2;
+ void*  hndl;
+
+ if (table != NULL){
+  *table = &thrd_labels[0];
+  return;
+ }
+
+ if (ctx->alu_ismod){ goto thrd_mod; }
+ goto thrd_step;
+
+ /* Handlers */
+
+ THRD_OP(00);
+ THRD_OP(01);
+ THRD_OP(02);
+ THRD_OP(03);
+ THRD_OP(04);
+ THRD_OP(05);
+ THRD_OP(06);
+ THRD_OP(07);
+ THRD_OP(08);
+ THRD_OP(09);
+ THRD_OP(0A);
+ THRD_OP(0B);
+ THRD_OP(0C);
+ THRD_OP(0D);
+ THRD_OP(0E);
+ THRD_OP(0F);
+ THRD_OP(10);
+ THRD_OP(11);
+ THRD_OP(12);
+ THRD_OP(13);
+ THRD_OP(14);
+ THRD_OP(15);
+ THRD_OP(16);
+ THRD_OP(17);
+ THRD_OP(18);
+ THRD_OP(19);
+ THRD_OP(1A);
+ THRD_OP(1B);
+ THRD_OP(1C);
+ THRD_OP(1D);
+ THRD_OP(1E);
+ THRD_OP(1F);
+ THRD_OP(20);
+ THRD_OP(21);
+ THRD_OP(22);
+ THRD_OP(23);
+ THRD_OP(24);
+ THRD_OP(25);
+ THRD_OP(26);
+ THRD_OP(27);
+ THRD_OP(28);
+ THRD_OP(29);
+ THRD_OP(2A);
+ THRD_OP(2B);
+ THRD_OP(2C);
+ THRD_OP(2D);
+ THRD_OP(2E);
+ THRD_OP(2F);
+ THRD_OP(30);
+ THRD_OP(31);
+ THRD_OP(32);
+ THRD_OP(33);
+ THRD_OP(34);
+ THRD_OP(35);
+ THRD_OP(36);
+ THRD_OP(37);
+ THRD_OP(38);
+ THRD_OP(39);
+ THRD_OP(3A);
+ THRD_OP(3B);
+ THRD_OP(3C);
+ THRD_OP(3D);
+ THRD_OP(3E);
+ THRD_OP(3F);
+ THRD_OP(40);
+ THRD_OP(41);
+ THRD_OP(42);
+ THRD_OP(43);
+ THRD_OP(44);
+ THRD_OP(45);
+ THRD_OP(46);
+ THRD_OP(47);
+ THRD_OP(48);
+ THRD_OP(49);
+ THRD_OP(4A);
+ THRD_OP(60);
+
+ /* Superinstructions */
+
+ THRD_OP(4B);
+ THRD_OP(4C);
+ THRD_OP(4D);
+ THRD_OP(4E);
+ THRD_OP(4F);
+ THRD_OP(50);
+ THRD_OP(51);
+ THRD_OP(52);
+ THRD_OP(53);
+ THRD_OP(54);
+ THRD_OP(55);
+ THRD_OP(56);
+ THRD_OP(57);
+
+ /* Above the event horizon: Instructions are stepped processing hardware
+ ** events until it is possible to return below it */
+
+thrd_slow:
+
+ cu_avr_exec_flag(ctx); /* If an "ijmp" enabled modifications */
+ if (ctx->alu_ismod){ goto thrd_chk; }
+ cu_avr_horizon(ctx);
+ if (ctx->cpu_state.cycle < ctx->cycle_horizon){ goto thrd_next; }
+ if (ctx->cpu_state.cycle >= ctx->cycle_count_max){ return; }
+
+thrd_step:
+
+ cu_avr_exec_step(ctx);
+ goto thrd_slow;
+
+ /* Emulation with the behaviour modifications enabled */
+
+thrd_chk:
+
+ if (ctx->cpu_state.cycle >= ctx->cycle_count_max){ return; }
+
+thrd_mod:
+
+ cu_avr_exec_mod(ctx);
+ if (ctx->cpu_state.cycle >= ctx->cycle_count_max){ return; }
+ if (ctx->alu_ismod){ goto thrd_mod; }
+ goto thrd_slow;
+
+ /* Dispatch of the next instruction below the event horizon */
+
+thrd_next:
+
+ hndl   = ctx->cpu_thrd[ctx->cpu_state.pc & 0x7FFFU];
+ opcode = ctx->cpu_code[ctx->cpu_state.pc & 0x7FFFU];
+ arg1   = (opcode >>  8) & 0xFFU;
+ arg2   = (opcode >> 16) & 0xFFFFU;
+ ctx->cpu_state.pc ++;
+
+ goto *hndl;
+}
+
+
+
+#pragma GCC diagnostic pop
+
+
+
+/*
+** Runs emulation until the cycle counter reaches cycle_count_max (at least
+** one instruction is always emulated).
+*/
+static void cu_avr_exec_run(cu_avr_ctx_t* ctx)
+{
+ cu_avr_thrd_exec(ctx, NULL);
+}
+
+
+
+/*
+** Updates decoder specific data after compiling a range of the Code ROM (by
+** cu_avr_code_fill()). Resolves the handler addresses of the compiled
+** instructions.
+*/
+static void cu_avr_exec_fill(cu_avr_ctx_t* ctx, auint wbase, auint wlen)
+{
+ auint i;
+
+ for (i = wbase; i < (wbase + wlen); i++){
+  ctx->cpu_thrd[i] = ctx->thrd_table[ctx->cpu_code[i] & 0x7FU];
+ }
+}
+
+
+
+/*
+** Updates decoder specific data after the recompilation of a range of the
+** Code ROM (by cu_avr_crom_update()). Resolves the handler addresses of the
+** recompiled instructions.
+*/
+static void cu_avr_exec_update(cu_avr_ctx_t* ctx, auint wbase, auint wlen)
+{
+ if (ctx->thrd_table == NULL){ cu_avr_thrd_exec(ctx, &ctx->thrd_table); }
+
+ cu_avr_exec_fill(ctx, wbase, wlen);
+}
+
+
+
+/*
+** Releases decoder specific resources of an instance (by cu_avr_free()).
+** The direct threaded decoder has nothing to release.
+*/
+static void cu_avr_exec_free(cu_avr_ctx_t* ctx)
+{
+ (void)(ctx);
+}
@@ -546,3 +546,86 @@ auint cu_avrc_compile(auint word0, auint word1)
 
  return UNDEF;
 }
+
+
+
+/*
+** Forms a superinstruction from the compiled opcode of an instruction and the
+** compiled opcodes of the two words following it if they begin with a common
+** sequence of instructions. Returns the compiled opcode to use for the first
+** word (which is "op0" if no superinstruction was formed). The passed
+** opcodes must not be superinstructions.
+*/
+auint cu_avrc_fuse(auint op0, auint op1, auint op2)
+{
+ auint ret = op0 & 0xFFFFFF00U; /* Arguments of the first instruction */
+ auint op  = 0U;
+
+ /* Two word instructions never begin or continue superinstructions, so
+ ** their 2 word instruction flag (bit 7) is also compared here. */
+
+ op1 &= 0xFFU;
+ op2 &= 0xFFU;
+
+ switch (op0 & 0xFFU){
+
+  case 0x0BU: /* CP */
+
+   if       (op1 == 0x07U){ /* CPC */
+    if      ((op2 == 0x42U) || (op2 == 0x43U)){ op = 0x4FU; } /* BRBS / BRBC */
+    else                                      { op = 0x4EU; }
+   }else if ((op1 == 0x42U) || (op1 == 0x43U)){ op = 0x4BU; } /* BRBS / BRBC */
+   break;
+
+  case 0x12U: /* CPI */
+
+   if       (op1 == 0x07U){ /* CPC */
+    if      ((op2 == 0x42U) || (op2 == 0x43U)){ op = 0x51U; } /* BRBS / BRBC */
+    else                                      { op = 0x50U; }
+   }else if ((op1 == 0x42U) || (op1 == 0x43U)){ op = 0x4CU; } /* BRBS / BRBC */
+   break;
+
+  case 0x07U: /* CPC */
+
+   if       ((op1 == 0x42U) || (op1 == 0x43U)){ op = 0x4DU; } /* BRBS / BRBC */
+   break;
+
+  case 0x2BU: /* DEC */
+
+   if       ((op1 == 0x42U) || (op1 == 0x43U)){ op = 0x52U; } /* BRBS / BRBC */
+   break;
+
+  case 0x48U: /* LDI */
+
+   if       (op1 == 0x48U){ op = 0x53U; } /* LDI */
+   break;
+
+  case 0x01U: /* MOVW */
+
+   if       (op1 == 0x3AU){ op = 0x54U; } /* ADIW */
+   break;
+
+  case 0x14U: /* SUBI */
+
+   if       (op1 == 0x13U){ op = 0x55U; } /* SBCI */
+   break;
+
+  case 0x09U: /* ADD */
+
+   if       (op1 == 0x0DU){ op = 0x56U; } /* ADC */
+   break;
+
+  case 0x0CU: /* SUB */
+
+   if       (op1 == 0x08U){ op = 0x57U; } /* SBC */
+   break;
+
+  default:
+
+   break;
+
+ }
+
+ if (op == 0U){ return op0; }
+ return ret | op;
+}
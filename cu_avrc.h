@@ -126,6 +126,26 @@
 ** 0x49: PIXEL  Ar2(Reg)  (Note: Special OUT)
 ** 0x4A: UNDEF
 **
+** Superinstructions (see cu_avrc_fuse()):
+**
+** 0x4B: CP     + BRBS / BRBC
+** 0x4C: CPI    + BRBS / BRBC
+** 0x4D: CPC    + BRBS / BRBC
+** 0x4E: CP     + CPC
+** 0x4F: CP     + CPC  + BRBS / BRBC
+** 0x50: CPI    + CPC
+** 0x51: CPI    + CPC  + BRBS / BRBC
+** 0x52: DEC    + BRBS / BRBC
+** 0x53: LDI    + LDI
+** 0x54: MOVW   + ADIW
+** 0x55: SUBI   + SBCI
+** 0x56: ADD    + ADC
+** 0x57: SUB    + SBC
+** 0x58 - 0x5F: UNDEF
+**
+** 0x60: (Not compiled yet, used by the emulator for lazy decoding)
+** 0x61: UNDEF
+**
 ** 0x1C, 0x20, 0x2C and 0x2D are 2 word instructions, so these occur as 0x9C,
 ** 0xA0, 0xAC and 0xAD on the low 8 bits. This causes the subsequent opcode to
 ** be skipped (including when such an op is skipped by a skip instruction),
@@ -136,8 +156,23 @@
 ** instructions. Translating it to this special instruction makes emulation
 ** considerably faster.
 **
-** Including and above 0x4A all should be UNDEF.
+** A superinstruction retains the arguments of its first instruction, the
+** arguments of the subsequent ones are taken from their own opcodes (which
+** may be superinstructions themselves), so any of the words can still be
+** executed alone (such as when jumped to or when the emulator has to
+** process the instructions one by one). Its behaviour equals to that of the
+** instructions executed in sequence. All superinstructions start with a
+** single word instruction.
+**
+** Including and above 0x61 all should be UNDEF.
+*/
+
+
+/*
+** Version of the compiled opcode format. It has to be changed whenever the
+** compiled opcodes change, so stored compiled code is not reused.
 */
+#define CU_AVRC_VER  1U
 
 
 /*
@@ -147,4 +182,14 @@
 auint cu_avrc_compile(auint word0, auint word1);
 
 
+/*
+** Forms a superinstruction from the compiled opcode of an instruction and the
+** compiled opcodes of the two words following it if they begin with a common
+** sequence of instructions. Returns the compiled opcode to use for the first
+** word (which is "op0" if no superinstruction was formed). The passed
+** opcodes must not be superinstructions.
+*/
+auint cu_avrc_fuse(auint op0, auint op1, auint op2);
+
+
 #endif
@@ -28,137 +28,19 @@
 
 
 #include "cu_avrfg.h"
-
-
-/* Flags in CU_IO_SREG */
-#define SREG_H  5U
-#define SREG_S  4U
-#define SREG_V  3U
-#define SREG_N  2U
-#define SREG_Z  1U
-#define SREG_C  0U
-#define SREG_HM 0x20U
-#define SREG_SM 0x10U
-#define SREG_VM 0x08U
-#define SREG_NM 0x04U
-#define SREG_ZM 0x02U
-#define SREG_CM 0x01U
-
-
-/* Macros for managing the flags */
-
-/* Set flags by mask */
-#define SREG_SET(fl, xm) (fl |= (xm))
-
-/* Set Zero if (at most) 16 bit "val" is zero */
-#define SREG_SET_Z(fl, val) (fl |= SREG_ZM & (((auint)(val) - 1U) >> 16))
-
-/* Set Carry by bit 0 (for right shifts) */
-#define SREG_SET_C_BIT0(fl, val) (fl |= (val) & 1U)
-
-/* Set Carry by bit 8 (for various adds & subs) */
-#define SREG_SET_C_BIT8(fl, val) (fl |= ((val) >> 8) & 1U)
-
-/* Set Half-Carry by bit 4 (for various adds & subs) */
-#define SREG_SET_H_BIT4(fl, val) (fl |= ((val) << 1) & 0x20U)
-
-/* Set Negative by bit 7 (for all ops updating N) */
-#define SREG_SET_N_BIT7(fl, val) (fl |= ((val) >> 5) & 0x04U)
-
-/* Set Overflow by bit 7 (for various adds & subs) */
-#define SREG_SET_V_BIT7(fl, val) (fl |= ((val) >> 4) & 0x08U)
-
-/* Set Overflow if value is 0x80U (for inc) */
-#define SREG_SET_V_80(fl, val) (fl |= SREG_VM & (((auint)(((val) - 0x80U) & 0xFFU) - 1U) >> 16))
-
-/* Set Overflow if value is 0x7FU (for dec) */
-#define SREG_SET_V_7F(fl, val) (fl |= SREG_VM & (((auint)(((val) - 0x7FU) & 0xFFU) - 1U) >> 16))
-
-/* Set S by bit 7 (used where it is more efficient than SREG_COM_NV) */
-#define SREG_SET_S_BIT7(fl, val) (fl |= ((val) >> 3) & 0x10U)
-
-/* Combine N and V into S (for all ops updating N or V) */
-#define SREG_COM_NV(fl) (fl |= (((fl) << 1) ^ ((fl) << 2)) & 0x10U)
-
-/* Set N, V and S for logical ops (where only N depends on the result's bit 7) */
-#define SREG_LOG_NVS(fl, val) (fl |= ((0x7FU - (auint)(val)) >> 8) & (SREG_SM | SREG_NM))
-
-
-/* Macro for generating an addition's flags */
-#define GENFLAGS_ADD(fl, dst, src, res, tmp) \
- do{ \
-  tmp = (src) ^ (dst); \
-  SREG_SET_H_BIT4(fl, (tmp) ^ (res)); \
-  tmp = (~tmp) & ((res) ^ (dst)); \
-  SREG_SET_C_BIT8(fl, (res)); \
-  SREG_SET_N_BIT7(fl, (res)); \
-  SREG_SET_V_BIT7(fl, (tmp)); \
-  SREG_SET_S_BIT7(fl, (tmp) ^ (res)); \
-  SREG_SET_Z(fl, (res) & 0xFFU); \
- }while(0)
-
-/* Macro for generating a subtraction's flags */
-#define GENFLAGS_SUB(fl, dst, src, res, tmp) \
- do{ \
-  tmp = (src) ^ (dst); \
-  SREG_SET_H_BIT4(fl, (tmp) ^ (res)); \
-  tmp = ( tmp) & ((res) ^ (dst)); \
-  SREG_SET_C_BIT8(fl, (res)); \
-  SREG_SET_N_BIT7(fl, (res)); \
-  SREG_SET_V_BIT7(fl, (tmp)); \
-  SREG_SET_S_BIT7(fl, (tmp) ^ (res)); \
-  SREG_SET_Z(fl, (res) & 0xFFU); \
- }while(0)
-
-/* Macro for generating a right shift's flags */
-#define GENFLAGS_SHR(fl, src, res, tmp) \
- do{ \
-  SREG_SET_C_BIT0(fl, (src)); \
-  tmp = ((src) << 7) ^ (res); \
-  SREG_SET_V_BIT7(fl, (tmp)); \
-  SREG_SET_N_BIT7(fl, (res)); \
-  SREG_SET_S_BIT7(fl, (tmp) ^ (res)); \
-  SREG_SET_Z(fl, (res)); \
- }while(0)
-
-/* Macro for generating a logical op's flags */
-#define GENFLAGS_LOG(fl, res) \
- do{ \
-  SREG_LOG_NVS(fl, res); \
-  SREG_SET_Z(fl, res); \
- }while(0)
-
-/* Macro for generating an INC's flags */
-#define GENFLAGS_INC(fl, res) \
- do{ \
-  SREG_SET_V_80(fl, res); \
-  SREG_SET_N_BIT7(fl, res); \
-  SREG_COM_NV(fl); \
-  SREG_SET_Z(fl, (res) & 0xFFU); \
- }while(0)
-
-/* Macro for generating a DEC's flags */
-#define GENFLAGS_DEC(fl, res) \
- do{ \
-  SREG_SET_V_7F(fl, res); \
-  SREG_SET_N_BIT7(fl, res); \
-  SREG_COM_NV(fl); \
-  SREG_SET_Z(fl, (res) & 0xFFU); \
- }while(0)
+#include <stdio.h>
 
 
 
 /*
 ** Fills up the flag precalc table
 */
-void cu_avrfg_fill(uint8* ftable)
+static void cu_avrfg_fill(uint8* ftable)
 {
- auint fl;
  auint cy;
  auint src;
  auint dst;
  auint res;
- auint tmp;
 
  /*
  ** Add / Sub flag generation:
@@ -171,10 +53,8 @@ void cu_avrfg_fill(uint8* ftable)
  for (cy = 0U; cy < 2U; cy ++){
   for (src = 0U; src < 256U; src ++){
    for (dst = 0U; dst < 256U; dst ++){
-    fl = 0U;
     res = dst + (src + cy);
-    GENFLAGS_ADD(fl, dst, src, res, tmp);
-    ftable[CU_AVRFG_ADD + (res & 0x1FFU) + ((src & 0x90U) << 5) + ((dst & 0x90U) << 6)] = fl;
+    ftable[CU_AVRFG_ADD + (res & 0x1FFU) + ((src & 0x90U) << 5) + ((dst & 0x90U) << 6)] = cu_avrfg_add(dst, src, res);
    }
   }
  }
@@ -182,38 +62,105 @@ void cu_avrfg_fill(uint8* ftable)
  for (cy = 0U; cy < 2U; cy ++){
   for (src = 0U; src < 256U; src ++){
    for (dst = 0U; dst < 256U; dst ++){
-    fl = 0U;
     res = dst - (src + cy);
-    GENFLAGS_SUB(fl, dst, src, res, tmp);
-    ftable[CU_AVRFG_SUB + (res & 0x1FFU) + ((src & 0x90U) << 5) + ((dst & 0x90U) << 6)] = fl;
+    ftable[CU_AVRFG_SUB + (res & 0x1FFU) + ((src & 0x90U) << 5) + ((dst & 0x90U) << 6)] = cu_avrfg_sub(dst, src, res);
    }
   }
  }
 
  for (src = 0U; src < 2U; src ++){
   for (res = 0U; res < 256U; res ++){
-   fl = 0U;
-   GENFLAGS_SHR(fl, src, res, tmp);
-   ftable[CU_AVRFG_SHR + ((src << 8) + res)] = fl;
+   ftable[CU_AVRFG_SHR + (src << 8) + res] = cu_avrfg_shr(src, res);
   }
  }
 
  for (res = 0U; res < 256U; res ++){
-  fl = 0U;
-  GENFLAGS_LOG(fl, res);
-  ftable[CU_AVRFG_LOG + res] = fl;
+  ftable[CU_AVRFG_LOG + res] = cu_avrfg_log(res);
+  ftable[CU_AVRFG_INC + res] = cu_avrfg_inc(res);
+  ftable[CU_AVRFG_DEC + res] = cu_avrfg_dec(res);
  }
 
- for (res = 0U; res < 256U; res ++){
-  fl = 0U;
-  GENFLAGS_INC(fl, res);
-  ftable[CU_AVRFG_INC + res] = fl;
+}
+
+
+
+/*
+** Fills up the split flag precalc table (the H flag of additions and
+** subtractions is calculated separately, so these only need bit 7 of the
+** operands)
+*/
+static void cu_avrfg_sfill(uint8* ftable)
+{
+ auint cy;
+ auint src;
+ auint dst;
+ auint res;
+
+ for (cy = 0U; cy < 2U; cy ++){
+  for (src = 0U; src < 256U; src ++){
+   for (dst = 0U; dst < 256U; dst ++){
+    res = dst + (src + cy);
+    ftable[CU_AVRFG_SADD + (res & 0x1FFU) + ((src & 0x80U) << 2) + ((dst & 0x80U) << 3)] =
+        cu_avrfg_add(dst, src, res) & 0x1FU;
+    res = dst - (src + cy);
+    ftable[CU_AVRFG_SSUB + (res & 0x1FFU) + ((src & 0x80U) << 2) + ((dst & 0x80U) << 3)] =
+        cu_avrfg_sub(dst, src, res) & 0x1FU;
+   }
+  }
+ }
+
+ for (src = 0U; src < 2U; src ++){
+  for (res = 0U; res < 256U; res ++){
+   ftable[CU_AVRFG_SSHR + (src << 8) + res] = cu_avrfg_shr(src, res);
+  }
  }
 
  for (res = 0U; res < 256U; res ++){
-  fl = 0U;
-  GENFLAGS_DEC(fl, res);
-  ftable[CU_AVRFG_DEC + res] = fl;
+  ftable[CU_AVRFG_SLOG + res] = cu_avrfg_log(res);
+  ftable[CU_AVRFG_SINC + res] = cu_avrfg_inc(res);
+  ftable[CU_AVRFG_SDEC + res] = cu_avrfg_dec(res);
+ }
+}
+
+
+
+/*
+** Outputs a table as C source onto the standard output.
+*/
+static void cu_avrfg_print(char const* name, uint8 const* ftable, auint size)
+{
+ auint i;
+
+ printf("const uint8 %s[%s] = {\n", name,
+        (size == CU_AVRFG_SIZE) ? "CU_AVRFG_SIZE" : "CU_AVRFG_SSIZE");
+ for (i = 0U; i < size; i++){
+  printf("%s0x%02XU%s", ((i & 15U) == 0U) ? " " : "",
+         (auint)(ftable[i]),
+         (i == (size - 1U)) ? "\n" : (((i & 15U) == 15U) ? ",\n" : ", "));
  }
+ printf("};\n");
+}
+
+
+
+/*
+** Generates the flag precalc tables as C source onto the standard output.
+*/
+int main(void)
+{
+ static uint8 ftable[CU_AVRFG_SIZE];
+ static uint8 stable[CU_AVRFG_SSIZE];
+
+ cu_avrfg_fill(&ftable[0]);
+ cu_avrfg_sfill(&stable[0]);
+
+ printf("/* Flag precalc tables, generated by cu_avrfg.c */\n");
+ printf("\n");
+ printf("#include \"cu_avrfg.h\"\n");
+ printf("\n");
+ cu_avrfg_print("cu_avrfg_table", &ftable[0], CU_AVRFG_SIZE);
+ printf("\n");
+ cu_avrfg_print("cu_avrfg_stab",  &stable[0], CU_AVRFG_SSIZE);
 
+ return 0;
 }
@@ -52,10 +52,189 @@
 #define CU_AVRFG_SIZE 0x8500U
 
 
+/* Position of ADD flags in the split table (without H)
+** (res & 0x1FFU) + ((src & 0x80U) << 2) + ((dst & 0x80U) << 3) */
+#define CU_AVRFG_SADD  0x0000U
+/* Position of SUB flags in the split table (without H) */
+#define CU_AVRFG_SSUB  0x0800U
+/* Position of SHR flags in the split table (((src & 1U) << 8) + res) */
+#define CU_AVRFG_SSHR  0x1000U
+/* Position of LOG flags in the split table (res) */
+#define CU_AVRFG_SLOG  0x1200U
+/* Position of INC flags in the split table (res) */
+#define CU_AVRFG_SINC  0x1300U
+/* Position of DEC flags in the split table (res) */
+#define CU_AVRFG_SDEC  0x1400U
+
+/* Total size of the split flag precalc table */
+#define CU_AVRFG_SSIZE 0x1500U
+
+
 /*
-** Fills up the flag precalc table
+** The flag precalc tables. They are generated at build time (cu_avrfg.c is
+** built as a native tool outputting them), so they are constant data shared
+** by all emulator processes.
 */
-void cu_avrfg_fill(uint8* ftable);
+extern const uint8 cu_avrfg_table[CU_AVRFG_SIZE];
+extern const uint8 cu_avrfg_stab[CU_AVRFG_SSIZE];
+
+
+
+/*
+** Flag calculations, returning the H, S, V, N, Z and C flags as in SREG.
+** These are the reference the precalc tables are generated from.
+*/
+
+/* Addition: res = dst + src + carry (carry out on bit 8) */
+static __inline__ auint cu_avrfg_add(auint dst, auint src, auint res)
+{
+ auint ovf = (~(src ^ dst)) & (res ^ dst);     /* Signed overflow on bit 7 */
+ return ( (((src ^ dst ^ res) << 1) & 0x20U) | /* H: carry from bit 3 */
+          (((ovf ^ res) >> 3) & 0x10U) |       /* S: N ^ V */
+          ((ovf >> 4) & 0x08U) |               /* V */
+          ((res >> 5) & 0x04U) |               /* N */
+          ((((res & 0xFFU) - 1U) >> 16) & 0x02U) | /* Z */
+          ((res >> 8) & 0x01U) );              /* C */
+}
+
+/* Subtraction: res = dst - src - carry (borrow on bit 8) */
+static __inline__ auint cu_avrfg_sub(auint dst, auint src, auint res)
+{
+ auint ovf = (src ^ dst) & (res ^ dst);        /* Signed overflow on bit 7 */
+ return ( (((src ^ dst ^ res) << 1) & 0x20U) | /* H: borrow from bit 4 */
+          (((ovf ^ res) >> 3) & 0x10U) |       /* S: N ^ V */
+          ((ovf >> 4) & 0x08U) |               /* V */
+          ((res >> 5) & 0x04U) |               /* N */
+          ((((res & 0xFFU) - 1U) >> 16) & 0x02U) | /* Z */
+          ((res >> 8) & 0x01U) );              /* C */
+}
+
+/* Right shift: bit 0 of src is shifted out, res is the result */
+static __inline__ auint cu_avrfg_shr(auint src, auint res)
+{
+ auint ovf = (src << 7) ^ res;                 /* V: N ^ C on bit 7 */
+ return ( (((ovf ^ res) >> 3) & 0x10U) |       /* S: N ^ V */
+          ((ovf >> 4) & 0x08U) |               /* V */
+          ((res >> 5) & 0x04U) |               /* N */
+          (((res - 1U) >> 16) & 0x02U) |       /* Z */
+          (src & 0x01U) );                     /* C */
+}
+
+/* Logical operation (V is cleared, H and C are not affected) */
+static __inline__ auint cu_avrfg_log(auint res)
+{
+ return ( (((0x7FU - res) >> 8) & 0x14U) |     /* S, N */
+          (((res - 1U) >> 16) & 0x02U) );      /* Z */
+}
+
+/* Increment (H and C are not affected) */
+static __inline__ auint cu_avrfg_inc(auint res)
+{
+ auint ovf = ((((res - 0x80U) & 0xFFU) - 1U) >> 16) & 0x08U; /* V */
+ auint neg = (res >> 5) & 0x04U;               /* N */
+ return ( (((ovf << 1) ^ (neg << 2)) & 0x10U) | ovf | neg |
+          ((((res & 0xFFU) - 1U) >> 16) & 0x02U) ); /* Z */
+}
+
+/* Decrement (H and C are not affected) */
+static __inline__ auint cu_avrfg_dec(auint res)
+{
+ auint ovf = ((((res - 0x7FU) & 0xFFU) - 1U) >> 16) & 0x08U; /* V */
+ auint neg = (res >> 5) & 0x04U;               /* N */
+ return ( (((ovf << 1) ^ (neg << 2)) & 0x10U) | ovf | neg |
+          ((((res & 0xFFU) - 1U) >> 16) & 0x02U) ); /* Z */
+}
+
+
+
+/*
+** Flag engines. The emulator produces flag codes by these, then obtains the
+** flags from them by CU_AVRFG_FVAL() (so with the full table the lookup may
+** be deferred, see CU_AVR_LAZY_SREG). Selectable at build time:
+**
+** - (default):         Lookup in the full precalc table (33 KBytes).
+** - CU_AVRFG_SPLIT:    Lookup in the split table (5 KBytes), H calculated.
+** - CU_AVRFG_COMPUTED: Calculation with bit operations.
+** - CU_AVRFG_BUILTIN:  Add and subtract overflows (V, C) by the compiler's
+**                      overflow checking builtins (GCC or Clang), else as
+**                      with CU_AVRFG_COMPUTED.
+*/
+
+#if   defined(CU_AVRFG_SPLIT)
+
+#define CU_AVRFG_FADD(dst, src, res) \
+ ( cu_avrfg_stab[CU_AVRFG_SADD + ((res) & 0x1FFU) + (((src) & 0x80U) << 2) + (((dst) & 0x80U) << 3)] | \
+   ((((src) ^ (dst) ^ (res)) << 1) & 0x20U) )
+#define CU_AVRFG_FSUB(dst, src, res) \
+ ( cu_avrfg_stab[CU_AVRFG_SSUB + ((res) & 0x1FFU) + (((src) & 0x80U) << 2) + (((dst) & 0x80U) << 3)] | \
+   ((((src) ^ (dst) ^ (res)) << 1) & 0x20U) )
+#define CU_AVRFG_FSHR(src, res) (cu_avrfg_stab[CU_AVRFG_SSHR + (((src) & 1U) << 8) + (res)])
+#define CU_AVRFG_FLOG(res)      (cu_avrfg_stab[CU_AVRFG_SLOG + (res)])
+#define CU_AVRFG_FINC(res)      (cu_avrfg_stab[CU_AVRFG_SINC + ((res) & 0xFFU)])
+#define CU_AVRFG_FDEC(res)      (cu_avrfg_stab[CU_AVRFG_SDEC + ((res) & 0xFFU)])
+#define CU_AVRFG_FVAL(fc)       (fc)
+
+#elif defined(CU_AVRFG_COMPUTED) || defined(CU_AVRFG_BUILTIN)
+
+#ifdef CU_AVRFG_BUILTIN
+
+/* Addition with the V and C flags by overflow checking builtins */
+static __inline__ auint cu_avrfg_add_b(auint dst, auint src, auint res)
+{
+ uint8 cin = (uint8)((res - dst - src) & 1U);
+ sint8 sres;
+ uint8 ures;
+ auint ovf = (auint)(__builtin_add_overflow((sint8)(dst), (sint8)(src), &sres)) ^
+             (auint)(__builtin_add_overflow(sres, (sint8)(cin), &sres));
+ auint cry = (auint)(__builtin_add_overflow((uint8)(dst), (uint8)(src), &ures)) |
+             (auint)(__builtin_add_overflow(ures, cin, &ures));
+ return ( (cu_avrfg_add(dst, src, res) & 0x26U) | /* H, N, Z */
+          (((ovf << 4) ^ (res >> 3)) & 0x10U) | (ovf << 3) | cry );
+}
+
+/* Subtraction with the V and C flags by overflow checking builtins */
+static __inline__ auint cu_avrfg_sub_b(auint dst, auint src, auint res)
+{
+ uint8 cin = (uint8)((dst - src - res) & 1U);
+ sint8 sres;
+ uint8 ures;
+ auint ovf = (auint)(__builtin_sub_overflow((sint8)(dst), (sint8)(src), &sres)) ^
+             (auint)(__builtin_sub_overflow(sres, (sint8)(cin), &sres));
+ auint cry = (auint)(__builtin_sub_overflow((uint8)(dst), (uint8)(src), &ures)) |
+             (auint)(__builtin_sub_overflow(ures, cin, &ures));
+ return ( (cu_avrfg_sub(dst, src, res) & 0x26U) | /* H, N, Z */
+          (((ovf << 4) ^ (res >> 3)) & 0x10U) | (ovf << 3) | cry );
+}
+
+#define CU_AVRFG_FADD(dst, src, res) cu_avrfg_add_b(dst, src, res)
+#define CU_AVRFG_FSUB(dst, src, res) cu_avrfg_sub_b(dst, src, res)
+
+#else
+
+#define CU_AVRFG_FADD(dst, src, res) cu_avrfg_add(dst, src, res)
+#define CU_AVRFG_FSUB(dst, src, res) cu_avrfg_sub(dst, src, res)
+
+#endif
+
+#define CU_AVRFG_FSHR(src, res) cu_avrfg_shr(src, res)
+#define CU_AVRFG_FLOG(res)      cu_avrfg_log(res)
+#define CU_AVRFG_FINC(res)      cu_avrfg_inc((res) & 0xFFU)
+#define CU_AVRFG_FDEC(res)      cu_avrfg_dec((res) & 0xFFU)
+#define CU_AVRFG_FVAL(fc)       (fc)
+
+#else
+
+#define CU_AVRFG_FADD(dst, src, res) \
+ (CU_AVRFG_ADD + ((res) & 0x1FFU) + (((src) & 0x90U) << 5) + (((dst) & 0x90U) << 6))
+#define CU_AVRFG_FSUB(dst, src, res) \
+ (CU_AVRFG_SUB + ((res) & 0x1FFU) + (((src) & 0x90U) << 5) + (((dst) & 0x90U) << 6))
+#define CU_AVRFG_FSHR(src, res) (CU_AVRFG_SHR + (((src) & 1U) << 8) + (res))
+#define CU_AVRFG_FLOG(res)      (CU_AVRFG_LOG + (res))
+#define CU_AVRFG_FINC(res)      (CU_AVRFG_INC + ((res) & 0xFFU))
+#define CU_AVRFG_FDEC(res)      (CU_AVRFG_DEC + ((res) & 0xFFU))
+#define CU_AVRFG_FVAL(fc)       (cu_avrfg_table[fc])
+
+#endif
 
 
 #endif
@@ -0,0 +1,71 @@
+/*
+ *  Raw binary file loader
+ *
+ *  Copyright (C) 2016
+ *    Sandor Zsuga (Jubatian)
+ *  Uzem (the base of CUzeBox) is copyright (C)
+ *    David Etherton,
+ *    Eric Anderton,
+ *    Alec Bourque (Uze),
+ *    Filipe Rinaldi,
+ *    Sandor Zsuga (Jubatian),
+ *    Matt Pandina (Artcfox)
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#include "cu_bfile.h"
+#include "filesys.h"
+
+
+
+/* String constants */
+static const char cu_id[]  = "Binary loader: ";
+static const char cu_err[] = "Error: ";
+
+
+
+/*
+** Attempts to load the passed raw binary image (such as produced by
+** avr-objcopy -O binary) into code memory from its beginning. The rest of the
+** code memory is not altered.
+**
+** The code memory must be 64 KBytes.
+**
+** Returns TRUE if the loading was successful.
+*/
+boole cu_bfile_load(char const* fname, uint8* cmem)
+{
+ uint8 const* img;
+ auint        len;
+
+ img = filesys_map(FILESYS_CH_EMU, fname, &len);
+ if (img == NULL){
+  print_error("%s%sCouldn't open %s.\n", cu_id, cu_err, fname);
+  return FALSE;
+ }
+
+ if (len > 0x10000U){
+  print_error("%s%sImage larger than 64 KBytes in %s.\n", cu_id, cu_err, fname);
+  filesys_flush(FILESYS_CH_EMU);
+  return FALSE;
+ }
+
+ memcpy(cmem, img, len);
+ filesys_flush(FILESYS_CH_EMU);
+
+ return TRUE;
+}
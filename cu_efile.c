@@ -0,0 +1,345 @@
+/*
+ *  ELF file loader
+ *
+ *  Copyright (C) 2016
+ *    Sandor Zsuga (Jubatian)
+ *  Uzem (the base of CUzeBox) is copyright (C)
+ *    David Etherton,
+ *    Eric Anderton,
+ *    Alec Bourque (Uze),
+ *    Filipe Rinaldi,
+ *    Sandor Zsuga (Jubatian),
+ *    Matt Pandina (Artcfox)
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#include "cu_efile.h"
+#include "filesys.h"
+
+
+
+/* String constants */
+static const char cu_id[]  = "ELF loader: ";
+static const char cu_err[] = "Error: ";
+
+
+/* ELF constants used */
+#define ELF_EM_AVR       83U    /* Machine: AVR */
+#define ELF_PT_LOAD      1U     /* Loadable segment */
+#define ELF_SHT_SYMTAB   2U     /* Symbol table section */
+#define ELF_SHF_EXEC     4U     /* Executable section */
+#define ELF_STT_NOTYPE   0U     /* Symbol without type (such as labels) */
+#define ELF_STT_FUNC     2U     /* Function symbol */
+
+/* Addresses from here are not in the Code ROM (RAM, EEPROM, fuses...) */
+#define ELF_AVR_NONROM   0x800000U
+
+
+
+/*
+** Reads little endian values of the file (the offset is already checked).
+*/
+static auint cu_efile_r16(uint8 const* data, auint off)
+{
+ return ((auint)(data[off     ])     ) |
+        ((auint)(data[off + 1U]) << 8);
+}
+
+static auint cu_efile_r32(uint8 const* data, auint off)
+{
+ return ((auint)(data[off     ])      ) |
+        ((auint)(data[off + 1U]) <<  8) |
+        ((auint)(data[off + 2U]) << 16) |
+        ((auint)(data[off + 3U]) << 24);
+}
+
+
+
+/*
+** Returns whether the area given by offset, element size and count is
+** within the file.
+*/
+static boole cu_efile_inside(auint len, auint off, auint esize, auint cnt)
+{
+ if (off > len){ return FALSE; }
+ if ((esize != 0U) && (cnt > ((len - off) / esize))){ return FALSE; }
+ return TRUE;
+}
+
+
+
+/*
+** Symbol ordering for qsort: by address, then the largest first.
+*/
+static int cu_efile_sym_cmp(void const* a, void const* b)
+{
+ cu_efile_sym_t const* sa = (cu_efile_sym_t const*)(a);
+ cu_efile_sym_t const* sb = (cu_efile_sym_t const*)(b);
+
+ if (sa->addr != sb->addr){ return (sa->addr < sb->addr) ? -1 : 1; }
+ if (sa->size != sb->size){ return (sa->size > sb->size) ? -1 : 1; }
+ return 0;
+}
+
+
+
+/*
+** Builds the symbol index from the symbol table section(s): the function
+** symbols and untyped symbols of executable sections. Returns FALSE if it
+** can not be allocated.
+*/
+static boole cu_efile_syms(uint8 const* data, auint len, cu_efile_syms_t* syms)
+{
+ auint shoff  = cu_efile_r32(data, 0x20U);
+ auint shsize = cu_efile_r16(data, 0x2EU);
+ auint shnum  = cu_efile_r16(data, 0x30U);
+ auint i;
+ auint j;
+ auint sh;
+ auint st;
+ auint so;
+ auint sc;
+ auint nm;
+ auint nl;
+ auint pass;
+ auint sym;
+ auint sname;
+ auint sval;
+ auint ssize;
+ auint stype;
+ auint sshdx;
+ auint slen;
+ auint scnt = 0U;
+ auint nlen = 0U;
+
+ syms->sym   = NULL;
+ syms->cnt   = 0U;
+ syms->names = NULL;
+
+ if ( (shsize < 0x28U) ||
+      (!cu_efile_inside(len, shoff, shsize, shnum)) ){ return TRUE; }
+
+ /* First pass counts, second fills the index */
+
+ for (pass = 0U; pass < 2U; pass ++){
+
+  for (i = 0U; i < shnum; i++){
+
+   sh = shoff + (i * shsize);
+   if (cu_efile_r32(data, sh + 0x04U) != ELF_SHT_SYMTAB){ continue; }
+   so = cu_efile_r32(data, sh + 0x10U);
+   sc = cu_efile_r32(data, sh + 0x14U) / 16U;
+   st = cu_efile_r32(data, sh + 0x18U); /* Linked string table */
+   if ( (!cu_efile_inside(len, so, 16U, sc)) ||
+        (st >= shnum) ){ continue; }
+   st = shoff + (st * shsize);
+   nm = cu_efile_r32(data, st + 0x10U);
+   nl = cu_efile_r32(data, st + 0x14U);
+   if ( (!cu_efile_inside(len, nm, 1U, nl)) ||
+        (nl == 0U) ||
+        (data[nm + nl - 1U] != 0U) ){ continue; }
+
+   for (j = 0U; j < sc; j++){
+    sym   = so + (j * 16U);
+    sname = cu_efile_r32(data, sym + 0x00U);
+    sval  = cu_efile_r32(data, sym + 0x04U);
+    ssize = cu_efile_r32(data, sym + 0x08U);
+    stype = data[sym + 0x0CU] & 0x0FU;
+    sshdx = cu_efile_r16(data, sym + 0x0EU);
+    if ( (stype != ELF_STT_FUNC) &&
+         (stype != ELF_STT_NOTYPE) ){ continue; }
+    if ( (sshdx == 0U) || (sshdx >= shnum) ){ continue; }
+    if ((cu_efile_r32(data, shoff + (sshdx * shsize) + 0x08U) & ELF_SHF_EXEC) == 0U){ continue; }
+    if ( (sval >= 0x10000U) ||
+         (sname == 0U) ||
+         (sname >= nl) ||
+         (data[nm + sname] == (uint8)('.')) ){ continue; }
+    slen = strlen((char const*)(&data[nm + sname])) + 1U;
+    if (pass != 0U){
+     syms->sym[scnt].addr = sval;
+     syms->sym[scnt].size = ssize;
+     syms->sym[scnt].name = nlen;
+     memcpy(&syms->names[nlen], &data[nm + sname], slen);
+    }
+    scnt ++;
+    nlen += slen;
+   }
+
+  }
+
+  if (pass == 0U){
+   if (scnt == 0U){ return TRUE; }
+   syms->sym   = malloc(scnt * sizeof(cu_efile_sym_t));
+   syms->names = malloc(nlen);
+   if ((syms->sym == NULL) || (syms->names == NULL)){
+    cu_efile_syms_free(syms);
+    return FALSE;
+   }
+   scnt = 0U;
+   nlen = 0U;
+  }
+
+ }
+
+ qsort(syms->sym, scnt, sizeof(cu_efile_sym_t), &cu_efile_sym_cmp);
+ syms->cnt = scnt;
+
+ return TRUE;
+}
+
+
+
+/*
+** Attempts to load the passed ELF file (32 bit AVR executable, as produced
+** by avr-gcc) into code memory. The loadable segments destined to the Code
+** ROM (.text and the initializers of .data) are copied to their load
+** addresses, the rest of the code memory is not altered. If syms is
+** non-NULL, it receives the symbol index (to be released by
+** cu_efile_syms_free()), it is empty if the file has no symbols.
+**
+** The code memory must be 64 KBytes.
+**
+** Returns TRUE if the loading was successful.
+*/
+boole cu_efile_load(char const* fname, uint8* cmem, cu_efile_syms_t* syms)
+{
+ uint8 const* data;
+ auint        len;
+ auint        phoff;
+ auint        phsize;
+ auint        phnum;
+ auint        ph;
+ auint        poff;
+ auint        paddr;
+ auint        psize;
+ auint        i;
+
+ data = filesys_map(FILESYS_CH_EMU, fname, &len);
+ if (data == NULL){
+  print_error("%s%sCouldn't open %s.\n", cu_id, cu_err, fname);
+  return FALSE;
+ }
+
+ /* Identification: 32 bit, little endian, executable for AVR */
+
+ if ( (len < 0x34U) ||
+      (memcmp(data, "\177ELF", 4U) != 0) ||
+      (data[4] != 1U) ||
+      (data[5] != 1U) ||
+      (cu_efile_r16(data, 0x10U) != 2U) ||
+      (cu_efile_r16(data, 0x12U) != ELF_EM_AVR) ){
+  print_error("%s%sNot an AVR ELF executable: %s.\n", cu_id, cu_err, fname);
+  goto ex_file;
+ }
+
+ /* Copy the loadable segments by their physical (load) addresses */
+
+ phoff  = cu_efile_r32(data, 0x1CU);
+ phsize = cu_efile_r16(data, 0x2AU);
+ phnum  = cu_efile_r16(data, 0x2CU);
+ if ( (phsize < 0x20U) ||
+      (!cu_efile_inside(len, phoff, phsize, phnum)) ){
+  print_error("%s%sInvalid program headers in %s.\n", cu_id, cu_err, fname);
+  goto ex_file;
+ }
+
+ for (i = 0U; i < phnum; i++){
+  ph = phoff + (i * phsize);
+  if (cu_efile_r32(data, ph + 0x00U) != ELF_PT_LOAD){ continue; }
+  poff  = cu_efile_r32(data, ph + 0x04U);
+  paddr = cu_efile_r32(data, ph + 0x0CU);
+  psize = cu_efile_r32(data, ph + 0x10U); /* File size: initialized part */
+  if ( (psize == 0U) ||
+       (paddr >= ELF_AVR_NONROM) ){ continue; }
+  if (!cu_efile_inside(len, poff, 1U, psize)){
+   print_error("%s%sSegment %u outside the file in %s.\n", cu_id, cu_err, i, fname);
+   goto ex_file;
+  }
+  if ( (paddr >= 0x10000U) ||
+       (psize > (0x10000U - paddr)) ){
+   print_error("%s%sToo big address in segment %u in %s.\n", cu_id, cu_err, i, fname);
+   goto ex_file;
+  }
+  memcpy(&cmem[paddr], &data[poff], psize);
+ }
+
+ /* Symbols */
+
+ if (syms != NULL){
+  if (!cu_efile_syms(data, len, syms)){
+   print_error("%s%sOut of memory loading %s.\n", cu_id, cu_err, fname);
+   goto ex_file;
+  }
+ }
+
+ filesys_flush(FILESYS_CH_EMU);
+ return TRUE;
+
+ex_file:
+ filesys_flush(FILESYS_CH_EMU);
+ return FALSE;
+}
+
+
+
+/*
+** Returns the name of the symbol containing the given Code ROM byte address
+** (the last symbol starting at or below it if its size is unknown), or NULL
+** if there is none. If offs is non-NULL, the offset of the address from the
+** symbol's start is returned in it.
+*/
+char const* cu_efile_sym_find(cu_efile_syms_t const* syms, auint addr, auint* offs)
+{
+ auint lo = 0U;
+ auint hi = syms->cnt;
+ auint mid;
+ cu_efile_sym_t const* sym;
+
+ /* Find the first symbol above the address */
+
+ while (lo < hi){
+  mid = (lo + hi) >> 1;
+  if (syms->sym[mid].addr <= addr){ lo = mid + 1U; }
+  else                            { hi = mid; }
+ }
+ if (lo == 0U){ return NULL; }
+
+ /* The largest of those at the same address is the first */
+
+ sym = &syms->sym[lo - 1U];
+ while ( (sym != &syms->sym[0]) &&
+         ((sym - 1)->addr == sym->addr) ){ sym --; }
+ if ( (sym->size != 0U) &&
+      ((addr - sym->addr) >= sym->size) ){ return NULL; }
+
+ if (offs != NULL){ *offs = addr - sym->addr; }
+ return &syms->names[sym->name];
+}
+
+
+
+/*
+** Releases a symbol index.
+*/
+void  cu_efile_syms_free(cu_efile_syms_t* syms)
+{
+ free(syms->sym);
+ free(syms->names);
+ syms->sym   = NULL;
+ syms->cnt   = 0U;
+ syms->names = NULL;
+}
@@ -0,0 +1,85 @@
+/*
+ *  ELF file loader
+ *
+ *  Copyright (C) 2016
+ *    Sandor Zsuga (Jubatian)
+ *  Uzem (the base of CUzeBox) is copyright (C)
+ *    David Etherton,
+ *    Eric Anderton,
+ *    Alec Bourque (Uze),
+ *    Filipe Rinaldi,
+ *    Sandor Zsuga (Jubatian),
+ *    Matt Pandina (Artcfox)
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef CU_EFILE_H
+#define CU_EFILE_H
+
+
+
+#include "types.h"
+
+
+
+/* Symbol of the Code ROM */
+typedef struct{
+ auint addr;              /* Byte address */
+ auint size;              /* Size in bytes (may be zero if unknown) */
+ auint name;              /* Offset of the name in the name pool */
+}cu_efile_sym_t;
+
+/* Symbol index: the function symbols of the Code ROM sorted by address */
+typedef struct{
+ cu_efile_sym_t* sym;     /* Symbols */
+ auint           cnt;     /* Count of symbols */
+ char*           names;   /* Name pool (zero terminated names) */
+}cu_efile_syms_t;
+
+
+
+/*
+** Attempts to load the passed ELF file (32 bit AVR executable, as produced
+** by avr-gcc) into code memory. The loadable segments destined to the Code
+** ROM (.text and the initializers of .data) are copied to their load
+** addresses, the rest of the code memory is not altered. If syms is
+** non-NULL, it receives the symbol index (to be released by
+** cu_efile_syms_free()), it is empty if the file has no symbols.
+**
+** The code memory must be 64 KBytes.
+**
+** Returns TRUE if the loading was successful.
+*/
+boole cu_efile_load(char const* fname, uint8* cmem, cu_efile_syms_t* syms);
+
+
+/*
+** Returns the name of the symbol containing the given Code ROM byte address
+** (the last symbol starting at or below it if its size is unknown), or NULL
+** if there is none. If offs is non-NULL, the offset of the address from the
+** symbol's start is returned in it.
+*/
+char const* cu_efile_sym_find(cu_efile_syms_t const* syms, auint addr, auint* offs);
+
+
+/*
+** Releases a symbol index.
+*/
+void  cu_efile_syms_free(cu_efile_syms_t* syms);
+
+
+#endif
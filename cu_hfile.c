@@ -39,112 +39,137 @@ static const char cu_war[] = "Warning: ";
 
 
 
+/* Hex digit values of characters. Characters up to and including space
+** terminate the digits of a line (0x10), others are invalid (0x20). */
+static const uint8 cu_hex[256U] = {
+ 0x10U, 0x10U, 0x10U, 0x10U, 0x10U, 0x10U, 0x10U, 0x10U,
+ 0x10U, 0x10U, 0x10U, 0x10U, 0x10U, 0x10U, 0x10U, 0x10U,
+ 0x10U, 0x10U, 0x10U, 0x10U, 0x10U, 0x10U, 0x10U, 0x10U,
+ 0x10U, 0x10U, 0x10U, 0x10U, 0x10U, 0x10U, 0x10U, 0x10U,
+ 0x10U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U,
+ 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U,
+ 0x00U, 0x01U, 0x02U, 0x03U, 0x04U, 0x05U, 0x06U, 0x07U,
+ 0x08U, 0x09U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U,
+ 0x20U, 0x0AU, 0x0BU, 0x0CU, 0x0DU, 0x0EU, 0x0FU, 0x20U,
+ 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U,
+ 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U,
+ 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U,
+ 0x20U, 0x0AU, 0x0BU, 0x0CU, 0x0DU, 0x0EU, 0x0FU, 0x20U,
+ 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U,
+ 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U,
+ 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U,
+ 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U,
+ 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U,
+ 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U,
+ 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U,
+ 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U,
+ 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U,
+ 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U,
+ 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U,
+ 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U,
+ 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U,
+ 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U,
+ 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U,
+ 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U,
+ 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U,
+ 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U,
+ 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U, 0x20U
+};
+
+
+
 /*
-** Attempts to load the passed file into code memory. The code memory is not
-** cleared, so bootloader image may be added before this if there is any.
-**
-** The code memory must be 64 KBytes.
-**
-** Returns TRUE if the loading was successful.
+** Parses a hex file read in memory into code memory. Lines are processed as
+** if read in a 128 byte buffer each, a line ending at (including) the first
+** '\n' or '\r', so a "\r\n" terminated line counts as two lines.
 */
-boole cu_hfile_load(char const* fname, uint8* cmem)
+static boole cu_hfile_parse(uint8 const* text, auint tlen,
+                            char const* fname, uint8* cmem)
 {
  uint8 buf[128];
  uint8 dec[64];
+ auint tpos = 0U; /* Position in the file */
  auint lpos = 0U; /* Input file line counter */
  auint cpos = 0U; /* Code memory pointer */
  auint rp;
  auint wp;
- auint lh;
+ auint hv;
+ auint lv;
  auint dv;
- uint8 byte;
-
- if (!filesys_open(FILESYS_CH_EMU, fname)){
-  print_error("%s%sCouldn't open %s.\n", cu_id, cu_err, fname);
-  goto ex_none;
- }
 
  while (TRUE){
 
-  wp = 0U;
-  while (filesys_read(FILESYS_CH_EMU, &byte, 1U) != 0U){
-   if (wp < 127U){
-    buf[wp] = byte;
-    wp ++;
-   }
-   if ( (byte == '\n') ||
-        (byte == '\r') ){ break; }
-  }
-  buf[wp] = 0U;
-  if (wp == 0U){
+  /* Get the next line into the buffer, truncated as necessary */
+
+  wp = tpos;
+  while ( (wp < tlen) &&
+          (text[wp] != (uint8)('\n')) &&
+          (text[wp] != (uint8)('\r')) ){ wp ++; }
+  if (wp < tlen){ wp ++; }
+  if (wp == tpos){
    print_error("%s%sEOF without end marker on line %u in %s.\n", cu_id, cu_war, lpos, fname);
-   goto ex_ok;
+   return TRUE;
   }
+  rp = wp - tpos;
+  if (rp > 127U){ rp = 127U; }
+  memcpy(&buf[0], &text[tpos], rp);
+  buf[rp] = 0U;
+  tpos = wp;
 
   if ( (buf[0] != (uint8)(':')) &&
        (buf[0] != (uint8)('\n')) &&
        (buf[0] != (uint8)('\r')) &&
        (buf[0] != 0U) ){
    print_error("%s%sInvalid content on line %u in %s.\n", cu_id, cu_err, lpos, fname);
-   goto ex_file;
+   return FALSE;
   }
 
   if (buf[0] == (uint8)(':')){ /* A possibly valid hex line */
 
-   /* Decode the line into binary */
+   /* Decode the line into binary by character pairs, summing it up for
+   ** the checksum (the line must add up to zero). The terminating zero of
+   ** the buffer stops the decoding at latest. */
 
    rp = 1U;
    wp = 0U;
-   lh = 0U;
    dv = 0U;
-   while (buf[rp] > (uint8)(' ')){
-    dv <<= 4U;
-    if       ( (buf[rp] >= (uint8)('0')) &&
-               (buf[rp] <= (uint8)('9')) ){
-     dv |= (buf[rp] - (uint8)('0'));
-    }else if ( (buf[rp] >= (uint8)('a')) &&
-               (buf[rp] <= (uint8)('f')) ){
-     dv |= (buf[rp] - (uint8)('a') + 10U);
-    }else if ( (buf[rp] >= (uint8)('A')) &&
-               (buf[rp] <= (uint8)('F')) ){
-     dv |= (buf[rp] - (uint8)('A') + 10U);
-    }else{
-     print_error("%s%sInvalid character on line %u in %s.\n", cu_id, cu_err, lpos, fname);
-     goto ex_file;
-    }
-    lh ^= 1U;
-    if (lh == 0U){
-     dec[wp] = dv;
-     dv = 0U;
-     wp ++;
-    }
-    rp ++;
+   while (TRUE){
+    hv = cu_hex[buf[rp]];
+    if (hv > 0x0FU){ break; }
+    lv = cu_hex[buf[rp + 1U]];
+    if (lv > 0x0FU){ break; }
+    dec[wp] = (hv << 4) | lv;
+    dv += dec[wp];
+    wp ++;
+    rp += 2U;
    }
-   if (lh != 0U){
+   if       (hv > 0x10U){
+    print_error("%s%sInvalid character on line %u in %s.\n", cu_id, cu_err, lpos, fname);
+    return FALSE;
+   }else if (hv == 0x10U){
+    /* Even count of characters, fine */
+   }else if (lv == 0x10U){
     print_error("%s%sOdd count of hex characters on line %u in %s.\n", cu_id, cu_err, lpos, fname);
-    goto ex_file;
+    return FALSE;
+   }else{
+    print_error("%s%sInvalid character on line %u in %s.\n", cu_id, cu_err, lpos, fname);
+    return FALSE;
    }
 
-   /* Verify checksum: Simply the line must add up to zero */
-
-   dv = 0U;
-   for (rp = 0U; rp < wp; rp ++){
-    dv += dec[rp];
-   }
    if ((dv & 0xFFU) != 0U){
     print_error("%s%sBad checksum on line %u in %s.\n", cu_id, cu_err, lpos, fname);
-    goto ex_file;
+    return FALSE;
    }
 
    /* Verify data size */
 
    if (wp < 5U){
     print_error("%s%sToo short line %u in %s.\n", cu_id, cu_err, lpos, fname);
-    goto ex_file;
+    return FALSE;
    }
    if (dec[0] != (wp - 5U)){
     print_error("%s%sBad data count on line %u in %s.\n", cu_id, cu_err, lpos, fname);
-    goto ex_file;
+    return FALSE;
    }
 
    /* Parse the line */
@@ -157,21 +182,19 @@ boole cu_hfile_load(char const* fname, uint8* cmem)
             ((auint)(dec[2])     );
      if (cpos > (0x10000U - (auint)(dec[0]))){
       print_error("%s%sToo big address on line %u in %s.\n", cu_id, cu_err, lpos, fname);
-      goto ex_file;
-     }
-     for (rp = 0U; rp < dec[0]; rp ++){
-      cmem[cpos + rp] = dec[rp + 4U];
+      return FALSE;
      }
+     memcpy(&cmem[cpos], &dec[4], dec[0]);
      break;
 
     case 0x01U: /* End of file */
-     goto ex_ok;
+     return TRUE;
      break;
 
     case 0x04U: /* Extended linear address */
      if (dec[0] != 2U){
       print_error("%s%sInvalid Ext. linear address on line %u in %s.\n", cu_id, cu_err, lpos, fname);
-      goto ex_file;
+      return FALSE;
      }
      cpos = ((auint)(dec[4]) << 24) |
             ((auint)(dec[5]) << 16);
@@ -188,22 +211,32 @@ boole cu_hfile_load(char const* fname, uint8* cmem)
   lpos ++; /* Input file line counter */
 
  }
+}
 
- /* Correct exit */
-
-ex_ok:
-
- filesys_flush(FILESYS_CH_EMU);
 
- /* Successful */
 
- return TRUE;
+/*
+** Attempts to load the passed file into code memory. The code memory is not
+** cleared, so bootloader image may be added before this if there is any.
+**
+** The code memory must be 64 KBytes.
+**
+** Returns TRUE if the loading was successful.
+*/
+boole cu_hfile_load(char const* fname, uint8* cmem)
+{
+ uint8 const* text;
+ auint        tlen;
+ boole        ret;
 
- /* Failing exits */
+ text = filesys_map(FILESYS_CH_EMU, fname, &tlen);
+ if (text == NULL){
+  print_error("%s%sCouldn't open %s.\n", cu_id, cu_err, fname);
+  return FALSE;
+ }
 
-ex_file:
+ ret = cu_hfile_parse(text, tlen, fname, cmem);
  filesys_flush(FILESYS_CH_EMU);
 
-ex_none:
- return FALSE;
+ return ret;
 }
@@ -29,6 +29,14 @@
 
 #include "filesys.h"
 
+#ifdef TARGET_LINUX
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#define FILESYS_MMAP
+#endif
+
 
 
 /* Size of name in the channel state structure */
@@ -44,6 +52,10 @@ typedef struct{
  boole  rd;       /* If TRUE, file is open for reading, otherwise it is closed */
  boole  wr;       /* If TRUE, file is also open for writes (rd must be TRUE too) */
  auint  pos;      /* Position within the file (virtual) */
+ auint  mem;      /* Opened memory file (index in filesys_mem + 1), 0 for real files */
+ uint8* map;      /* Mapped contents of the file if any */
+ auint  mlen;     /* Length of the mapped contents */
+ boole  mm;       /* If TRUE, the contents are mmap()-ed, otherwise allocated */
 }filesys_ch_t;
 
 
@@ -56,12 +68,24 @@ typedef struct{
 #endif
 
 
+/* Memory file */
+typedef struct{
+ char*        name;       /* Name (allocated copy) */
+ uint8 const* data;       /* Contents (provided by the host) */
+ auint        len;        /* Length of the contents */
+}filesys_mem_t;
+
 /* Base path of files */
 static char filesys_path[PATH_SIZE] = {0U};
 
+/* Memory files */
+static filesys_mem_t* filesys_mem     = NULL;
+static auint          filesys_mem_cnt = 0U;
+static auint          filesys_mem_siz = 0U;
+
 /* Channels */
 static filesys_ch_t filesys_ch[FILESYS_CH_NO] = {
- { {0U}, NULL, FALSE, FALSE, 0U},
+ { {0U}, NULL, FALSE, FALSE, 0U, 0U, NULL, 0U, FALSE},
 };
 
 
@@ -96,6 +120,22 @@ static void filesys_addpath(char* dest, const char* src, auint len)
 
 
 
+/*
+** Returns the memory file of the given name, NULL if there is none.
+*/
+static filesys_mem_t* filesys_mem_find(char const* name)
+{
+ auint i;
+
+ for (i = 0U; i < filesys_mem_cnt; i++){
+  if (strcmp(filesys_mem[i].name, name) == 0){ return &filesys_mem[i]; }
+ }
+
+ return NULL;
+}
+
+
+
 /*
 ** Sets path string. All filesystem operations will be carried out on the
 ** set path. If there is a file name on the end of the path, it is removed
@@ -155,10 +195,21 @@ void  filesys_setpath(char const* path, char* name, auint len)
 */
 boole filesys_open(auint ch, char const* name)
 {
+ filesys_mem_t* mf;
+
  /* Clean up previously open file if any */
 
  filesys_flush(ch);
 
+ /* Memory file if there is one by the name */
+
+ mf = filesys_mem_find(name);
+ if (mf != NULL){
+  filesys_ch[ch].mem    = (auint)(mf - filesys_mem) + 1U;
+  filesys_ch[ch].pos    = 0U;
+  return TRUE;
+ }
+
  /* Open new file (or attempt it) */
 
  filesys_addpath(&(filesys_ch[ch].name[0]), name, CH_NSIZE);
@@ -184,6 +235,18 @@ boole filesys_open(auint ch, char const* name)
 auint filesys_read(auint ch, uint8* dest, auint len)
 {
  auint rb;
+ filesys_mem_t* mf;
+
+ /* Memory file */
+
+ if (filesys_ch[ch].mem != 0U){
+  mf = &filesys_mem[filesys_ch[ch].mem - 1U];
+  rb = mf->len - filesys_ch[ch].pos;
+  if (rb > len){ rb = len; }
+  memcpy(dest, &mf->data[filesys_ch[ch].pos], rb);
+  filesys_ch[ch].pos += rb;
+  return rb;
+ }
 
  /* Try to open the file if necessary */
 
@@ -211,15 +274,198 @@ auint filesys_read(auint ch, uint8* dest, auint len)
 
 
 
+/*
+** Maps a file for reading. Returns its contents, the length into len, or
+** NULL on failure. The contents remain valid until the channel is flushed.
+** Where possible the file is mmap()-ed privately, otherwise it is read into
+** an allocated buffer.
+*/
+uint8 const* filesys_map(auint ch, char const* name, auint* len)
+{
+ uint8* buf;
+ uint8* nbuf;
+ auint  bsize;
+ auint  blen;
+ auint  rb;
+#ifdef FILESYS_MMAP
+ int    fd;
+ struct stat fst;
+ void*  mp;
+#endif
+ filesys_mem_t* mf;
+
+ /* Clean up previously open file if any */
+
+ filesys_flush(ch);
+
+ /* Memory files are returned directly */
+
+ mf = filesys_mem_find(name);
+ if (mf != NULL){
+  filesys_ch[ch].mem = (auint)(mf - filesys_mem) + 1U;
+  *len = mf->len;
+  return mf->data;
+ }
+
+ filesys_addpath(&(filesys_ch[ch].name[0]), name, CH_NSIZE);
+
+#ifdef FILESYS_MMAP
+
+ /* Map it if it is a non-empty regular file (the mapping keeps the file's
+ ** contents after closing it) */
+
+ fd = open(&(filesys_ch[ch].name[0]), O_RDONLY);
+ if (fd < 0){ return NULL; }
+ if ( (fstat(fd, &fst) == 0) &&
+      (S_ISREG(fst.st_mode)) &&
+      (fst.st_size > 0) &&
+      (fst.st_size < 0x40000000) ){
+  mp = mmap(NULL, (size_t)(fst.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+  if (mp != MAP_FAILED){
+   (void)(close(fd));
+   filesys_ch[ch].map  = (uint8*)(mp);
+   filesys_ch[ch].mlen = (auint)(fst.st_size);
+   filesys_ch[ch].mm   = TRUE;
+   *len = filesys_ch[ch].mlen;
+   return filesys_ch[ch].map;
+  }
+ }
+ (void)(close(fd));
+
+#endif
+
+ /* Read the whole file */
+
+ if (!filesys_open(ch, name)){ return NULL; }
+ buf   = NULL;
+ bsize = 0U;
+ blen  = 0U;
+ do{
+  if ((blen + 65536U) > bsize){
+   bsize = (bsize == 0U) ? 262144U : (bsize << 1);
+   nbuf  = realloc(buf, bsize);
+   if (nbuf == NULL){
+    free(buf);
+    filesys_flush(ch);
+    return NULL;
+   }
+   buf = nbuf;
+  }
+  rb = filesys_read(ch, &buf[blen], 65536U);
+  blen += rb;
+ }while (rb != 0U);
+ filesys_flush(ch);
+ filesys_ch[ch].map  = buf;
+ filesys_ch[ch].mlen = blen;
+ filesys_ch[ch].mm   = FALSE;
+ *len = blen;
+ return buf;
+}
+
+
+
 /*
 ** Flushes a channel. It internally closes any opened file, safely flushing
-** them as needed.
+** them as needed, and releases its mapped contents.
 */
 void  filesys_flush(auint ch)
 {
  if (filesys_ch[ch].rd){ fclose(filesys_ch[ch].fp); }
  filesys_ch[ch].rd  = FALSE;
  filesys_ch[ch].wr  = FALSE;
+ if (filesys_ch[ch].map != NULL){
+#ifdef FILESYS_MMAP
+  if (filesys_ch[ch].mm){
+   (void)(munmap(filesys_ch[ch].map, filesys_ch[ch].mlen));
+  }else{
+   free(filesys_ch[ch].map);
+  }
+#else
+  free(filesys_ch[ch].map);
+#endif
+ }
+ filesys_ch[ch].map  = NULL;
+ filesys_ch[ch].mlen = 0U;
+ filesys_ch[ch].mm   = FALSE;
+ filesys_ch[ch].mem  = 0U;
+}
+
+
+
+/*
+** Registers a memory file: opening or mapping the given name is served from
+** the passed buffer instead of the filesystem (the set path is not applied
+** to the name). The buffer is not copied, it has to remain valid until the
+** memory file is removed. Registering an existing name replaces it. Returns
+** FALSE if it can not be allocated.
+*/
+boole filesys_mem_add(char const* name, uint8 const* data, auint len)
+{
+ filesys_mem_t* mf = filesys_mem_find(name);
+ filesys_mem_t* nmem;
+ char*          nname;
+ auint          nsiz;
+ auint          i;
+
+ for (i = 0U; i < FILESYS_CH_NO; i++){ /* Might be open on a channel */
+  if ((mf != NULL) && (filesys_ch[i].mem == ((auint)(mf - filesys_mem) + 1U))){
+   filesys_flush(i);
+  }
+ }
+
+ if (mf == NULL){
+  if (filesys_mem_cnt == filesys_mem_siz){
+   nsiz = (filesys_mem_siz == 0U) ? 16U : (filesys_mem_siz << 1);
+   nmem = realloc(filesys_mem, nsiz * sizeof(filesys_mem_t));
+   if (nmem == NULL){ return FALSE; }
+   filesys_mem     = nmem;
+   filesys_mem_siz = nsiz;
+  }
+  nname = malloc(strlen(name) + 1U);
+  if (nname == NULL){ return FALSE; }
+  strcpy(nname, name);
+  mf = &filesys_mem[filesys_mem_cnt];
+  mf->name = nname;
+  filesys_mem_cnt ++;
+ }
+
+ mf->data = (data != NULL) ? data : (uint8 const*)(""); /* Mapping it must not fail */
+ mf->len  = len;
+
+ return TRUE;
+}
+
+
+
+/*
+** Removes a memory file, or all of them if name is NULL. Channels having it
+** open are flushed.
+*/
+void  filesys_mem_remove(char const* name)
+{
+ auint i;
+ auint j;
+
+ for (i = filesys_mem_cnt; i != 0U; i--){
+  if ( (name == NULL) ||
+       (strcmp(filesys_mem[i - 1U].name, name) == 0) ){
+   for (j = 0U; j < FILESYS_CH_NO; j++){
+    if (filesys_ch[j].mem == i){ filesys_flush(j); }
+   }
+   free(filesys_mem[i - 1U].name);
+   filesys_mem[i - 1U] = filesys_mem[filesys_mem_cnt - 1U];
+   for (j = 0U; j < FILESYS_CH_NO; j++){ /* The last one moved in its place */
+    if (filesys_ch[j].mem == filesys_mem_cnt){ filesys_ch[j].mem = i; }
+   }
+   filesys_mem_cnt --;
+  }
+ }
+
+ if (filesys_mem_cnt == 0U){
+  free(filesys_mem);
+  filesys_mem     = NULL;
+  filesys_mem_siz = 0U;
+ }
 }
 
 
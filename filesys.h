@@ -41,6 +41,9 @@
 ** files. This is provided to make it possible to entirely replace the
 ** filesystem in need, such as to provide a self-contained package (planned
 ** mainly for Emscripten use)
+**
+** A host embedding the emulator may also register memory files which are
+** served from its own buffers in place of files of the same name.
 */
 
 
@@ -85,13 +88,36 @@ boole filesys_open(auint ch, char const* name);
 auint filesys_read(auint ch, uint8* dest, auint len);
 
 
+/*
+** Maps a file for reading. Returns its contents, the length into len, or
+** NULL on failure. The contents remain valid until the channel is flushed.
+** Where possible the file is mmap()-ed privately, otherwise it is read into
+** an allocated buffer.
+*/
+uint8 const* filesys_map(auint ch, char const* name, auint* len);
+
 /*
 ** Flushes a channel. It internally closes any opened file, safely flushing
-** them as needed.
+** them as needed, and releases its mapped contents.
 */
 void  filesys_flush(auint ch);
 
 
+/*
+** Registers a memory file: opening or mapping the given name is served from
+** the passed buffer instead of the filesystem (the set path is not applied
+** to the name). The buffer is not copied, it has to remain valid until the
+** memory file is removed. Registering an existing name replaces it. Returns
+** FALSE if it can not be allocated.
+*/
+boole filesys_mem_add(char const* name, uint8 const* data, auint len);
+
+/*
+** Removes a memory file, or all of them if name is NULL. Channels having it
+** open are flushed.
+*/
+void  filesys_mem_remove(char const* name);
+
 /*
 ** Flushes all channels. Should be used before exit.
 */
@@ -0,0 +1,234 @@
+/*
+ *  Compiled image cache
+ *
+ *  Copyright (C) 2016
+ *    Sandor Zsuga (Jubatian)
+ *  Uzem (the base of CUzeBox) is copyright (C)
+ *    David Etherton,
+ *    Eric Anderton,
+ *    Alec Bourque (Uze),
+ *    Filipe Rinaldi,
+ *    Sandor Zsuga (Jubatian),
+ *    Matt Pandina (Artcfox)
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#include "imgcache.h"
+#include "cu_avrc.h"
+#include "filesys.h"
+
+#ifdef TARGET_LINUX
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#define IMGCACHE_ON
+#endif
+
+
+
+/* Version of the entry layout */
+#define IMGCACHE_VER  1U
+
+/* Identifier of entries ("AEIC") */
+#define IMGCACHE_ID   0x43494541U
+
+/* Size of the path of entries */
+#define PATH_SIZE     1024U
+
+
+/* Cache entry. It is stored as-is, so it is only valid on the same kind of
+** host (which is checked by the byte order marker and the size). */
+typedef struct{
+ uint32   id;             /* IMGCACHE_ID */
+ uint32   ver;            /* IMGCACHE_VER */
+ uint32   cver;           /* CU_AVRC_VER */
+ uint32   bom;            /* Byte order marker: 0x01020304U */
+ uint32   size;           /* Size of this structure */
+ uint32   flen;           /* Length of the program file */
+ uint64   fhash;          /* Hash of the program file */
+ uint32   ldr;            /* Loader used on the program file (IMGCACHE_LDR_*) */
+ uint8    rsv[28];        /* Reserved (zero), aligns the contents */
+ uint8    crom[65536];    /* Code ROM */
+ uint32   code[32768];    /* Compiled code (from cu_avr_code_export()) */
+}imgcache_t;
+
+
+#ifdef IMGCACHE_ON
+
+/* Path of the entry of the program file last passed to imgcache_get(), an
+** empty string if there is none */
+static char imgcache_path[PATH_SIZE] = {0};
+
+/* Length and hash of that program file, and the loader used on it */
+static auint    imgcache_flen  = 0U;
+static uint64   imgcache_fhash = 0U;
+static auint    imgcache_ldr   = 0U;
+
+#endif
+
+
+
+#ifdef IMGCACHE_ON
+
+/*
+** Calculates the hash of a program file, 8 bytes at a time.
+*/
+static uint64 imgcache_hash(uint8 const* data, auint len)
+{
+ uint64   h = 0xCBF29CE484222325U ^ len;
+ uint64   w;
+ auint    i;
+
+ for (i = 0U; (i + 8U) <= len; i += 8U){
+  memcpy(&w, &data[i], 8U);
+  h  = (h ^ w) * 0x100000001B3U;
+  h ^= h >> 32;
+ }
+ w = 0U;
+ memcpy(&w, &data[i], len - i);
+ h  = (h ^ w) * 0x100000001B3U;
+ h ^= h >> 29;
+
+ return h;
+}
+
+#endif
+
+
+
+/*
+** Attempts to load the program file through the cache: if it has an entry
+** made with the given loader (IMGCACHE_LDR_*), its Code ROM and compiled
+** code are loaded into the emulator instance as if the program file was
+** loaded then cu_avr_crom_update() was called on it.
+** Returns TRUE if this happened, otherwise the program file has to be
+** loaded normally, then imgcache_put() may be called to store it.
+*/
+boole imgcache_get(cu_avr_ctx_t* avr, char const* fname, auint ldr)
+{
+#ifdef IMGCACHE_ON
+ char const*       dir = getenv("ALUEMU_CACHE");
+ uint8 const*      data;
+ imgcache_t const* ent;
+ struct stat       fst;
+ void*             mp;
+ int               fd;
+ boole             ret = FALSE;
+
+ imgcache_path[0] = 0;
+ imgcache_ldr     = ldr;
+ if ((dir == NULL) || (dir[0] == 0)){ return FALSE; }
+
+ /* Hash the program file to get the entry's path (with the loader) */
+
+ data = filesys_map(FILESYS_CH_EMU, fname, &imgcache_flen);
+ if (data == NULL){ return FALSE; }
+ imgcache_fhash = imgcache_hash(data, imgcache_flen);
+ filesys_flush(FILESYS_CH_EMU);
+
+ if (snprintf(&imgcache_path[0], PATH_SIZE, "%s/%016llx-%u.aic", dir,
+              (unsigned long long)(imgcache_fhash), ldr) >= (int)(PATH_SIZE)){
+  imgcache_path[0] = 0;
+  return FALSE;
+ }
+
+ /* Map the entry if any, and use it if it is valid */
+
+ fd = open(&imgcache_path[0], O_RDONLY);
+ if (fd < 0){ return FALSE; }
+ if ( (fstat(fd, &fst) == 0) &&
+      (fst.st_size == (off_t)(sizeof(imgcache_t))) ){
+  mp = mmap(NULL, sizeof(imgcache_t), PROT_READ, MAP_PRIVATE, fd, 0);
+  if (mp != MAP_FAILED){
+   ent = (imgcache_t const*)(mp);
+   if ( (ent->id    == IMGCACHE_ID) &&
+        (ent->ver   == IMGCACHE_VER) &&
+        (ent->cver  == CU_AVRC_VER) &&
+        (ent->bom   == 0x01020304U) &&
+        (ent->size  == sizeof(imgcache_t)) &&
+        (ent->flen  == imgcache_flen) &&
+        (ent->fhash == imgcache_fhash) &&
+        (ent->ldr   == ldr) ){
+    memcpy(&(cu_avr_get_state(avr)->crom[0]), &ent->crom[0], 65536U);
+    cu_avr_code_import(avr, &ent->code[0]);
+    ret = TRUE;
+   }
+   (void)(munmap(mp, sizeof(imgcache_t)));
+  }
+ }
+ (void)(close(fd));
+
+ return ret;
+#else
+ (void)(avr);
+ (void)(fname);
+ (void)(ldr);
+ return FALSE;
+#endif
+}
+
+
+
+/*
+** Stores the Code ROM of the emulator instance and its compiled code under
+** the program file and loader last passed to imgcache_get() (if the file
+** could be hashed).
+** Failures are silently ignored (the cache is only an optimization).
+*/
+void  imgcache_put(cu_avr_ctx_t* avr)
+{
+#ifdef IMGCACHE_ON
+ char        tpath[PATH_SIZE + 16U];
+ imgcache_t* ent;
+ FILE*       fp;
+ boole       ok;
+
+ if (imgcache_path[0] == 0){ return; }
+
+ ent = calloc(1U, sizeof(imgcache_t));
+ if (ent == NULL){ return; }
+
+ ent->id    = IMGCACHE_ID;
+ ent->ver   = IMGCACHE_VER;
+ ent->cver  = CU_AVRC_VER;
+ ent->bom   = 0x01020304U;
+ ent->size  = sizeof(imgcache_t);
+ ent->flen  = imgcache_flen;
+ ent->fhash = imgcache_fhash;
+ ent->ldr   = imgcache_ldr;
+ memcpy(&ent->crom[0], &(cu_avr_get_state(avr)->crom[0]), 65536U);
+ cu_avr_code_export(avr, &ent->code[0]);
+
+ /* Write it under a temporary name then rename it, so concurrent runs
+ ** never see partial entries */
+
+ snprintf(&tpath[0], sizeof(tpath), "%s.%u", &imgcache_path[0], (auint)(getpid()));
+ fp = fopen(&tpath[0], "wb");
+ if (fp != NULL){
+  ok = (fwrite(ent, sizeof(imgcache_t), 1U, fp) == 1U);
+  ok = (fclose(fp) == 0) && ok;
+  if ((!ok) || (rename(&tpath[0], &imgcache_path[0]) != 0)){
+   (void)(remove(&tpath[0]));
+  }
+ }
+
+ free(ent);
+#else
+ (void)(avr);
+#endif
+}
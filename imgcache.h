@@ -0,0 +1,78 @@
+/*
+ *  Compiled image cache
+ *
+ *  Copyright (C) 2016
+ *    Sandor Zsuga (Jubatian)
+ *  Uzem (the base of CUzeBox) is copyright (C)
+ *    David Etherton,
+ *    Eric Anderton,
+ *    Alec Bourque (Uze),
+ *    Filipe Rinaldi,
+ *    Sandor Zsuga (Jubatian),
+ *    Matt Pandina (Artcfox)
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+
+#ifndef IMGCACHE_H
+#define IMGCACHE_H
+
+
+
+#include "types.h"
+#include "cu_avr.h"
+
+
+
+/*
+** The image cache stores the Code ROM loaded from a program file along with
+** its compiled code in the directory given by the ALUEMU_CACHE environment
+** variable, keyed by the hash of the program file and the loader used on
+** it. Each entry is a file of a fixed layout, so it can be mapped into
+** memory. Without ALUEMU_CACHE the cache is not used. Only supported on
+** Linux.
+*/
+
+
+/* Loaders of program files (the same file may load into different images
+** by different loaders, so their entries are separate) */
+#define IMGCACHE_LDR_HEX  0U
+#define IMGCACHE_LDR_BIN  1U
+#define IMGCACHE_LDR_ELF  2U
+
+
+/*
+** Attempts to load the program file through the cache: if it has an entry
+** made with the given loader (IMGCACHE_LDR_*), its Code ROM and compiled
+** code are loaded into the emulator instance as if the program file was
+** loaded then cu_avr_crom_update() was called on it.
+** Returns TRUE if this happened, otherwise the program file has to be
+** loaded normally, then imgcache_put() may be called to store it.
+*/
+boole imgcache_get(cu_avr_ctx_t* avr, char const* fname, auint ldr);
+
+
+/*
+** Stores the Code ROM of the emulator instance and its compiled code under
+** the program file and loader last passed to imgcache_get() (if the file
+** could be hashed).
+** Failures are silently ignored (the cache is only an optimization).
+*/
+void  imgcache_put(cu_avr_ctx_t* avr);
+
+
+#endif
@@ -28,8 +28,201 @@
 
 #include "types.h"
 #include "cu_hfile.h"
+#include "cu_bfile.h"
+#include "cu_efile.h"
 #include "filesys.h"
 #include "cu_avr.h"
+#include "campaign.h"
+#include "imgcache.h"
+
+
+
+/*
+** Returns whether the passed file name has the given extension (such as
+** ".bin", passed in lower case), case insensitively.
+*/
+static boole main_isext(char const* name, char const* ext)
+{
+ auint len  = strlen(name);
+ auint elen = strlen(ext);
+ auint i;
+
+ if (len < elen){ return FALSE; }
+ for (i = 0U; i < elen; i++){
+  if ((name[len - elen + i] | 0x20) != ext[i]){ return FALSE; }
+ }
+ return TRUE;
+}
+
+
+
+/* Binary results of the program */
+typedef struct{
+ uint8* buf;      /* Results (NULL if none yet) */
+ auint  len;      /* Length of the results */
+ auint  size;     /* Allocated size of the buffer */
+ boole  trunc;    /* Results truncated (out of memory) */
+}main_res_t;
+
+
+
+/*
+** Result function of the emulator collecting the binary results.
+*/
+static void main_result(void* user, uint8 const* data, auint len)
+{
+ main_res_t* res = user;
+ uint8*      nbuf;
+ auint       nsize;
+
+ if ((res->len + len) > res->size){
+  nsize = (res->size == 0U) ? 256U : (res->size << 1);
+  while (nsize < (res->len + len)){ nsize <<= 1; }
+  nbuf = realloc(res->buf, nsize);
+  if (nbuf == NULL){
+   res->trunc = TRUE;
+   return;
+  }
+  res->buf  = nbuf;
+  res->size = nsize;
+ }
+
+ memcpy(res->buf + res->len, data, len);
+ res->len += len;
+}
+
+
+
+/*
+** Writes the binary results of the program into the given file. Returns
+** TRUE on success.
+*/
+static boole main_results(char const* rname, main_res_t const* res, auint status)
+{
+ FILE* fp = fopen(rname, "wb");
+ boole ret;
+
+ if (res->trunc){
+  print_error("Results truncated.\n");
+ }
+ if (fp == NULL){
+  print_error("Couldn't open %s for writing.\n", rname);
+  return FALSE;
+ }
+ ret = campaign_result(fp, 0U, status, res->buf, res->len);
+ if ((fclose(fp) != 0) || (!ret)){
+  print_error("Couldn't write %s.\n", rname);
+  return FALSE;
+ }
+
+ return TRUE;
+}
+
+
+
+/*
+** Loads the golden output the output of the program is compared with. The
+** new line the emulator adds to the end of its output is dropped, so the
+** output of a fault-free run may be used as-is. Returns the output (NULL if
+** it can not be loaded), to be freed.
+*/
+static char* main_golden(char const* gname, auint* len)
+{
+ uint8 const* img;
+ char*        gold;
+ auint        glen;
+
+ img = filesys_map(FILESYS_CH_EMU, gname, &glen);
+ if (img == NULL){
+  print_error("Couldn't read %s.\n", gname);
+  return NULL;
+ }
+ if ((glen != 0U) && (img[glen - 1U] == '\n')){ glen --; }
+ gold = malloc(glen + 1U);
+ if (gold != NULL){ memcpy(gold, img, glen); }
+ filesys_flush(FILESYS_CH_EMU);
+ *len = glen;
+
+ return gold;
+}
+
+
+
+/* Function of the cycle profile report */
+typedef struct{
+ char const* name;  /* Name of the function */
+ auint       cnt;   /* Samples in it */
+}main_pfn_t;
+
+
+
+/*
+** Compares two functions of the cycle profile report for sorting them by
+** their samples, most first.
+*/
+static int main_pfn_cmp(void const* a, void const* b)
+{
+ main_pfn_t const* fa = (main_pfn_t const*)(a);
+ main_pfn_t const* fb = (main_pfn_t const*)(b);
+
+ if (fa->cnt != fb->cnt){ return (fa->cnt > fb->cnt) ? -1 : 1; }
+ return 0;
+}
+
+
+
+/*
+** Reports the cycle profile (samples every ival cycles) on the standard
+** error channel: the cycles spent in each function by the symbol index of
+** the program, most first.
+*/
+static void main_profile(auint const* prof, auint ival, cu_efile_syms_t const* syms)
+{
+ main_pfn_t* fn  = malloc((0x8000U + 1U) * sizeof(main_pfn_t));
+ char const* name;
+ auint       cnt = 0U;
+ auint       unk = 0U;
+ auint       tot = 0U;
+ auint       pm;
+ auint       i;
+
+ if (fn == NULL){
+  print_error("Out of memory for the profile.\n");
+  return;
+ }
+
+ /* The samples of each function, they are consecutive by address */
+
+ for (i = 0U; i < 0x8000U; i++){
+  if (prof[i] == 0U){ continue; }
+  tot += prof[i];
+  name = cu_efile_sym_find(syms, i << 1, NULL);
+  if       (name == NULL){
+   unk += prof[i];
+  }else if ((cnt != 0U) && (fn[cnt - 1U].name == name)){
+   fn[cnt - 1U].cnt += prof[i];
+  }else{
+   fn[cnt].name = name;
+   fn[cnt].cnt  = prof[i];
+   cnt ++;
+  }
+ }
+ if (unk != 0U){
+  fn[cnt].name = "(no symbol)";
+  fn[cnt].cnt  = unk;
+  cnt ++;
+ }
+
+ qsort(fn, cnt, sizeof(main_pfn_t), &main_pfn_cmp);
+
+ for (i = 0U; i < cnt; i++){
+  pm = (auint)(((uint64)(fn[i].cnt) * 1000U) / tot);
+  fprintf(stderr, "Profile: %u cycles (%u.%u%%) in %s\n",
+          fn[i].cnt * ival, pm / 10U, pm % 10U, fn[i].name);
+ }
+
+ free(fn);
+}
 
 
 
@@ -38,28 +231,155 @@
 */
 int main (int argc, char** argv)
 {
+ cu_avr_ctx_t*     avr;
  cu_state_cpu_t*   ecpu;
  char              tstr[128];
  char const*       game = "default.hex";
+ char const*       camp = NULL;
+ char const*       rnam = getenv("ALUEMU_RESULT");
+ char const*       gnam = getenv("ALUEMU_GOLDEN");
+ char const*       gpfx = getenv("ALUEMU_GOLDEN_PREFIX");
+ char const*       conv = getenv("ALUEMU_CONVERGE");
+ char const*       hang = getenv("ALUEMU_HANG");
+ char const*       hbud = getenv("ALUEMU_HANG_BUDGET");
+ char const*       pivl = getenv("ALUEMU_PROFILE");
+ auint*            prof = NULL;
+ cu_efile_syms_t   syms;
+ char*             gold = NULL;
+ auint             glen = 0U;
+ auint             gpos;
+ auint             gcyc;
+ auint             gst;
+ auint             hcyc;
+ auint             hper;
+ auint             hst;
+ auint             thrd = 0U;
+ auint             stat;
+ main_res_t        res;
+ auint             ldr;
+ boole             lres;
+ boole             cres;
 
  if (argc > 1){ game = argv[1]; }
+ if (argc > 2){ camp = argv[2]; }
+ if (argc > 3){ thrd = (auint)(atoi(argv[3])); }
+ if ((rnam != NULL) && (rnam[0] == 0)){ rnam = NULL; }
+ if ((pivl != NULL) && (strtoul(pivl, NULL, 0) == 0U)){ pivl = NULL; }
+ if (camp != NULL){ pivl = NULL; } /* Only single runs are profiled */
+ memset(&syms, 0, sizeof(syms));
  filesys_setpath(game, &(tstr[0]), 100U); /* Locate everything beside the game */
 
- ecpu = cu_avr_get_state();
-
- if (!cu_hfile_load(&(tstr[0]), &(ecpu->crom[0]))){
+ avr = cu_avr_new();
+ if (avr == NULL){
   return 1;
  }
 
+ ecpu = cu_avr_get_state(avr);
+
+ ldr = IMGCACHE_LDR_HEX;
+ if      (main_isext(&(tstr[0]), ".bin")){ ldr = IMGCACHE_LDR_BIN; }
+ else if (main_isext(&(tstr[0]), ".elf")){ ldr = IMGCACHE_LDR_ELF; }
+
+ /* The cached image has no symbols, so an ELF file to profile is loaded */
+
+ if ( ((pivl != NULL) && (ldr == IMGCACHE_LDR_ELF)) ||
+      (!imgcache_get(avr, &(tstr[0]), ldr)) ){
+  if       (ldr == IMGCACHE_LDR_BIN){
+   lres = cu_bfile_load(&(tstr[0]), &(ecpu->crom[0]));
+  }else if (ldr == IMGCACHE_LDR_ELF){
+   lres = cu_efile_load(&(tstr[0]), &(ecpu->crom[0]),
+                        (pivl != NULL) ? &syms : NULL);
+  }else{
+   lres = cu_hfile_load(&(tstr[0]), &(ecpu->crom[0]));
+  }
+  if (!lres){
+   cu_avr_free(avr);
+   return 1;
+  }
+  imgcache_put(avr);
+ }
+
  ecpu->wd_seed = rand(); /* Seed the WD timeout used for PRNG seed in Uzebox games */
 
- cu_avr_reset();
+ if ((gnam != NULL) && (gnam[0] != 0)){ /* Golden output to compare with */
+  filesys_setpath(gnam, &(tstr[0]), 100U);
+  gold = main_golden(&(tstr[0]), &glen);
+  if (gold == NULL){
+   cu_avr_free(avr);
+   return 1;
+  }
+  gpos = (gpfx != NULL) ? (auint)(strtoul(gpfx, NULL, 0)) : 0U;
+  cu_avr_set_golden(avr, gold, glen, gpos);
+  campaign_set_golden(gold, glen, gpos);
+ }
+
+ if (camp != NULL){ /* Fault campaign: run the program for each configuration */
+  if (conv != NULL){ campaign_set_conv((auint)(strtoul(conv, NULL, 0))); }
+  campaign_set_hang((hang != NULL) ? (auint)(strtoul(hang, NULL, 0)) : 0U,
+                    (hbud != NULL) ? (auint)(strtoul(hbud, NULL, 0)) : 0U);
+  filesys_setpath(camp, &(tstr[0]), 100U);
+  cres = campaign_run(ecpu, &(tstr[0]), thrd, rnam);
+  cu_avr_free(avr);
+  filesys_flushall();
+  free(gold);
+  return (cres ? 0 : 1);
+ }
+
+ memset(&res, 0, sizeof(res));
+ if (rnam != NULL){
+  cu_avr_set_result(avr, &main_result, &res);
+ }
+
+ if (hang != NULL){
+  cu_avr_set_hang(avr, (auint)(strtoul(hang, NULL, 0)), 0U, 0U);
+ }
+
+ if (pivl != NULL){
+  prof = calloc(0x8000U, sizeof(auint));
+  if (prof == NULL){
+   print_error("Out of memory for the profile.\n");
+   pivl = NULL;
+  }else{
+   cu_avr_set_profile(avr, prof, (auint)(strtoul(pivl, NULL, 0)));
+  }
+ }
 
- cu_avr_run();
+ cu_avr_reset(avr);
+
+ cu_avr_run(avr);
+
+ stat = cu_avr_get_status(avr); /* Exit status set by the program */
+ gst  = cu_avr_get_golden(avr, &gpos, &gcyc);
+ hst  = cu_avr_get_hang(avr, &hcyc, &hper);
+
+ cu_avr_free(avr);
 
  filesys_flushall();
 
  print_unf("\n"); /* New line to terminate any text line produced by running code */
 
- return 0;
+ if (gold != NULL){
+  fflush(stdout);
+  campaign_golden(stderr, gst, gpos, gcyc, glen);
+  free(gold);
+ }
+
+ if (hang != NULL){
+  fflush(stdout);
+  campaign_hang(stderr, hst, hcyc, hper);
+ }
+
+ if (pivl != NULL){
+  fflush(stdout);
+  main_profile(prof, (auint)(strtoul(pivl, NULL, 0)), &syms);
+ }
+ free(prof);
+ cu_efile_syms_free(&syms);
+
+ if (rnam != NULL){
+  if (!main_results(rnam, &res, stat)){ stat = 1U; }
+  free(res.buf);
+ }
+
+ return (int)(stat);
 }